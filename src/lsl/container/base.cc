@@ -34,6 +34,13 @@ void ContainerBase<T>::Remove( const KeyType& index )
     }
 }
 
+template < class T >
+void ContainerBase<T>::Clear()
+{
+    m_map.clear();
+    m_seekpos = SEEKPOS_INVALID;
+}
+
 template < class T >
 const typename ContainerBase<T>::PointerType ContainerBase<T>::Get( const KeyType& index ) const
 {
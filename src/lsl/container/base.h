@@ -43,6 +43,8 @@ public:
     void Add( PointerType item );
     PointerType Add( ItemType* item );
 	void Remove( const KeyType& key );
+	//! drop all items at once
+	void Clear();
 	//! throws MissingItemException if no item at \param key
 	const PointerType Get( const KeyType& key ) const;
 	PointerType Get( const KeyType& key );
@@ -1,5 +1,7 @@
 #include "battlelist.h"
 
+#include <algorithm>
+
 namespace LSL {
 namespace Battle {
 
@@ -9,4 +11,201 @@ std::string BattleList::GetChannelName( const ConstIBattlePtr /*battle*/ )
     return "";
 }
 
+void BattleList::Add( PointerType item )
+{
+    ContainerBase< Battle >::Add( item );
+    UpdateIndex( item );
+}
+
+BattleList::PointerType BattleList::Add( ItemType* item )
+{
+    PointerType p( item );
+    Add( p );
+    return p;
+}
+
+void BattleList::Remove( const KeyType& key )
+{
+    std::map< KeyType, IndexEntry >::iterator it = m_entries.find( key );
+    if ( it != m_entries.end() ) {
+        Unindex( key, it->second );
+        m_entries.erase( it );
+    }
+    ContainerBase< Battle >::Remove( key );
+}
+
+void BattleList::Clear()
+{
+    m_entries.clear();
+    m_by_founder.clear();
+    m_by_map.clear();
+    m_by_mod.clear();
+    m_in_game.clear();
+    m_open.clear();
+    m_by_free_slots.clear();
+    ContainerBase< Battle >::Clear();
+}
+
+BattleList::IndexEntry BattleList::MakeEntry( const IBattle& battle )
+{
+    IndexEntry entry;
+    entry.founder = battle.GetBattleOptions().founder;
+    entry.map_hash = battle.GetHostMapHash();
+    entry.mod_hash = battle.GetHostModHash();
+    entry.in_game = battle.InGame();
+    entry.free_slots = std::max( 0, int(battle.GetMaxPlayers()) - int(battle.GetNumActivePlayers()) );
+    return entry;
+}
+
+void BattleList::UpdateIndex( const ConstIBattlePtr battle )
+{
+    if ( !battle )
+        return;
+    const KeyType id = battle->key();
+    if ( !Exists( id ) )
+        return;
+    const IndexEntry entry = MakeEntry( *battle );
+    std::map< KeyType, IndexEntry >::iterator it = m_entries.find( id );
+    if ( it != m_entries.end() ) {
+        const IndexEntry& old = it->second;
+        if ( old.founder == entry.founder && old.map_hash == entry.map_hash
+             && old.mod_hash == entry.mod_hash && old.in_game == entry.in_game
+             && old.free_slots == entry.free_slots )
+            return;
+        Unindex( id, old );
+    }
+    m_entries[id] = entry;
+    Index( id, entry );
+}
+
+namespace {
+template < class Index, class Key, class Id >
+void EraseFromBucket( Index& index, const Key& key, const Id& id )
+{
+    typename Index::iterator it = index.find( key );
+    if ( it == index.end() )
+        return;
+    it->second.erase( id );
+    if ( it->second.empty() )
+        index.erase( it );
+}
+} // namespace
+
+void BattleList::Unindex( const KeyType& id, const IndexEntry& entry )
+{
+    EraseFromBucket( m_by_founder, entry.founder, id );
+    EraseFromBucket( m_by_map, entry.map_hash, id );
+    EraseFromBucket( m_by_mod, entry.mod_hash, id );
+    EraseFromBucket( m_by_free_slots, entry.free_slots, id );
+    m_in_game.erase( id );
+    m_open.erase( id );
+}
+
+void BattleList::Index( const KeyType& id, const IndexEntry& entry )
+{
+    m_by_founder[entry.founder].insert( id );
+    m_by_map[entry.map_hash].insert( id );
+    m_by_mod[entry.mod_hash].insert( id );
+    m_by_free_slots[entry.free_slots].insert( id );
+    if ( entry.in_game )
+        m_in_game.insert( id );
+    else
+        m_open.insert( id );
+}
+
+BattleVector BattleList::Collect( const IdSet& ids ) const
+{
+    BattleVector ret;
+    ret.reserve( ids.size() );
+    for ( IdSet::const_iterator it = ids.begin(); it != ids.end(); ++it ) {
+        MapType::const_iterator b = find( *it );
+        if ( b != end() )
+            ret.push_back( b->second );
+    }
+    return ret;
+}
+
+BattleVector BattleList::FindByFounder( const std::string& nick ) const
+{
+    StringIndex::const_iterator it = m_by_founder.find( nick );
+    return it == m_by_founder.end() ? BattleVector() : Collect( it->second );
+}
+
+BattleVector BattleList::FindByMapHash( const std::string& hash ) const
+{
+    StringIndex::const_iterator it = m_by_map.find( hash );
+    return it == m_by_map.end() ? BattleVector() : Collect( it->second );
+}
+
+BattleVector BattleList::FindByModHash( const std::string& hash ) const
+{
+    StringIndex::const_iterator it = m_by_mod.find( hash );
+    return it == m_by_mod.end() ? BattleVector() : Collect( it->second );
+}
+
+BattleVector BattleList::FindInGame( bool in_game ) const
+{
+    return Collect( in_game ? m_in_game : m_open );
+}
+
+BattleVector BattleList::FindWithFreeSlots( int min_free ) const
+{
+    IdSet ids;
+    for ( std::map< int, IdSet >::const_iterator it = m_by_free_slots.lower_bound( min_free );
+          it != m_by_free_slots.end(); ++it )
+        ids.insert( it->second.begin(), it->second.end() );
+    return Collect( ids );
+}
+
+bool BattleList::Matches( const IndexEntry& entry, const BattleQuery& q )
+{
+    if ( !q.founder.empty() && entry.founder != q.founder )
+        return false;
+    if ( !q.map_hash.empty() && entry.map_hash != q.map_hash )
+        return false;
+    if ( !q.mod_hash.empty() && entry.mod_hash != q.mod_hash )
+        return false;
+    if ( q.in_game >= 0 && entry.in_game != ( q.in_game > 0 ) )
+        return false;
+    if ( q.min_free_slots >= 0 && entry.free_slots < q.min_free_slots )
+        return false;
+    return true;
+}
+
+BattleVector BattleList::Query( const BattleQuery& q ) const
+{
+    // start from the most selective string index available, then filter on the cached entries
+    const IdSet* candidates = NULL;
+    static const IdSet empty;
+    const std::pair< const StringIndex*, const std::string* > string_indexes[] = {
+        std::make_pair( &m_by_founder, &q.founder ),
+        std::make_pair( &m_by_map, &q.map_hash ),
+        std::make_pair( &m_by_mod, &q.mod_hash )
+    };
+    for ( size_t i = 0; i < sizeof(string_indexes)/sizeof(string_indexes[0]); ++i ) {
+        if ( string_indexes[i].second->empty() )
+            continue;
+        StringIndex::const_iterator it = string_indexes[i].first->find( *string_indexes[i].second );
+        const IdSet* bucket = ( it == string_indexes[i].first->end() ) ? &empty : &it->second;
+        if ( !candidates || bucket->size() < candidates->size() )
+            candidates = bucket;
+    }
+    if ( !candidates && q.in_game >= 0 )
+        candidates = q.in_game > 0 ? &m_in_game : &m_open;
+
+    IdSet ids;
+    if ( candidates ) {
+        for ( IdSet::const_iterator it = candidates->begin(); it != candidates->end(); ++it ) {
+            std::map< KeyType, IndexEntry >::const_iterator e = m_entries.find( *it );
+            if ( e != m_entries.end() && Matches( e->second, q ) )
+                ids.insert( *it );
+        }
+    } else {
+        for ( std::map< KeyType, IndexEntry >::const_iterator e = m_entries.begin(); e != m_entries.end(); ++e )
+            if ( Matches( e->second, q ) )
+                ids.insert( e->first );
+    }
+    return Collect( ids );
+}
+
 } } //namespace LSL { namespace Battle {
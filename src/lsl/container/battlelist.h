@@ -5,14 +5,83 @@
 #include <lsl/battle/battle.h>
 #include <lslutils/type_forwards.h>
 
+#include <set>
+
 namespace LSL {
 namespace Battle {
 
-//! container for battle pointer
+typedef std::vector< BattlePtr >
+    BattleVector;
+
+/** \brief filter for BattleList::Query
+ * empty strings / negative numbers mean "don't care"
+ **/
+struct BattleQuery {
+    BattleQuery() : in_game(-1), min_free_slots(-1) {}
+    std::string founder;
+    std::string map_hash;
+    std::string mod_hash;
+    //! 0 -> only open battles, 1 -> only running ones
+    int in_game;
+    int min_free_slots;
+};
+
+/** \brief container for battle pointer
+ *
+ * Keeps secondary indexes on founder nick, map hash, mod hash, in-game flag
+ * and free player slots. The lobby model mutates battles in place, so whoever
+ * changes one of those properties has to call UpdateIndex afterwards.
+ **/
 class BattleList : public ContainerBase< Battle >
 {
 public:
     std::string GetChannelName( const ConstIBattlePtr battle );
+
+    void Add( PointerType item );
+    PointerType Add( ItemType* item );
+    void Remove( const KeyType& key );
+    void Clear();
+
+    //! re-read the indexed properties of \param battle, no-op for unknown battles
+    void UpdateIndex( const ConstIBattlePtr battle );
+
+    BattleVector FindByFounder( const std::string& nick ) const;
+    BattleVector FindByMapHash( const std::string& hash ) const;
+    BattleVector FindByModHash( const std::string& hash ) const;
+    BattleVector FindInGame( bool in_game ) const;
+    BattleVector FindWithFreeSlots( int min_free = 1 ) const;
+    //! all battles matching every criterion set in \param q
+    BattleVector Query( const BattleQuery& q ) const;
+
+private:
+    typedef std::set< KeyType >
+        IdSet;
+    typedef std::map< std::string, IdSet >
+        StringIndex;
+
+    //! the indexed values as last seen, needed to find the old buckets on change
+    struct IndexEntry {
+        std::string founder;
+        std::string map_hash;
+        std::string mod_hash;
+        bool in_game;
+        int free_slots;
+    };
+
+    static IndexEntry MakeEntry( const IBattle& battle );
+    void Unindex( const KeyType& id, const IndexEntry& entry );
+    void Index( const KeyType& id, const IndexEntry& entry );
+    static bool Matches( const IndexEntry& entry, const BattleQuery& q );
+    BattleVector Collect( const IdSet& ids ) const;
+
+    std::map< KeyType, IndexEntry > m_entries;
+    StringIndex m_by_founder;
+    StringIndex m_by_map;
+    StringIndex m_by_mod;
+    IdSet m_in_game;
+    IdSet m_open;
+    //! free slots -> battles, ordered so "at least n" is a range scan
+    std::map< int, IdSet > m_by_free_slots;
 };
 
 } //namespace Battle
@@ -0,0 +1,219 @@
+#ifndef LIBSPRINGLOBBY_HEADERGUARD_OBJECTPOOL_H
+#define LIBSPRINGLOBBY_HEADERGUARD_OBJECTPOOL_H
+
+#include <map>
+#include <cstddef>
+#include <typeinfo>
+#include <typeindex>
+#include <boost/pool/pool.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace LSL {
+
+/** \brief Size-segregated arena for the lobby model (users, battles, channels)
+ *
+ * Blocks of equal size share one boost::pool, so slots freed by a quitting user
+ * are reused by the next one and all chunks go back to the heap at once when
+ * the arena dies. Allocations from boost::allocate_shared keep the arena alive
+ * through their allocator copy, objects may therefore safely outlive the owner.
+ */
+class ObjectArena : public boost::noncopyable
+{
+public:
+	//! \param objects_per_chunk how many slots of a given size are grabbed from the heap at once
+	explicit ObjectArena( std::size_t objects_per_chunk = 256 )
+		: m_chunk_size( objects_per_chunk )
+		, m_in_use( 0 )
+	{}
+
+	~ObjectArena()
+	{
+		for ( PoolMap::iterator it = m_pools.begin(); it != m_pools.end(); ++it )
+			delete it->second;
+	}
+
+	//! \param chunk_hint slots grabbed at once if this is the first block of its size, 0 for the default
+	void* Allocate( std::size_t bytes, std::size_t chunk_hint = 0 )
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		void* p = GetPool( bytes, chunk_hint ).malloc();
+		if ( !p )
+			throw std::bad_alloc();
+		++m_in_use;
+		return p;
+	}
+
+	void Deallocate( void* p, std::size_t bytes )
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		GetPool( bytes, 0 ).free( p );
+		--m_in_use;
+	}
+
+	//! number of live objects allocated from this arena
+	std::size_t InUse() const
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		return m_in_use;
+	}
+
+private:
+	typedef std::map< std::size_t, boost::pool<>* >
+		PoolMap;
+
+	boost::pool<>& GetPool( std::size_t bytes, std::size_t chunk_hint )
+	{
+		PoolMap::iterator it = m_pools.find( bytes );
+		if ( it == m_pools.end() ) {
+			const std::size_t chunk = chunk_hint > 0 ? chunk_hint : m_chunk_size;
+			it = m_pools.insert( std::make_pair( bytes, new boost::pool<>( bytes, chunk ) ) ).first;
+		}
+		return *it->second;
+	}
+
+	PoolMap m_pools;
+	const std::size_t m_chunk_size;
+	std::size_t m_in_use;
+	mutable boost::mutex m_lock;
+};
+
+typedef boost::shared_ptr< ObjectArena >
+	ObjectArenaPtr;
+
+//! minimal std allocator drawing from an ObjectArena, meant for boost::allocate_shared
+template < class T >
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template < class U >
+	struct rebind { typedef ArenaAllocator<U> other; };
+
+	//! \param chunk_hint see ObjectArena::Allocate, carried over to the rebound allocators
+	explicit ArenaAllocator( const ObjectArenaPtr& arena, std::size_t chunk_hint = 0 )
+		: m_arena( arena ), m_chunk_hint( chunk_hint ) {}
+	template < class U >
+	ArenaAllocator( const ArenaAllocator<U>& o ) : m_arena( o.m_arena ), m_chunk_hint( o.m_chunk_hint ) {}
+
+	pointer allocate( size_type n, const void* = 0 )
+	{
+		return static_cast<pointer>( m_arena->Allocate( n * sizeof(T), m_chunk_hint ) );
+	}
+	void deallocate( pointer p, size_type n )
+	{
+		m_arena->Deallocate( p, n * sizeof(T) );
+	}
+
+	template < class U >
+	bool operator == ( const ArenaAllocator<U>& o ) const { return m_arena == o.m_arena; }
+	template < class U >
+	bool operator != ( const ArenaAllocator<U>& o ) const { return m_arena != o.m_arena; }
+
+private:
+	template < class U > friend class ArenaAllocator;
+	ObjectArenaPtr m_arena;
+	std::size_t m_chunk_hint;
+};
+
+//! per-server factory for lobby model objects, shares one arena across all types
+class ObjectPool
+{
+public:
+	ObjectPool() : m_arena( new ObjectArena() ) {}
+
+	template < class T >
+	boost::shared_ptr<T> Create()
+	{ return boost::allocate_shared<T>( Allocator<T>() ); }
+	template < class T, class A1 >
+	boost::shared_ptr<T> Create( const A1& a1 )
+	{ return boost::allocate_shared<T>( Allocator<T>(), a1 ); }
+	template < class T, class A1, class A2 >
+	boost::shared_ptr<T> Create( const A1& a1, const A2& a2 )
+	{ return boost::allocate_shared<T>( Allocator<T>(), a1, a2 ); }
+	template < class T, class A1, class A2, class A3 >
+	boost::shared_ptr<T> Create( const A1& a1, const A2& a2, const A3& a3 )
+	{ return boost::allocate_shared<T>( Allocator<T>(), a1, a2, a3 ); }
+	template < class T, class A1, class A2, class A3, class A4, class A5 >
+	boost::shared_ptr<T> Create( const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5 )
+	{ return boost::allocate_shared<T>( Allocator<T>(), a1, a2, a3, a4, a5 ); }
+
+	/** \brief drop the current arena after the model has been cleared
+	 *
+	 * Objects still referenced elsewhere keep the old arena alive until they are gone,
+	 * new allocations start from a fresh, unfragmented one.
+	 */
+	void Reset() { m_arena.reset( new ObjectArena() ); }
+
+	/** \brief pre-size the arena for \param objects live objects of type \a T
+	 *
+	 * Only the size class of \a T grabs that many slots at once, other types keep
+	 * the default. Takes effect when that size class is first used, so call it while
+	 * the pool is empty; a type sharing its size with an earlier one gets that chunk size.
+	 */
+	template < class T >
+	void Reserve( std::size_t objects )
+	{
+		if ( objects == 0 )
+			return;
+		if ( m_arena->InUse() == 0 )
+			m_arena.reset( new ObjectArena() ); // forget chunk sizes picked before
+		m_hints[ std::type_index( typeid(T) ) ] = objects;
+	}
+
+	std::size_t InUse() const { return m_arena->InUse(); }
+
+private:
+	template < class T >
+	ArenaAllocator<T> Allocator() const
+	{
+		HintMap::const_iterator it = m_hints.find( std::type_index( typeid(T) ) );
+		return ArenaAllocator<T>( m_arena, it == m_hints.end() ? 0 : it->second );
+	}
+
+	typedef std::map< std::type_index, std::size_t >
+		HintMap;
+
+	ObjectArenaPtr m_arena;
+	HintMap m_hints;
+};
+
+} //namespace LSL
+
+/**
+ * \file objectpool.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LIBSPRINGLOBBY_HEADERGUARD_OBJECTPOOL_H
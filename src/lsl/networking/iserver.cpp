@@ -434,7 +434,13 @@ void Server::OnDisconnected()
     m_impl->m_relay_masters.clear();
     m_impl->GetLastPingID() = 0;
     m_impl->GetPingList().clear();
-	// delete all users, battles, channels
+    // delete all users, battles, channels
+    m_impl->m_battles.Clear();
+    m_impl->m_users.Clear();
+    m_impl->m_channels.Clear();
+    m_impl->m_current_battle.reset();
+    m_impl->m_pool.Reset();
+    m_impl->ModelChanged( ServerImpl::MODEL_USERS | ServerImpl::MODEL_BATTLES );
 	sig_Disconnected( connectionwaspresent );
 }
 
@@ -469,7 +475,6 @@ void Server::OnNewUser( const UserPtr user )
 void Server::OnUserStatus( const UserPtr user, UserStatus status )
 {
 	if ( !user ) return;
-    UserStatus oldStatus = user->Status();
 	user->SetStatus( status );
 	//TODO: event
 }
@@ -834,6 +839,7 @@ void Server::SendHostInfo(const std::string &key)
 void Server::RemoveUser(const CommonUserPtr user)
 {
     m_impl->m_users.Remove( user->key() );
+    m_impl->ModelChanged( ServerImpl::MODEL_USERS | ServerImpl::MODEL_BATTLES );
 }
 
 void Server::RemoveChannel(const ChannelPtr chan)
@@ -841,9 +847,42 @@ void Server::RemoveChannel(const ChannelPtr chan)
     m_impl->m_channels.Remove( chan->key() );
 }
 
+void Server::SetSizeHints( const LobbySizeHints& hints ) { m_impl->m_size_hints = hints; }
+LobbySizeHints Server::GetSizeHints() const { return m_impl->m_size_hints; }
+long Server::GetLoginInfoDuration() const { return m_impl->m_login_info_duration; }
+
+LobbySnapshotPtr Server::Snapshot() const
+{
+    const LobbySnapshotPtr old = m_impl->m_snapshot;
+    if ( old && old->generation == m_impl->m_model_generation )
+        return old;
+    // columns that did not change since the last snapshot are shared, not copied
+    boost::shared_ptr< LobbySnapshot > snap( new LobbySnapshot() );
+    snap->generation = m_impl->m_model_generation;
+    if ( old && old->users->generation == m_impl->m_users_generation )
+        snap->users = old->users;
+    else
+        snap->users = MakeSnapshotUsers( m_impl->m_users, m_impl->m_users_generation );
+    if ( old && old->battles->generation == m_impl->m_battles_generation )
+        snap->battles = old->battles;
+    else
+        snap->battles = MakeSnapshotBattles( m_impl->m_battles, m_impl->m_battles_generation );
+    m_impl->m_snapshot = snap;
+    return snap;
+}
+
+const Battle::BattleList& Server::GetBattleList() const { return m_impl->m_battles; }
+Battle::BattleVector Server::FindBattles( const Battle::BattleQuery& q ) const { return m_impl->m_battles.Query( q ); }
+Battle::BattleVector Server::FindBattlesByFounder( const std::string& nick ) const { return m_impl->m_battles.FindByFounder( nick ); }
+Battle::BattleVector Server::FindBattlesByMapHash( const std::string& hash ) const { return m_impl->m_battles.FindByMapHash( hash ); }
+Battle::BattleVector Server::FindBattlesByModHash( const std::string& hash ) const { return m_impl->m_battles.FindByModHash( hash ); }
+Battle::BattleVector Server::FindBattlesInGame( bool in_game ) const { return m_impl->m_battles.FindInGame( in_game ); }
+Battle::BattleVector Server::FindBattlesWithFreeSlots( int min_free ) const { return m_impl->m_battles.FindWithFreeSlots( min_free ); }
+
 void Server::RemoveBattle(const IBattlePtr battle)
 {
     m_impl->m_battles.Remove( battle->key() );
+    m_impl->ModelChanged( ServerImpl::MODEL_USERS | ServerImpl::MODEL_BATTLES );
 }
 
 void Server::SendMyBattleStatus( const UserBattleStatus& bs )
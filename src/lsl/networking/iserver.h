@@ -16,6 +16,7 @@
 
 #include <lslutils/type_forwards.h>
 #include "enums.h"
+#include "snapshot.h"
 
 namespace LSL {
 
@@ -52,6 +53,14 @@ struct MuteListEntry {
 typedef std::list<MuteListEntry>
     MuteList;
 
+//! expected lobby population, used to pre-size containers before the login burst
+struct LobbySizeHints {
+    LobbySizeHints() : users(0), battles(0), channels(0) {}
+    size_t users;
+    size_t battles;
+    size_t channels;
+};
+
 class Server : public boost::enable_shared_from_this<Server>
 {
   public:
@@ -68,12 +77,16 @@ class Server : public boost::enable_shared_from_this<Server>
     boost::signals2::signal<void ()> sig_Timeout;
     //! success | msg | msg_id
     boost::signals2::signal<void (bool,std::string,int)> sig_SentMessage;
-    //! user whose status changed | the changed status
-    boost::signals2::signal<void (const ConstUserPtr,UserStatus)> sig_UserStatusChanged;
+    //! user whose status changed | the changed status | UserStatus::FIELD_* bits that changed
+    boost::signals2::signal<void (const ConstUserPtr,UserStatus,unsigned int)> sig_UserStatusChanged;
+    //! user whose battle status changed | the changed status | UserBattleStatus::FIELD_* bits that changed
+    boost::signals2::signal<void (const ConstCommonUserPtr,UserBattleStatus,unsigned int)> sig_UserBattleStatusChanged;
     //! was_online
     boost::signals2::signal<void (bool)> sig_Disconnected;
     //! the udp port
     boost::signals2::signal<void (int)> sig_MyInternalUdpSourcePort;
+    //! milliseconds from sending LOGIN until LOGININFOEND
+    boost::signals2::signal<void (long)> sig_LoginInfoComplete;
 
 	void Connect( const std::string& servername, const std::string& addr, const int port );
     void Disconnect(const std::string& reason);
@@ -107,6 +120,15 @@ class Server : public boost::enable_shared_from_this<Server>
 
     std::string GetServerName() const;
 
+    /** \brief sizes used to pre-allocate storage on the next login
+     * after each completed login these are replaced by the sizes actually seen,
+     * store GetSizeHints() across sessions and feed it back here to start warm
+     **/
+    void SetSizeHints( const LobbySizeHints& hints );
+    LobbySizeHints GetSizeHints() const;
+    //! milliseconds the last login took until LOGININFOEND, -1 if none completed yet
+    long GetLoginInfoDuration() const;
+
     void SetRelayIngamePassword(const CommonUserPtr user );
 
 	UserPtr AcquireRelayhost();
@@ -139,6 +161,25 @@ class Server : public boost::enable_shared_from_this<Server>
     void SendHostInfo(Enum::HostInfo update);
     void SendHostInfo(const std::string &key);
 
+    /** \brief immutable copy of all users and battles, safe to hand to other threads
+     * must be called from the thread processing server commands; repeated calls
+     * without intervening model changes return the same shared instance
+     **/
+    LobbySnapshotPtr Snapshot() const;
+
+    /** \brief live battle list with its founder, map, mod, state and free slot indexes
+     * same threading rule as Snapshot(), the references and pointers are not stable
+     * across server commands
+     **/
+    const Battle::BattleList& GetBattleList() const;
+    //! all battles matching \param q, see Battle::BattleList::Query
+    Battle::BattleVector FindBattles( const Battle::BattleQuery& q ) const;
+    Battle::BattleVector FindBattlesByFounder( const std::string& nick ) const;
+    Battle::BattleVector FindBattlesByMapHash( const std::string& hash ) const;
+    Battle::BattleVector FindBattlesByModHash( const std::string& hash ) const;
+    Battle::BattleVector FindBattlesInGame( bool in_game ) const;
+    Battle::BattleVector FindBattlesWithFreeSlots( int min_free = 1 ) const;
+
     void RemoveUser(const CommonUserPtr user );
     void RemoveChannel( const ChannelPtr chan );
     void RemoveBattle( const IBattlePtr battle );
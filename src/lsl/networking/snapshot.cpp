@@ -0,0 +1,88 @@
+#include "snapshot.h"
+
+#include <lsl/container/userlist.h>
+#include <lsl/container/battlelist.h>
+#include <lsl/battle/ibattle.h>
+#include <lsl/user/user.h>
+
+namespace LSL {
+
+boost::shared_ptr< const LobbySnapshot::Users > MakeSnapshotUsers( const UserList& users, unsigned int generation )
+{
+    boost::shared_ptr< LobbySnapshot::Users > cols( new LobbySnapshot::Users() );
+    cols->generation = generation;
+
+    const size_t num_users = users.size();
+    cols->id.reserve( num_users );
+    cols->nick.reserve( num_users );
+    cols->flags.reserve( num_users );
+    cols->rank.reserve( num_users );
+    cols->sync.reserve( num_users );
+    cols->battle_id.reserve( num_users );
+    cols->team.reserve( num_users );
+    cols->ally.reserve( num_users );
+    cols->side.reserve( num_users );
+    cols->handicap.reserve( num_users );
+    for ( size_t i = 0; i < num_users; ++i )
+    {
+        const ConstUserPtr user = users.At( i );
+        const UserStatus& status = user->Status();
+        const UserBattleStatus& bstatus = user->BattleStatus();
+        const ConstIBattlePtr battle = user->GetBattle();
+        boost::uint8_t flags = 0;
+        if ( status.in_game )    flags |= LobbySnapshot::USER_IN_GAME;
+        if ( status.away )       flags |= LobbySnapshot::USER_AWAY;
+        if ( status.moderator )  flags |= LobbySnapshot::USER_MODERATOR;
+        if ( status.bot )        flags |= LobbySnapshot::USER_BOT;
+        if ( bstatus.spectator ) flags |= LobbySnapshot::USER_SPECTATOR;
+        if ( bstatus.ready )     flags |= LobbySnapshot::USER_READY;
+        cols->id.push_back( user->Id() );
+        cols->nick.push_back( user->Nick() );
+        cols->flags.push_back( flags );
+        cols->rank.push_back( boost::uint8_t(status.rank) );
+        cols->sync.push_back( boost::uint8_t(bstatus.sync) );
+        cols->battle_id.push_back( battle ? battle->GetBattleId() : -1 );
+        cols->team.push_back( bstatus.team );
+        cols->ally.push_back( bstatus.ally );
+        cols->side.push_back( bstatus.side );
+        cols->handicap.push_back( bstatus.handicap );
+    }
+    return cols;
+}
+
+boost::shared_ptr< const LobbySnapshot::Battles > MakeSnapshotBattles( const Battle::BattleList& battles, unsigned int generation )
+{
+    boost::shared_ptr< LobbySnapshot::Battles > cols( new LobbySnapshot::Battles() );
+    cols->generation = generation;
+
+    const size_t num_battles = battles.size();
+    cols->id.reserve( num_battles );
+    cols->founder.reserve( num_battles );
+    cols->map_hash.reserve( num_battles );
+    cols->mod_hash.reserve( num_battles );
+    cols->flags.reserve( num_battles );
+    cols->max_players.reserve( num_battles );
+    cols->active_players.reserve( num_battles );
+    cols->spectators.reserve( num_battles );
+    cols->rank_needed.reserve( num_battles );
+    for ( size_t i = 0; i < num_battles; ++i )
+    {
+        const ConstBattlePtr battle = battles.At( i );
+        boost::uint8_t flags = 0;
+        if ( battle->InGame() )       flags |= LobbySnapshot::BATTLE_IN_GAME;
+        if ( battle->IsLocked() )     flags |= LobbySnapshot::BATTLE_LOCKED;
+        if ( battle->IsPassworded() ) flags |= LobbySnapshot::BATTLE_PASSWORDED;
+        cols->id.push_back( battle->GetBattleId() );
+        cols->founder.push_back( battle->GetBattleOptions().founder );
+        cols->map_hash.push_back( battle->GetHostMapHash() );
+        cols->mod_hash.push_back( battle->GetHostModHash() );
+        cols->flags.push_back( flags );
+        cols->max_players.push_back( battle->GetMaxPlayers() );
+        cols->active_players.push_back( battle->GetNumActivePlayers() );
+        cols->spectators.push_back( battle->GetSpectators() );
+        cols->rank_needed.push_back( battle->GetRankNeeded() );
+    }
+    return cols;
+}
+
+} //namespace LSL
@@ -0,0 +1,118 @@
+#ifndef LSL_SNAPSHOT_H
+#define LSL_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace LSL {
+
+class UserList;
+namespace Battle {
+class BattleList;
+}
+
+/** \brief immutable structure-of-arrays copy of the lobby model
+ *
+ * Every users->* vector has one element per user, every battles->* vector one per battle,
+ * all in the same order. Produced by Server::Snapshot(), shared between all readers
+ * and never modified afterwards, so it can be scanned from any thread without locking.
+ * A snapshot taken after only battles changed shares the user columns with the previous
+ * one and vice versa.
+ **/
+struct LobbySnapshot
+{
+    enum UserFlags {
+        USER_IN_GAME    = 1 << 0,
+        USER_AWAY       = 1 << 1,
+        USER_MODERATOR  = 1 << 2,
+        USER_BOT        = 1 << 3,
+        USER_SPECTATOR  = 1 << 4,
+        USER_READY      = 1 << 5
+    };
+    enum BattleFlags {
+        BATTLE_IN_GAME     = 1 << 0,
+        BATTLE_LOCKED      = 1 << 1,
+        BATTLE_PASSWORDED  = 1 << 2
+    };
+
+    struct Users
+    {
+        //! model generation these were built at
+        unsigned int generation;
+        std::vector<std::string> id;
+        std::vector<std::string> nick;
+        std::vector<boost::uint8_t> flags;
+        std::vector<boost::uint8_t> rank;
+        std::vector<boost::uint8_t> sync;
+        //! -1 if not in a battle
+        std::vector<boost::int32_t> battle_id;
+        std::vector<boost::int32_t> team;
+        std::vector<boost::int32_t> ally;
+        std::vector<boost::int32_t> side;
+        std::vector<boost::int32_t> handicap;
+    };
+
+    struct Battles
+    {
+        //! model generation these were built at
+        unsigned int generation;
+        std::vector<boost::int32_t> id;
+        std::vector<std::string> founder;
+        std::vector<std::string> map_hash;
+        std::vector<std::string> mod_hash;
+        std::vector<boost::uint8_t> flags;
+        std::vector<boost::int32_t> max_players;
+        std::vector<boost::int32_t> active_players;
+        std::vector<boost::int32_t> spectators;
+        std::vector<boost::int32_t> rank_needed;
+    };
+
+    //! model generation this was taken from, equal generations mean equal content
+    unsigned int generation;
+    boost::shared_ptr< const Users > users;
+    boost::shared_ptr< const Battles > battles;
+
+    size_t NumUsers() const { return users->id.size(); }
+    size_t NumBattles() const { return battles->id.size(); }
+};
+
+typedef boost::shared_ptr< const LobbySnapshot >
+    LobbySnapshotPtr;
+
+//! copy the current content of \param users into fresh user columns
+boost::shared_ptr< const LobbySnapshot::Users > MakeSnapshotUsers( const UserList& users, unsigned int generation );
+//! copy the current content of \param battles into fresh battle columns
+boost::shared_ptr< const LobbySnapshot::Battles > MakeSnapshotBattles( const Battle::BattleList& battles, unsigned int generation );
+
+} //namespace LSL
+
+/**
+ * \file snapshot.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_SNAPSHOT_H
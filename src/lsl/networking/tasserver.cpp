@@ -32,6 +32,10 @@ ServerImpl::ServerImpl(Server *serv)
     , m_online(false)
     , m_buffer("")
     , m_udp_reply_timeout(0)
+    , m_model_generation(0)
+    , m_users_generation(0)
+    , m_battles_generation(0)
+    , m_login_info_duration(-1)
     , m_iface( serv )
 {
     m_sock->sig_dataReceived.connect( boost::bind( &ServerImpl::ExecuteCommand, this, _1, _2 ) );
@@ -45,6 +49,15 @@ void ServerImpl::ExecuteCommand(const std::string& cmd, std::string& inparams, i
 		m_cmd_dict->Process(cmd,inparams);
 }
 
+void ServerImpl::ModelChanged( int what )
+{
+    ++m_model_generation;
+    if ( what & MODEL_USERS )
+        m_users_generation = m_model_generation;
+    if ( what & MODEL_BATTLES )
+        m_battles_generation = m_model_generation;
+}
+
 void ServerImpl::GetInGameTime(const std::string& user)
 {
 	SendCmd( "GETINGAMETIME", user );
@@ -207,6 +220,10 @@ void ServerImpl::Login(const std::string& user, const std::string& password)
         localaddr = "*";
 //    SendCmd ( "LOGIN", user + " " + pass + " " + Util::GetHostCPUSpeed() + " "
 //			  + localaddr + " liblobby " + Util::GetLibLobbyVersion() + protocol  + "\ta sp");
+    m_pool.Reserve<User>( m_size_hints.users );
+    m_pool.Reserve<Battle::Battle>( m_size_hints.battles );
+    m_pool.Reserve<Channel>( m_size_hints.channels );
+    m_login_start = boost::posix_time::microsec_clock::universal_time();
     boost::format login_cmd( "%s %s %s %d %s\t%s\ta m sp" );
     SendCmd ( "LOGIN", (login_cmd % user % pass % 0 % localaddr % "lsl" % protocol).str() );
 
@@ -543,7 +560,8 @@ ChannelPtr ServerImpl::GetCreatePrivateChannel( const UserPtr user )
     ChannelPtr channel = m_channels.Get( channame );
     if (!channel)
     {
-        channel = m_channels.Add( new Channel( channame ) );
+        channel = m_pool.Create<Channel>( channame );
+        m_channels.Add( channel );
         m_iface->OnUserJoinedChannel( channel, user );
         m_iface->OnUserJoinedChannel( channel, m_me );
     }
@@ -562,7 +580,7 @@ void ServerImpl::RequestInGameTime( const std::string& nick )
 
 BattlePtr ServerImpl::AddBattle(const int &id)
 {
-    BattlePtr b( new Battle::Battle(m_iface->shared_from_this(), id) );
+    BattlePtr b = m_pool.Create<Battle::Battle>( m_iface->shared_from_this(), id );
     m_battles.Add(b);
     return b;
 }
@@ -597,12 +615,13 @@ void ServerImpl::OnNewUser( const std::string& nick, const std::string& country,
         str_id = User::GetNewUserId();
     UserPtr user = m_users.Get( str_id );
     if ( !user )  {
-        user = UserPtr( new User( m_iface->shared_from_this(), str_id, nick, country, cpu ) );
+        user = m_pool.Create<User>( m_iface->shared_from_this(), str_id, nick, country, cpu );
     }
 	user->SetCountry( country );
 	user->SetCpu( cpu );
 	user->SetNick( nick );
     m_iface->OnNewUser( user );
+    ModelChanged( MODEL_USERS );
 }
 
 std::string ServerImpl::GetBattleChannelName( const BattlePtr battle )
@@ -645,16 +664,22 @@ void ServerImpl::OnBattleOpened( int id, Enum::BattleType type, Enum::NatType na
 	{
         m_iface->OnBattleStarted(battle);
 	}
+    m_battles.UpdateIndex( battle );
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnUserStatusChanged( const std::string& nick, int intstatus )
 {
-    const ConstUserPtr user = m_users.FindByNick( nick );
+    const UserPtr user = m_users.FindByNick( nick );
 	if (!user) return;
 	UTASClientStatus tasstatus;
 	tasstatus.byte = intstatus;
     const UserStatus status = ConvTasclientstatus( tasstatus.tasdata );
-    m_iface->sig_UserStatusChanged( user, status );
+    const unsigned int changed = status.ChangeMask( user->Status() );
+    if ( !changed ) return;
+    m_iface->OnUserStatus( user, status );
+    m_iface->sig_UserStatusChanged( user, status, changed );
+    ModelChanged( MODEL_USERS );
     IBattlePtr battle = user->GetBattle();
 	if ( battle )
 	{
@@ -662,6 +687,8 @@ void ServerImpl::OnUserStatusChanged( const std::string& nick, int intstatus )
             if ( status.in_game != battle->InGame() )
 			{
 				battle->SetInGame( status.in_game );
+                m_battles.UpdateIndex( battle );
+                ModelChanged( MODEL_BATTLES );
                 if ( status.in_game )
                     m_iface->OnBattleStarted( battle );
                 else
@@ -676,6 +703,7 @@ void ServerImpl::OnHostedBattle( int battleid )
 	if(!battle) return;
     m_iface->OnSelfHostedBattle(battle);
     m_iface->OnSelfJoinedBattle(battle);
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnUserQuit(const std::string &nick )
@@ -683,6 +711,7 @@ void ServerImpl::OnUserQuit(const std::string &nick )
     const UserPtr user = m_users.FindByNick( nick );
 	if ( !user ) return;
     m_iface->OnUserQuit( user );
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnSelfJoinedBattle( int battleid, const std::string& hash )
@@ -691,18 +720,22 @@ void ServerImpl::OnSelfJoinedBattle( int battleid, const std::string& hash )
 	if ( !battle ) return;
     m_current_battle = battle;
     battle->SetHostMod( battle->GetHostModName(), hash );
+    m_battles.UpdateIndex( battle );
 
 	UserBattleStatus& bs = m_me->BattleStatus();
 	bs.spectator = false;
 
     m_iface->OnUserJoinedBattle(battle,m_me);
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnStartHostedBattle()
 {
     IBattlePtr battle = m_current_battle;
 	battle->SetInGame( true );
+    m_battles.UpdateIndex( battle );
     m_iface->OnBattleStarted( battle );
+    ModelChanged( MODEL_BATTLES );
 }
 
 void ServerImpl::OnClientBattleStatus( const std::string& nick, int intstatus, int colorint )
@@ -719,8 +752,17 @@ void ServerImpl::OnClientBattleStatus( const std::string& nick, int intstatus, i
 	color.data = colorint;
     bstatus.color = lslColor( color.color.red, color.color.green, color.color.blue );
     if ( user->GetBattle() != battle ) return;
-    user->BattleStatus().color_index = bstatus.color_index;
+    // diffed against what we stored last time, UpdateBattleStatus keeps ip, udpport and the script password;
+    // always forwarded, our own status may have been changed locally before the server echoed it
+    const unsigned int changed = bstatus.ChangeMask( user->BattleStatus() );
+    user->UpdateBattleStatus( bstatus );
     m_iface->OnClientBattleStatus( battle, user, bstatus );
+    // an echo of our own status may carry what was changed locally since the last snapshot
+    if ( changed || user == m_me )
+        ModelChanged( MODEL_USERS | MODEL_BATTLES );
+    if ( !changed ) return;
+    m_iface->sig_UserBattleStatusChanged( user, bstatus, changed );
+    m_battles.UpdateIndex( battle );
 }
 
 void ServerImpl::OnUserJoinedBattle( int battleid, const std::string& nick, const std::string& userScriptPassword )
@@ -744,6 +786,8 @@ void ServerImpl::OnUserJoinedBattle( int battleid, const std::string& nick, cons
             m_iface->OnBattleStarted(battle);
 		}
 	}
+    m_battles.UpdateIndex( battle );
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnUserLeftBattle( int battleid, const std::string& nick )
@@ -758,7 +802,9 @@ void ServerImpl::OnUserLeftBattle( int battleid, const std::string& nick )
             m_iface->OnUserLeftChannel( channel, user );
 	}
     m_iface->OnUserLeftBattle(battle, user);
+    m_battles.UpdateIndex( battle );
     if ( user == m_me ) m_current_battle = IBattlePtr();
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnBattleInfoUpdated( int battleid, int spectators, bool locked, const std::string& maphash, const std::string& mapname )
@@ -771,6 +817,8 @@ void ServerImpl::OnBattleInfoUpdated( int battleid, int spectators, bool locked,
         m_iface->OnBattleSpectatorCountUpdated( battle, locked );
     if (battle->GetHostMapName() != mapname )
         m_iface->OnBattleMapChanged( battle, UnitsyncMap(mapname, maphash) );
+    m_battles.UpdateIndex( battle );
+    ModelChanged( MODEL_BATTLES );
 }
 
 void ServerImpl::OnSetBattleOption( std::string key, const std::string& value )
@@ -837,6 +885,7 @@ void ServerImpl::OnBattleClosed( int battleid )
     BattlePtr battle = m_battles.Get( battleid );
 	if (!battle) return;
     m_iface->OnBattleClosed(battle);
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnBattleDisableUnits( const std::string& unitlist )
@@ -880,7 +929,10 @@ void ServerImpl::OnJoinChannel(const std::string& channel , const std::string &r
 void ServerImpl::OnJoinChannelFailed( const std::string& name, const std::string& reason )
 {
     ChannelPtr chan = m_channels.Get( "#" + name );
-    if(!chan) chan = m_channels.Add( new Channel("#" + name) );
+    if(!chan) {
+        chan = m_pool.Create<Channel>( "#" + name );
+        m_channels.Add( chan );
+    }
     m_iface->OnJoinChannelFailed( chan, reason );
 }
 
@@ -1103,6 +1155,7 @@ void ServerImpl::OnKickedFromBattle()
 {
     m_iface->OnKickedFromBattle(m_current_battle);
     m_iface->OnUserLeftBattle(m_current_battle,m_me);
+    ModelChanged( MODEL_USERS | MODEL_BATTLES );
 }
 
 void ServerImpl::OnKickedFromChannel( const std::string& channel, const std::string& fromWho, const std::string& message)
@@ -1145,7 +1198,8 @@ void ServerImpl::OnChannelListEntry( const std::string& channel, const int& numu
     ChannelPtr chan = m_channels.Get( "#" + channel );
 	if (!chan)
 	{
-        chan = m_channels.Add( new Channel( "#" + channel ) );
+        chan = m_pool.Create<Channel>( "#" + channel );
+        m_channels.Add( chan );
 	}
 	chan->SetNumUsers(numusers);
 	chan->SetTopic(topic);
@@ -1174,10 +1228,13 @@ void ServerImpl::OnBattleAddBot( int battleid, const std::string& nick, const st
     status.color = lslColor( color.color.red, color.color.green, color.color.blue );
 	status.aishortname = aidll;
     status.owner = owner;
-    UserPtr user( new User( m_iface->shared_from_this(), User::GetNewUserId(), nick ) );
+    UserPtr user = m_pool.Create<User>( m_iface->shared_from_this(), User::GetNewUserId(), nick );
     battle->OnUserAdded( user );
     m_iface->OnUserJoinedBattle( battle, user );
     m_iface->OnUserBattleStatusUpdated( battle, user, status );
+    m_battles.UpdateIndex( battle );
+    // bots are not in m_users, only the battle columns see them
+    ModelChanged( MODEL_BATTLES );
 }
 
 void ServerImpl::OnBattleUpdateBot( int battleid, const std::string& nick, int intstatus, int intcolor )
@@ -1192,7 +1249,14 @@ void ServerImpl::OnBattleUpdateBot( int battleid, const std::string& nick, int i
 	color.data = intcolor;
     status.color = lslColor( color.color.red, color.color.green, color.color.blue );
     CommonUserPtr user = battle->GetUser( nick );
+	if (!user) return;
+    const unsigned int changed = status.ChangeMask( user->BattleStatus() );
+    user->UpdateBattleStatus( status );
     m_iface->OnUserBattleStatusUpdated( battle, user, status );
+    if ( !changed ) return;
+    m_iface->sig_UserBattleStatusChanged( user, status, changed );
+    m_battles.UpdateIndex( battle );
+    ModelChanged( MODEL_BATTLES );
 }
 
 void ServerImpl::OnBattleRemoveBot( int battleid, const std::string& nick )
@@ -1202,6 +1266,8 @@ void ServerImpl::OnBattleRemoveBot( int battleid, const std::string& nick )
     CommonUserPtr user = battle->GetUser( nick );
 	if (!user ) return;
     m_iface->OnUserLeftBattle( battle, user );
+    m_battles.UpdateIndex( battle );
+    ModelChanged( MODEL_BATTLES );
     if (user->BattleStatus().IsBot())
         m_iface->OnUserQuit( user );
 }
@@ -1235,7 +1301,16 @@ void ServerImpl::OnConnected(const std::string &, const int, const std::string &
 
 void ServerImpl::OnLoginInfoComplete()
 {
-    //TODO: event
+    if ( !m_login_start.is_not_a_date_time() ) {
+        const boost::posix_time::time_duration td = boost::posix_time::microsec_clock::universal_time() - m_login_start;
+        m_login_info_duration = td.total_milliseconds();
+    }
+    m_size_hints.users = m_users.size();
+    m_size_hints.battles = m_battles.size();
+    m_size_hints.channels = m_channels.size();
+    LslDebug( "login info complete after %ld ms: %lu users, %lu battles, %lu channels", m_login_info_duration,
+              (unsigned long)m_size_hints.users, (unsigned long)m_size_hints.battles, (unsigned long)m_size_hints.channels );
+    m_iface->sig_LoginInfoComplete( m_login_info_duration );
 }
 
 void ServerImpl::OnChannelListEnd()
@@ -2,9 +2,11 @@
 #define LSL_TASSERVER_H
 
 #include "iserver.h"
+#include <lsl/container/objectpool.h>
 
 #include <lslutils/type_forwards.h>
 #include <boost/format/format_fwd.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace LSL {
 
@@ -78,6 +80,14 @@ private:
 	void SendRaw(const std::string &raw);
 	void RequestInGameTime(const std::string &nick);
 
+    //! what a handler changed, decides which snapshot columns get rebuilt
+    enum ModelChange {
+        MODEL_USERS   = 1,
+        MODEL_BATTLES = 2
+    };
+    //! bumps m_model_generation, call from every handler changing what Snapshot() copies
+    void ModelChanged( int what );
+
     BattlePtr AddBattle( const int& id );
     ChannelPtr AddChannel( const std::string& chan );
 
@@ -241,9 +251,20 @@ private:
     UserPtr m_relay_host_bot;
     int m_message_size_limit; //! in bytes
     UserPtr m_me;
+    //! backing storage for everything in the lists below, dropped wholesale on disconnect
+    ObjectPool m_pool;
     Battle::BattleList m_battles;
     UserList m_users;
     ChannelList m_channels;
+    //! bumped by ModelChanged(), invalidates m_snapshot
+    unsigned int m_model_generation;
+    //! m_model_generation at the last change to users resp. battles
+    unsigned int m_users_generation;
+    unsigned int m_battles_generation;
+    LobbySnapshotPtr m_snapshot;
+    LobbySizeHints m_size_hints;
+    boost::posix_time::ptime m_login_start;
+    long m_login_info_duration; //! in milliseconds
     Server* m_iface;
 };
 
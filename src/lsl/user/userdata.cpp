@@ -13,6 +13,26 @@ std::string UserStatus::GetDiffString ( const UserStatus& old ) const
         std::string();
 }
 
+boost::uint32_t UserStatus::Pack() const
+{
+    return ( in_game ? FIELD_IN_GAME : 0 )
+         | ( away ? FIELD_AWAY : 0 )
+         | ( ( boost::uint32_t(rank) << 2 ) & FIELD_RANK )
+         | ( moderator ? FIELD_MODERATOR : 0 )
+         | ( bot ? FIELD_BOT : 0 );
+}
+
+UserStatus UserStatus::Unpack( boost::uint32_t packed )
+{
+    UserStatus status;
+    status.in_game = packed & FIELD_IN_GAME;
+    status.away = packed & FIELD_AWAY;
+    status.rank = RankContainer( ( packed & FIELD_RANK ) >> 2 );
+    status.moderator = packed & FIELD_MODERATOR;
+    status.bot = packed & FIELD_BOT;
+    return status;
+}
+
 UserBattleStatus::UserBattleStatus()
     : team(0)
     , ally(0)
@@ -28,6 +48,22 @@ UserBattleStatus::UserBattleStatus()
     , udpport(0)
 {}
 
+boost::uint32_t UserBattleStatus::Pack() const
+{
+    return ( ready ? boost::uint32_t(FIELD_READY) : 0 )
+         | ( spectator ? boost::uint32_t(FIELD_SPECTATOR) : 0 )
+         | ( ( boost::uint32_t(sync) << 2 ) & FIELD_SYNC )
+         | ( ( boost::uint32_t(handicap) << 4 ) & FIELD_HANDICAP )
+         | ( ( boost::uint32_t(side) << 11 ) & FIELD_SIDE )
+         | ( ( boost::uint32_t(team) << 15 ) & FIELD_TEAM )
+         | ( ( boost::uint32_t(ally) << 23 ) & FIELD_ALLY );
+}
+
+boost::uint32_t UserBattleStatus::ChangeMask( const UserBattleStatus& other ) const
+{
+    return ( Pack() ^ other.Pack() ) | ( color != other.color ? boost::uint32_t(FIELD_COLOR) : 0 );
+}
+
 bool UserBattleStatus::operator == ( const UserBattleStatus& s ) const
 {
     return ( ( team == s.team ) && ( color == s.color ) && ( handicap == s.handicap ) && ( side == s.side )
@@ -4,6 +4,7 @@
 #include <lslutils/type_forwards.h>
 #include <lslutils/misc.h>
 #include <string>
+#include <boost/cstdint.hpp>
 
 namespace LSL {
 
@@ -26,6 +27,15 @@ struct UserStatus
       RANK_8
     };
 
+  //! bit masks into Pack(), same layout as the lobby protocol's client status
+  enum Fields
+  {
+      FIELD_IN_GAME   = 1 << 0,
+      FIELD_AWAY      = 1 << 1,
+      FIELD_RANK      = 7 << 2,
+      FIELD_MODERATOR = 1 << 5,
+      FIELD_BOT       = 1 << 6
+  };
   bool in_game;
   bool away;
   RankContainer rank;
@@ -33,6 +43,11 @@ struct UserStatus
   bool bot;
   UserStatus(): in_game(false), away(false), rank(RANK_1), moderator(false), bot(false) {}
   std::string GetDiffString ( const UserStatus& other ) const;
+
+  boost::uint32_t Pack() const;
+  static UserStatus Unpack( boost::uint32_t packed );
+  //! FIELD_* bits that differ from \param other, 0 for a no-op update
+  boost::uint32_t ChangeMask( const UserStatus& other ) const { return Pack() ^ other.Pack(); }
 };
 
 /** \todo really  not necessary to have a sep class for this **/
@@ -70,6 +85,24 @@ struct UserBattleStatus
     unsigned int udpport;
     std::string scriptPassword;
     bool IsBot() const { return !aishortname.empty(); }
+
+    /** \brief bit masks into Pack()
+     * only the protocol level fields are packed, FIELD_COLOR is set by ChangeMask alone
+     **/
+    enum Fields
+    {
+        FIELD_READY     = 1u << 0,
+        FIELD_SPECTATOR = 1u << 1,
+        FIELD_SYNC      = 3u << 2,
+        FIELD_HANDICAP  = 0x7fu << 4,
+        FIELD_SIDE      = 0xfu << 11,
+        FIELD_TEAM      = 0xffu << 15,
+        FIELD_ALLY      = 0xffu << 23,
+        FIELD_COLOR     = 1u << 31
+    };
+    boost::uint32_t Pack() const;
+    //! FIELD_* bits that differ from \param other, 0 for a no-op update
+    boost::uint32_t ChangeMask( const UserBattleStatus& other ) const;
     UserBattleStatus();
 
     bool operator == ( const UserBattleStatus& s ) const;
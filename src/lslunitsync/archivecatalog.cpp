@@ -0,0 +1,73 @@
+#include "archivecatalog.h"
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+namespace LSL {
+
+bool ArchiveCatalog::Add( int index, const std::string& name, const std::string& hash,
+		const std::string& shortname, const std::string& version )
+{
+	if ( !m_by_name.insert( std::make_pair( name, index ) ).second )
+		return false;
+	// first one wins when two names differ only in case
+	m_by_lower_name.insert( std::make_pair( boost::algorithm::to_lower_copy( name ), name ) );
+	if ( !hash.empty() )
+		m_by_hash[hash] = name;
+	m_by_shortname[std::make_pair( shortname, version )] = name;
+	return true;
+}
+
+void ArchiveCatalog::SetHash( const std::string& name, const std::string& hash )
+{
+	if ( !hash.empty() && Contains( name ) )
+		m_by_hash[hash] = name;
+}
+
+void ArchiveCatalog::Clear()
+{
+	m_by_name.clear();
+	m_by_lower_name.clear();
+	m_by_hash.clear();
+	m_by_shortname.clear();
+}
+
+void ArchiveCatalog::Swap( ArchiveCatalog& other )
+{
+	m_by_name.swap( other.m_by_name );
+	m_by_lower_name.swap( other.m_by_lower_name );
+	m_by_hash.swap( other.m_by_hash );
+	m_by_shortname.swap( other.m_by_shortname );
+}
+
+bool ArchiveCatalog::Contains( const std::string& name ) const
+{
+	return m_by_name.find( name ) != m_by_name.end();
+}
+
+int ArchiveCatalog::IndexOf( const std::string& name ) const
+{
+	IndexMap::const_iterator it = m_by_name.find( name );
+	return it == m_by_name.end() ? -1 : it->second;
+}
+
+std::string ArchiveCatalog::FindNoCase( const std::string& name ) const
+{
+	if ( Contains( name ) )
+		return name;
+	NameMap::const_iterator it = m_by_lower_name.find( boost::algorithm::to_lower_copy( name ) );
+	return it == m_by_lower_name.end() ? std::string() : it->second;
+}
+
+std::string ArchiveCatalog::NameForHash( const std::string& hash ) const
+{
+	NameMap::const_iterator it = m_by_hash.find( hash );
+	return it == m_by_hash.end() ? std::string() : it->second;
+}
+
+std::string ArchiveCatalog::NameForShortname( const std::string& shortname, const std::string& version ) const
+{
+	ShortnameMap::const_iterator it = m_by_shortname.find( std::make_pair( shortname, version ) );
+	return it == m_by_shortname.end() ? std::string() : it->second;
+}
+
+} // namespace LSL
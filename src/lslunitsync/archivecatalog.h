@@ -0,0 +1,82 @@
+#ifndef LSL_HEADERGUARD_ARCHIVECATALOG_H
+#define LSL_HEADERGUARD_ARCHIVECATALOG_H
+
+#include <lslutils/type_forwards.h>
+
+#include <string>
+#include <utility>
+#include <boost/unordered_map.hpp>
+
+namespace LSL {
+
+/** \brief Hashed lookup tables over the maps or games unitsync reported
+ *
+ * Names resolve to the unitsync index they were reported with, in plain and
+ * case-insensitive form, as do checksums and (shortname, version) pairs.
+ * The catalog does no locking of its own, Unitsync guards it with m_archives_lock.
+ */
+class ArchiveCatalog
+{
+public:
+	//! register \param name at unitsync index \param index, false if the name is already known
+	bool Add( int index, const std::string& name, const std::string& hash = "",
+			const std::string& shortname = "", const std::string& version = "" );
+	//! record a checksum learned after Add
+	void SetHash( const std::string& name, const std::string& hash );
+	void Clear();
+	void Swap( ArchiveCatalog& other );
+
+	bool Contains( const std::string& name ) const;
+	//! unitsync index of \param name, -1 if unknown
+	int IndexOf( const std::string& name ) const;
+	//! exact spelling of \param name found ignoring case, empty if unknown
+	std::string FindNoCase( const std::string& name ) const;
+	//! empty if no archive with that checksum is known (yet)
+	std::string NameForHash( const std::string& hash ) const;
+	std::string NameForShortname( const std::string& shortname, const std::string& version ) const;
+	size_t Size() const { return m_by_name.size(); }
+
+private:
+	typedef boost::unordered_map<std::string, int>
+		IndexMap;
+	typedef boost::unordered_map<std::string, std::string>
+		NameMap;
+	typedef boost::unordered_map<std::pair<std::string, std::string>, std::string>
+		ShortnameMap;
+
+	IndexMap m_by_name;
+	NameMap m_by_lower_name;
+	NameMap m_by_hash;
+	ShortnameMap m_by_shortname;
+};
+
+} // namespace LSL
+
+/**
+ * \file archivecatalog.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_ARCHIVECATALOG_H
@@ -0,0 +1,425 @@
+#include "binarycache.h"
+
+#include <lslutils/misc.h>
+#include <lslutils/logging.h>
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace LSL {
+
+namespace {
+const char CACHE_MAGIC[4] = { 'L', 'S', 'L', 'B' };
+const boost::uint32_t CACHE_VERSION = 1;
+const boost::uint32_t CACHE_BYTEORDER = 0x01020304;
+}
+
+//! all fields are 32 bit, so the layout has no padding and records stay aligned
+struct BinaryCache::Header
+{
+	char magic[4];
+	boost::uint32_t version;
+	boost::uint32_t byteorder;
+	boost::uint32_t record_count;
+	boost::uint32_t records_offset;
+	boost::uint32_t positions_count;
+	boost::uint32_t positions_offset;
+	boost::uint32_t strrefs_count;
+	boost::uint32_t strrefs_offset;
+	boost::uint32_t strings_size;
+	boost::uint32_t strings_offset;
+};
+
+struct BinaryCache::StrRef
+{
+	boost::uint32_t offset;
+	boost::uint32_t length;
+};
+
+struct BinaryCache::Record
+{
+	boost::uint32_t kind;
+	StrRef key;
+	boost::int32_t tidalStrength;
+	boost::int32_t gravity;
+	float maxMetal;
+	boost::int32_t extractorRadius;
+	boost::int32_t minWind;
+	boost::int32_t maxWind;
+	boost::int32_t width;
+	boost::int32_t height;
+	StrRef author;
+	StrRef description;
+	//! index into the position table (mapinfo) or the string reference table (lists)
+	boost::uint32_t first;
+	boost::uint32_t count;
+};
+
+BinaryCache::BinaryCache( size_t flush_threshold )
+	: m_data( NULL )
+	, m_size( 0 )
+	, m_header( NULL )
+	, m_flush_threshold( flush_threshold )
+{
+}
+
+BinaryCache::~BinaryCache()
+{
+	Close();
+}
+
+void BinaryCache::Open( const std::string& path )
+{
+	Close();
+	boost::mutex::scoped_lock lock(m_lock);
+	m_path = path;
+	if ( Map() )
+		LslDebug( "binary cache %s: %u records", m_path.c_str(), m_header->record_count );
+}
+
+void BinaryCache::Close()
+{
+	boost::mutex::scoped_lock lock(m_lock);
+	if ( m_path.empty() )
+		return;
+	FlushLocked();
+	Unmap();
+	m_pending.clear();
+	m_path.clear();
+}
+
+bool BinaryCache::Flush()
+{
+	boost::mutex::scoped_lock lock(m_lock);
+	return FlushLocked();
+}
+
+bool BinaryCache::Map()
+{
+	Unmap();
+	namespace bip = boost::interprocess;
+	try {
+		boost::system::error_code ec;
+		const boost::uintmax_t size = boost::filesystem::file_size( m_path, ec );
+		if ( ec || size < sizeof(Header) )
+			return false;
+		bip::file_mapping file( m_path.c_str(), bip::read_only );
+		m_region.reset( new bip::mapped_region( file, bip::read_only ) );
+	} catch ( std::exception& e ) {
+		LslWarning( "binary cache %s could not be mapped: %s", m_path.c_str(), e.what() );
+		m_region.reset();
+		return false;
+	}
+	m_data = static_cast<const char*>( m_region->get_address() );
+	m_size = m_region->get_size();
+	m_header = reinterpret_cast<const Header*>( m_data );
+	if ( !Validate() ) {
+		LslWarning( "binary cache %s is outdated or damaged, ignoring it", m_path.c_str() );
+		Unmap();
+		return false;
+	}
+	return true;
+}
+
+void BinaryCache::Unmap()
+{
+	m_region.reset();
+	m_data = NULL;
+	m_size = 0;
+	m_header = NULL;
+}
+
+bool BinaryCache::Validate() const
+{
+	const Header& h = *m_header;
+	if ( memcmp( h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC) ) != 0
+			|| h.version != CACHE_VERSION || h.byteorder != CACHE_BYTEORDER )
+		return false;
+	const boost::uint64_t size = m_size;
+	if ( boost::uint64_t(h.records_offset) + boost::uint64_t(h.record_count) * sizeof(Record) > size
+			|| boost::uint64_t(h.positions_offset) + boost::uint64_t(h.positions_count) * sizeof(boost::int32_t) * 2 > size
+			|| boost::uint64_t(h.strrefs_offset) + boost::uint64_t(h.strrefs_count) * sizeof(StrRef) > size
+			|| boost::uint64_t(h.strings_offset) + h.strings_size > size
+			|| h.records_offset % 4 || h.positions_offset % 4 || h.strrefs_offset % 4 )
+		return false;
+	// check every reference once, lookups can then trust the file
+	const Record* records = reinterpret_cast<const Record*>( m_data + h.records_offset );
+	const StrRef* strrefs = reinterpret_cast<const StrRef*>( m_data + h.strrefs_offset );
+	struct InRange {
+		static bool Check( const StrRef& ref, boost::uint32_t size )
+		{ return boost::uint64_t(ref.offset) + ref.length <= size; }
+	};
+	for ( boost::uint32_t i = 0; i < h.strrefs_count; ++i ) {
+		if ( !InRange::Check( strrefs[i], h.strings_size ) )
+			return false;
+	}
+	for ( boost::uint32_t i = 0; i < h.record_count; ++i ) {
+		const Record& rec = records[i];
+		if ( !InRange::Check( rec.key, h.strings_size ) || !InRange::Check( rec.author, h.strings_size )
+				|| !InRange::Check( rec.description, h.strings_size ) )
+			return false;
+		const boost::uint32_t table = rec.kind == KIND_MAPINFO ? h.positions_count : h.strrefs_count;
+		if ( boost::uint64_t(rec.first) + rec.count > table )
+			return false;
+	}
+	return true;
+}
+
+std::string BinaryCache::String( const StrRef& ref ) const
+{
+	return std::string( m_data + m_header->strings_offset + ref.offset, ref.length );
+}
+
+const BinaryCache::Record* BinaryCache::Find( boost::uint32_t kind, const std::string& key ) const
+{
+	if ( !m_header )
+		return NULL;
+	const Record* begin = reinterpret_cast<const Record*>( m_data + m_header->records_offset );
+	const Record* end = begin + m_header->record_count;
+	const char* strings = m_data + m_header->strings_offset;
+	// binary search on (kind, key), keys compared in place in the string table
+	while ( begin < end ) {
+		const Record* mid = begin + ( end - begin ) / 2;
+		int cmp = int(mid->kind) - int(kind);
+		if ( cmp == 0 ) {
+			const size_t len = std::min<size_t>( mid->key.length, key.size() );
+			cmp = memcmp( strings + mid->key.offset, key.data(), len );
+			if ( cmp == 0 )
+				cmp = mid->key.length < key.size() ? -1 : ( mid->key.length > key.size() ? 1 : 0 );
+		}
+		if ( cmp == 0 )
+			return mid;
+		if ( cmp < 0 )
+			begin = mid + 1;
+		else
+			end = mid;
+	}
+	return NULL;
+}
+
+void BinaryCache::Decode( const Record& rec, Entry& entry ) const
+{
+	if ( rec.kind == KIND_MAPINFO ) {
+		MapInfo& info = entry.info;
+		info.tidalStrength = rec.tidalStrength;
+		info.gravity = rec.gravity;
+		info.maxMetal = rec.maxMetal;
+		info.extractorRadius = rec.extractorRadius;
+		info.minWind = rec.minWind;
+		info.maxWind = rec.maxWind;
+		info.width = rec.width;
+		info.height = rec.height;
+		info.author = String( rec.author );
+		info.description = String( rec.description );
+		const boost::int32_t* pos = reinterpret_cast<const boost::int32_t*>( m_data + m_header->positions_offset ) + 2 * rec.first;
+		info.positions.resize( rec.count );
+		for ( boost::uint32_t i = 0; i < rec.count; ++i ) {
+			info.positions[i].x = pos[2*i];
+			info.positions[i].y = pos[2*i+1];
+		}
+	} else {
+		const StrRef* refs = reinterpret_cast<const StrRef*>( m_data + m_header->strrefs_offset ) + rec.first;
+		entry.list.resize( rec.count );
+		for ( boost::uint32_t i = 0; i < rec.count; ++i )
+			entry.list[i] = String( refs[i] );
+	}
+}
+
+bool BinaryCache::GetMapInfo( const std::string& key, MapInfo& info ) const
+{
+	boost::mutex::scoped_lock lock(m_lock);
+	EntryMap::const_iterator it = m_pending.find( EntryKey( KIND_MAPINFO, key ) );
+	if ( it != m_pending.end() ) {
+		info = it->second.info;
+		return true;
+	}
+	const Record* rec = Find( KIND_MAPINFO, key );
+	if ( !rec )
+		return false;
+	Entry entry;
+	Decode( *rec, entry );
+	info = entry.info;
+	return true;
+}
+
+void BinaryCache::SetMapInfo( const std::string& key, const MapInfo& info )
+{
+	Entry entry;
+	entry.info = info;
+	boost::mutex::scoped_lock lock(m_lock);
+	Pending( EntryKey( KIND_MAPINFO, key ), entry );
+}
+
+bool BinaryCache::GetStringList( RecordKind kind, const std::string& key, StringVector& list ) const
+{
+	assert( kind != KIND_MAPINFO );
+	boost::mutex::scoped_lock lock(m_lock);
+	EntryMap::const_iterator it = m_pending.find( EntryKey( kind, key ) );
+	if ( it != m_pending.end() ) {
+		list = it->second.list;
+		return true;
+	}
+	const Record* rec = Find( kind, key );
+	if ( !rec )
+		return false;
+	Entry entry;
+	Decode( *rec, entry );
+	list.swap( entry.list );
+	return true;
+}
+
+void BinaryCache::SetStringList( RecordKind kind, const std::string& key, const StringVector& list )
+{
+	assert( kind != KIND_MAPINFO );
+	Entry entry;
+	entry.list = list;
+	boost::mutex::scoped_lock lock(m_lock);
+	Pending( EntryKey( kind, key ), entry );
+}
+
+size_t BinaryCache::MappedCount() const
+{
+	boost::mutex::scoped_lock lock(m_lock);
+	return m_header ? m_header->record_count : 0;
+}
+
+size_t BinaryCache::PendingCount() const
+{
+	boost::mutex::scoped_lock lock(m_lock);
+	return m_pending.size();
+}
+
+void BinaryCache::Pending( const EntryKey& key, const Entry& entry )
+{
+	m_pending[key] = entry;
+	// every flush rewrites the whole file, so wait until the pending part is
+	// as big as the mapped one, a cold start then costs O(N) written bytes
+	const size_t mapped = m_header ? m_header->record_count : 0;
+	if ( m_pending.size() >= std::max( m_flush_threshold, mapped ) )
+		FlushLocked();
+}
+
+namespace {
+template < class T >
+void Append( std::string& buf, const T& value )
+{
+	buf.append( reinterpret_cast<const char*>( &value ), sizeof(T) );
+}
+}
+
+bool BinaryCache::FlushLocked()
+{
+	if ( m_pending.empty() || m_path.empty() )
+		return true;
+
+	// merge the mapped records with the pending ones, pending entries win
+	EntryMap all;
+	if ( m_header ) {
+		const Record* records = reinterpret_cast<const Record*>( m_data + m_header->records_offset );
+		for ( boost::uint32_t i = 0; i < m_header->record_count; ++i ) {
+			const EntryKey key( records[i].kind, String( records[i].key ) );
+			if ( m_pending.find( key ) == m_pending.end() )
+				Decode( records[i], all[key] );
+		}
+	}
+	for ( EntryMap::const_iterator it = m_pending.begin(); it != m_pending.end(); ++it )
+		all[it->first] = it->second;
+
+	std::string records, positions, strrefs, strings;
+	Header header;
+	memcpy( header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC) );
+	header.version = CACHE_VERSION;
+	header.byteorder = CACHE_BYTEORDER;
+	header.record_count = all.size();
+	header.positions_count = 0;
+	header.strrefs_count = 0;
+	struct Strings {
+		static StrRef Add( std::string& table, const std::string& s )
+		{
+			StrRef ref;
+			ref.offset = table.size();
+			ref.length = s.size();
+			table += s;
+			return ref;
+		}
+	};
+	// std::map iterates in (kind, key) order, which is what Find() expects
+	for ( EntryMap::const_iterator it = all.begin(); it != all.end(); ++it ) {
+		const MapInfo& info = it->second.info;
+		Record rec;
+		memset( &rec, 0, sizeof(rec) );
+		rec.kind = it->first.first;
+		rec.key = Strings::Add( strings, it->first.second );
+		if ( rec.kind == KIND_MAPINFO ) {
+			rec.tidalStrength = info.tidalStrength;
+			rec.gravity = info.gravity;
+			rec.maxMetal = info.maxMetal;
+			rec.extractorRadius = info.extractorRadius;
+			rec.minWind = info.minWind;
+			rec.maxWind = info.maxWind;
+			rec.width = info.width;
+			rec.height = info.height;
+			rec.author = Strings::Add( strings, info.author );
+			rec.description = Strings::Add( strings, info.description );
+			rec.first = header.positions_count;
+			rec.count = info.positions.size();
+			for ( const StartPos& pos: info.positions ) {
+				Append( positions, boost::int32_t(pos.x) );
+				Append( positions, boost::int32_t(pos.y) );
+			}
+			header.positions_count += rec.count;
+		} else {
+			rec.first = header.strrefs_count;
+			rec.count = it->second.list.size();
+			for ( const std::string& s: it->second.list )
+				Append( strrefs, Strings::Add( strings, s ) );
+			header.strrefs_count += rec.count;
+		}
+		Append( records, rec );
+	}
+	header.records_offset = sizeof(Header);
+	header.positions_offset = header.records_offset + records.size();
+	header.strrefs_offset = header.positions_offset + positions.size();
+	header.strings_offset = header.strrefs_offset + strrefs.size();
+	header.strings_size = strings.size();
+
+	// write a temporary file and swap it in, the mapping has to go first (windows)
+	const std::string tmp = m_path + ".tmp";
+	FILE* file = Util::lslopen( tmp, "wb" );
+	if ( file == NULL ) {
+		LslError( "could not write binary cache %s", tmp.c_str() );
+		return false;
+	}
+	std::string buf;
+	buf.reserve( header.strings_offset + strings.size() );
+	Append( buf, header );
+	buf += records;
+	buf += positions;
+	buf += strrefs;
+	buf += strings;
+	const bool written = fwrite( buf.data(), 1, buf.size(), file ) == buf.size();
+	const bool closed = fclose( file ) == 0;
+	if ( !written || !closed ) {
+		LslError( "could not write binary cache %s", tmp.c_str() );
+		boost::system::error_code ec;
+		boost::filesystem::remove( tmp, ec );
+		return false;
+	}
+	Unmap();
+	boost::system::error_code ec;
+	boost::filesystem::rename( tmp, m_path, ec );
+	if ( ec ) {
+		LslError( "could not replace binary cache %s: %s", m_path.c_str(), ec.message().c_str() );
+		Map();
+		return false;
+	}
+	m_pending.clear();
+	Map();
+	return true;
+}
+
+} // namespace LSL
@@ -0,0 +1,122 @@
+#ifndef LSL_HEADERGUARD_BINARYCACHE_H
+#define LSL_HEADERGUARD_BINARYCACHE_H
+
+#include "data.h"
+#include <lslutils/type_forwards.h>
+
+#include <string>
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace boost { namespace interprocess { class mapped_region; } }
+
+namespace LSL {
+
+/** \brief Single memory mapped cache file for map infos, side, unit and option lists
+ *
+ * The file is a header followed by fixed size records sorted by (kind, key),
+ * a start position table, a string reference table and a string table.
+ * A lookup is a binary search over the mapped records, so a warm start does
+ * not touch the filesystem per map. New entries are held in memory and merged
+ * into a freshly written file on Flush().
+ */
+class BinaryCache : public boost::noncopyable
+{
+public:
+	enum RecordKind {
+		KIND_MAPINFO = 1,
+		KIND_SIDES   = 2,
+		KIND_UNITS   = 3,
+		KIND_OPTIONS = 4 //!< GameOptions flattened by the caller
+	};
+
+	/** \param flush_threshold pending entries after which the file is rewritten automatically,
+	 * raised to the number of records already in the file so rewrites grow geometrically
+	 */
+	explicit BinaryCache( size_t flush_threshold = 64 );
+	~BinaryCache();
+
+	//! map \param path, a missing, outdated or damaged file is treated as empty
+	void Open( const std::string& path );
+	//! flush pending entries and unmap the file
+	void Close();
+	//! merge pending entries into the file, returns false if writing failed
+	bool Flush();
+
+	bool GetMapInfo( const std::string& key, MapInfo& info ) const;
+	void SetMapInfo( const std::string& key, const MapInfo& info );
+
+	//! all kinds but KIND_MAPINFO hold string lists
+	bool GetStringList( RecordKind kind, const std::string& key, StringVector& list ) const;
+	void SetStringList( RecordKind kind, const std::string& key, const StringVector& list );
+
+	size_t MappedCount() const;
+	size_t PendingCount() const;
+
+	struct Header;
+	struct StrRef;
+	struct Record;
+
+private:
+	struct Entry
+	{
+		MapInfo info;
+		StringVector list;
+	};
+	typedef std::pair<boost::uint32_t, std::string>
+		EntryKey;
+	typedef std::map<EntryKey, Entry>
+		EntryMap;
+
+	const Record* Find( boost::uint32_t kind, const std::string& key ) const;
+	void Decode( const Record& rec, Entry& entry ) const;
+	std::string String( const StrRef& ref ) const;
+	bool Map();
+	void Unmap();
+	bool Validate() const;
+	bool FlushLocked();
+	void Pending( const EntryKey& key, const Entry& entry );
+
+	std::string m_path;
+	boost::scoped_ptr<boost::interprocess::mapped_region> m_region;
+	const char* m_data;
+	size_t m_size;
+	const Header* m_header;
+	EntryMap m_pending;
+	const size_t m_flush_threshold;
+	mutable boost::mutex m_lock;
+};
+
+} // namespace LSL
+
+/**
+ * \file binarycache.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_BINARYCACHE_H
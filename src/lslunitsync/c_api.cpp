@@ -4,6 +4,7 @@
 
 #include <stdexcept>
 #include <cmath>
+#include <boost/current_function.hpp>
 
 #include <lslutils/logging.h>
 #include <lslutils/misc.h>
@@ -13,6 +14,7 @@
 
 #include "image.h"
 #include "loader.h"
+#include "profiler.h"
 #include "sharedlib.h"
 
 #define UNITSYNC_EXCEPTION(cond,msg) do { if(!(cond))\
@@ -21,49 +23,23 @@
 #define CHECK_FUNCTION( arg ) \
 	do { if ( !(arg) ) LSL_THROW( function_missing, "arg" ); } while (0)
 
-// on linux / debug builds, check the time a unitsync
-#if defined(__linux__) && !defined(NDEBUG)
-#include <sys/time.h>
-
-/**
-	ScopedTime, takes time of a function call / one scope
-	usage: just add at the beginning of a function
-	ScopedTime tmp(__FUNCTION__, __LINE__);
-*/
-class ScopedTime {
-public:
-	int diff_ms(timespec t1, timespec t2) {
-		return (((t1.tv_sec - t2.tv_sec) * 1000000000) +  (t1.tv_nsec - t2.tv_nsec)) / 1000000;
-	}
-	ScopedTime(const std::string& func, const int line): func(func),  line(line){
-		clock_gettime(CLOCK_REALTIME, &start);
-	}
-	~ScopedTime()
-	{
-		timespec stop;
-		clock_gettime(CLOCK_REALTIME, &stop);
-		const int diff = diff_ms(stop, start);
-		if ( diff > 10) {
-			printf("Slow Unitsync call (%s():%d) took: %dms\n",func.c_str(), line, diff);
-		}
-	}
-private:
-	timespec start;
-	std::string func;
-	int line;
-};
+//! counts one call of the enclosing function, see UnitsyncProfiler
+#define UNITSYNC_CALL_TIMER \
+	static UnitsyncCallStats& unitsync_call_stats = \
+		UnitsyncProfiler::Register( UnitsyncProfiler::SectionName( BOOST_CURRENT_FUNCTION ) ); \
+	UnitsyncCallTimer unitsync_call_timer( unitsync_call_stats );
 
+//! serializes unitsync access, timing lock wait and execution of the section
 #define LOCK_UNITSYNC \
-	ScopedTime scopedtime(__FUNCTION__, __LINE__); \
+	UNITSYNC_CALL_TIMER \
 	boost::mutex::scoped_lock lock_criticalsection(m_lock); \
+	unitsync_call_timer.Locked();
 
-#else
-#define LOCK_UNITSYNC \
-	boost::mutex::scoped_lock lock_criticalsection(m_lock);
-#endif // __linux__
-
-
-
+//! one of several locked sections in a function that starts with UNITSYNC_CALL_TIMER
+#define LOCK_UNITSYNC_SECTION \
+	UnitsyncCallTimer::Section unitsync_call_section( unitsync_call_timer ); \
+	boost::mutex::scoped_lock lock_criticalsection(m_lock); \
+	unitsync_call_section.Locked();
 
 //! Macro that checks if a function is present/loaded, unitsync is loaded, and locks it on call.
 #define InitLib( arg ) \
@@ -71,6 +47,12 @@ private:
 	UNITSYNC_EXCEPTION( m_loaded, "Unitsync function not loaded:" #arg ); \
 	CHECK_FUNCTION( arg );
 
+//! InitLib for one of several locked sections, see LOCK_UNITSYNC_SECTION
+#define InitLibSection( arg ) \
+	LOCK_UNITSYNC_SECTION; \
+	UNITSYNC_EXCEPTION( m_loaded, "Unitsync function not loaded:" #arg ); \
+	CHECK_FUNCTION( arg );
+
 // convert const char* to std::string, as std::string(NULL) crashes
 inline std::string SafeString(const char* str)
 {
@@ -101,6 +83,31 @@ void UnitsyncLib::Load( const std::string& path)
 	LOCK_UNITSYNC;
 	_Load( path );
 	_Init();
+	// workers have to rescan the archives just like we did
+	if ( m_processes.IsRunning() )
+		m_processes.Reset( path );
+}
+
+bool UnitsyncLib::StartWorkerProcesses( const std::string& worker_exe, size_t count )
+{
+	std::string path;
+	{
+		LOCK_UNITSYNC;
+		if ( !m_loaded )
+			return false;
+		path = m_path;
+	}
+	return m_processes.Start( worker_exe, path, count );
+}
+
+void UnitsyncLib::StopWorkerProcesses()
+{
+	m_processes.Stop();
+}
+
+size_t UnitsyncLib::GetWorkerProcessCount() const
+{
+	return m_processes.IsRunning() ? m_processes.GetProcessCount() : 0;
 }
 
 
@@ -327,6 +334,12 @@ std::string UnitsyncLib::GetMapChecksum( int index )
 	return Util::ToString( (unsigned int)m_get_map_checksum( index ) );
 }
 
+std::string UnitsyncLib::GetMapChecksumFromName( const std::string& mapName )
+{
+	InitLib( m_get_map_checksum_from_name );
+	return Util::ToString( (unsigned int)m_get_map_checksum_from_name( mapName.c_str() ) );
+}
+
 std::string UnitsyncLib::GetMapName( int index )
 {
 	InitLib( m_get_map_name );
@@ -358,6 +371,10 @@ UnitsyncLib::StringVector UnitsyncLib::GetMapDeps( int index )
 
 MapInfo UnitsyncLib::GetMapInfoEx( int index, int version )
 {
+	MapInfo remote;
+	// workers have their own map list, they get the name and look up their index
+	if ( m_loaded && m_processes.IsRunning() && m_processes.GetMapInfoEx( GetMapName( index ), version, remote ) )
+		return remote;
   if (m_get_map_description == NULL) {
 		// old fetch method
 		InitLib( m_get_map_info_ex );
@@ -419,51 +436,138 @@ MapInfo UnitsyncLib::GetMapInfoEx( int index, int version )
 
 UnitsyncImage UnitsyncLib::GetMinimap( const std::string& mapFileName )
 {
-	InitLib( m_get_minimap );
+	if ( m_processes.IsRunning() )
+		return _GetMapImage( mapFileName, MAP_IMAGE_MINIMAP );
 	const int miplevel = 1;  // miplevel should not be 10 ffs
 	const int width  = 1024 >> miplevel;
 	const int height = 1024 >> miplevel;
-	// this unitsync call returns a pointer to a static buffer
-	unsigned short* colors = (unsigned short*)m_get_minimap( mapFileName.c_str(), miplevel );
-	if (!colors)
-		LSL_THROWF( unitsync, "Get minimap failed %s", mapFileName.c_str());
-	UnitsyncImage img = UnitsyncImage::FromMinimapData( colors, width, height );
-	img.RescaleIfBigger();
-	return img;
+	Util::uninitialized_array<unsigned short> colors(width * height);
+	{
+		// only the unitsync call itself is serialized, conversion runs unlocked
+		InitLib( m_get_minimap );
+		// this unitsync call returns a pointer to a static buffer
+		const unsigned short* data = (const unsigned short*)m_get_minimap( mapFileName.c_str(), miplevel );
+		if (!data)
+			LSL_THROWF( unitsync, "Get minimap failed %s", mapFileName.c_str());
+		std::copy( data, data + width * height, (unsigned short*)colors );
+	}
+	return UnitsyncImage::FromMinimapData( colors, width, height );
 }
 
 UnitsyncImage UnitsyncLib::GetMetalmap( const std::string& mapFileName )
 {
-	InitLib( m_get_infomap_size ); // assume GetInfoMap is available too
-	int width = 0, height = 0, retval;
-	retval = m_get_infomap_size(mapFileName.c_str(), "metal", &width, &height);
-	if ( !(retval != 0 && width * height != 0) )
-		LSL_THROWF( unitsync, "Get metalmap size failed %s", mapFileName.c_str());
+	if ( m_processes.IsRunning() )
+		return _GetMapImage( mapFileName, MAP_IMAGE_METALMAP );
+	UNITSYNC_CALL_TIMER
+	int width = 0, height = 0;
+	{
+		InitLibSection( m_get_infomap_size ); // assume GetInfoMap is available too
+		const int retval = m_get_infomap_size(mapFileName.c_str(), "metal", &width, &height);
+		if ( !(retval != 0 && width * height != 0) )
+			LSL_THROWF( unitsync, "Get metalmap size failed %s", mapFileName.c_str());
+	}
 	Util::uninitialized_array<unsigned char> grayscale(width * height);
-	retval = m_get_infomap(mapFileName.c_str(), "metal", grayscale, 1 /*byte per pixel*/);
-	if ( retval == 0 )
-		LSL_THROWF( unitsync, "Get metalmap failed %s", mapFileName.c_str());
-	UnitsyncImage img = UnitsyncImage::FromMetalmapData(grayscale, width, height);
-	img.RescaleIfBigger();
-	return img;
+	{
+		// only the unitsync calls are serialized, conversion runs unlocked
+		InitLibSection( m_get_infomap );
+		if ( m_get_infomap(mapFileName.c_str(), "metal", grayscale, 1 /*byte per pixel*/) == 0 )
+			LSL_THROWF( unitsync, "Get metalmap failed %s", mapFileName.c_str());
+	}
+	return UnitsyncImage::FromMetalmapData(grayscale, width, height);
 }
 
 UnitsyncImage UnitsyncLib::GetHeightmap( const std::string& mapFileName )
 {
-	InitLib( m_get_infomap_size ); // assume GetInfoMap is available too
-	int width = 0, height = 0, retval;
-	retval = m_get_infomap_size(mapFileName.c_str(), "height", &width, &height);
-	if ( !(retval != 0 && width * height != 0) )
-		LSL_THROWF( unitsync, "Get heightmap size failed %s", mapFileName.c_str());
+	if ( m_processes.IsRunning() )
+		return _GetMapImage( mapFileName, MAP_IMAGE_HEIGHTMAP );
+	UNITSYNC_CALL_TIMER
+	int width = 0, height = 0;
+	{
+		InitLibSection( m_get_infomap_size ); // assume GetInfoMap is available too
+		const int retval = m_get_infomap_size(mapFileName.c_str(), "height", &width, &height);
+		if ( !(retval != 0 && width * height != 0) )
+			LSL_THROWF( unitsync, "Get heightmap size failed %s", mapFileName.c_str());
+	}
 	Util::uninitialized_array<unsigned short> grayscale(width * height);
-	retval = m_get_infomap(mapFileName.c_str(), "height", grayscale, 2 /*byte per pixel*/);
-	if ( retval == 0 )
-		LSL_THROW( unitsync, "Get heightmap failed");
-	UnitsyncImage img = UnitsyncImage::FromHeightmapData( grayscale, width, height );
-	img.RescaleIfBigger();
+	{
+		InitLibSection( m_get_infomap );
+		if ( m_get_infomap(mapFileName.c_str(), "height", grayscale, 2 /*byte per pixel*/) == 0 )
+			LSL_THROW( unitsync, "Get heightmap failed");
+	}
+	return UnitsyncImage::FromHeightmapData( grayscale, width, height );
+}
+
+UnitsyncImage UnitsyncLib::_GetMapImage( const std::string& mapFileName, int which )
+{
+	UnitsyncImage img;
+	GetMapImages( mapFileName, which == MAP_IMAGE_MINIMAP ? &img : NULL,
+		which == MAP_IMAGE_METALMAP ? &img : NULL, which == MAP_IMAGE_HEIGHTMAP ? &img : NULL );
+	if ( !img.isValid() )
+		LSL_THROWF( unitsync, "Get map image failed %s", mapFileName.c_str() );
 	return img;
 }
 
+void UnitsyncLib::GetMapImages( const std::string& mapFileName, UnitsyncImage* minimap, UnitsyncImage* metalmap, UnitsyncImage* heightmap )
+{
+	const int which = ( minimap ? MAP_IMAGE_MINIMAP : 0 )
+		| ( metalmap ? MAP_IMAGE_METALMAP : 0 )
+		| ( heightmap ? MAP_IMAGE_HEIGHTMAP : 0 );
+	MapImageData data;
+	GetMapImageData( mapFileName, which, data );
+	// conversion and downscaling run unlocked, in one pass each
+	if ( minimap && !data.minimap.empty() ) {
+		*minimap = UnitsyncImage::FromMinimapData( &data.minimap[0], data.minimap_size, data.minimap_size );
+	}
+	if ( metalmap && !data.metal.empty() ) {
+		*metalmap = UnitsyncImage::FromMetalmapData( &data.metal[0], data.metal_width, data.metal_height );
+	}
+	if ( heightmap && !data.height.empty() ) {
+		*heightmap = UnitsyncImage::FromHeightmapData( &data.height[0], data.height_width, data.height_height );
+	}
+}
+
+void UnitsyncLib::GetMapImageData( const std::string& mapFileName, int which, MapImageData& data )
+{
+	UNITSYNC_EXCEPTION( m_loaded, "Unitsync not loaded" );
+	if ( m_processes.GetMapImageData( mapFileName, which, data ) )
+		return;
+
+	const int miplevel = 1;
+	const int minimap_size = 1024 >> miplevel;
+	// all unitsync calls for this map back to back under one lock
+	LOCK_UNITSYNC;
+	UNITSYNC_EXCEPTION( m_loaded, "Unitsync not loaded" );
+	const char* name = mapFileName.c_str();
+	if ( ( which & MAP_IMAGE_MINIMAP ) && m_get_minimap ) {
+		const unsigned short* colors = (const unsigned short*)m_get_minimap( name, miplevel );
+		if ( colors ) {
+			data.minimap.assign( colors, colors + minimap_size * minimap_size );
+			data.minimap_size = minimap_size;
+		}
+	}
+	if ( m_get_infomap_size && m_get_infomap ) {
+		int width = 0, height = 0;
+		if ( ( which & MAP_IMAGE_METALMAP ) && m_get_infomap_size( name, "metal", &width, &height ) != 0 && width * height != 0 ) {
+			data.metal.resize( width * height );
+			if ( m_get_infomap( name, "metal", &data.metal[0], 1 /*byte per pixel*/ ) != 0 ) {
+				data.metal_width = width;
+				data.metal_height = height;
+			} else {
+				data.metal.clear();
+			}
+		}
+		if ( ( which & MAP_IMAGE_HEIGHTMAP ) && m_get_infomap_size( name, "height", &width, &height ) != 0 && width * height != 0 ) {
+			data.height.resize( width * height );
+			if ( m_get_infomap( name, "height", &data.height[0], 2 /*byte per pixel*/ ) != 0 ) {
+				data.height_width = width;
+				data.height_height = height;
+			} else {
+				data.height.clear();
+			}
+		}
+	}
+}
+
 std::string UnitsyncLib::GetPrimaryModChecksum( int index )
 {
 	InitLib( m_get_mod_checksum );
@@ -618,11 +722,11 @@ UnitsyncLib::StringVector UnitsyncLib::FindFilesVFS( const std::string& name )
 	StringVector ret;
 	//thanks to assbars awesome edit we now get different invalid values from init and find
 	if ( handle != -1 ) {
+		char buffer[1025];
+		buffer[1024] = 0;
 		do
 		{
-			char buffer[1025];
 			handle = m_find_files_vfs( handle, &buffer[0], 1024 );
-			buffer[1024] = 0;
 			ret.push_back( &buffer[0] );
 		}while ( handle );
 	}
@@ -654,6 +758,66 @@ void UnitsyncLib::CloseFileVFS( int handle )
 	m_close_file_vfs( handle );
 }
 
+namespace {
+//! spare buffers kept by ReleaseVfsFiles, bigger ones are freed
+const size_t VFS_BUFFER_POOL_SIZE = 16;
+const size_t VFS_BUFFER_MAX_KEPT = 4 << 20;
+}
+
+VfsFileVector UnitsyncLib::ReadFilesVFS( const std::string& modname, const StringVector& paths )
+{
+	VfsFileVector files( paths.size() );
+	{
+		boost::mutex::scoped_lock lock( m_vfs_buffers_lock );
+		for ( size_t i = 0; i < files.size() && !m_vfs_buffers.empty(); ++i ) {
+			files[i].data.swap( m_vfs_buffers.back() );
+			m_vfs_buffers.pop_back();
+		}
+	}
+	for ( size_t i = 0; i < files.size(); ++i )
+		files[i].path = paths[i];
+
+	// everything back to back under one lock, no other caller can switch the mod in between
+	InitLib( m_open_file_vfs );
+	CHECK_FUNCTION( m_file_size_vfs );
+	CHECK_FUNCTION( m_read_file_vfs );
+	CHECK_FUNCTION( m_close_file_vfs );
+	if ( !modname.empty() )
+		_SetCurrentMod( modname );
+	for ( size_t i = 0; i < files.size(); ++i ) {
+		VfsFile& file = files[i];
+		assert( file.path.empty() || file.path[0] != '/' );
+		const int handle = m_open_file_vfs( file.path.c_str() );
+		file.found = handle != 0;
+		if ( !file.found ) {
+			file.data.clear();
+			continue;
+		}
+		const int size = m_file_size_vfs( handle );
+		// a pooled buffer only gets shrunk, growing it fills just the new part
+		file.data.resize( size > 0 ? size : 0 );
+		if ( !file.data.empty() ) {
+			const int read = m_read_file_vfs( handle, &file.data[0], size );
+			file.data.resize( read > 0 ? read : 0 );
+		}
+		m_close_file_vfs( handle );
+	}
+	return files;
+}
+
+void UnitsyncLib::ReleaseVfsFiles( VfsFileVector& files )
+{
+	boost::mutex::scoped_lock lock( m_vfs_buffers_lock );
+	for ( size_t i = 0; i < files.size() && m_vfs_buffers.size() < VFS_BUFFER_POOL_SIZE; ++i ) {
+		std::vector<char>& data = files[i].data;
+		if ( data.capacity() == 0 || data.capacity() > VFS_BUFFER_MAX_KEPT )
+			continue;
+		m_vfs_buffers.push_back( std::vector<char>() );
+		m_vfs_buffers.back().swap( data );
+	}
+	files.clear();
+}
+
 unsigned int UnitsyncLib::GetValidMapCount( const std::string& modname )
 {
 	InitLib( m_get_mod_valid_map_count );
@@ -2,10 +2,12 @@
 #define LIBSPRINGLOBBY_HEADERGUARD_SPRINGUNITSYNCLIB_H
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 
 #include "data.h"
 #include "signatures.h"
+#include "processpool.h"
 #include <lslutils/type_forwards.h>
 #include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
@@ -59,6 +61,16 @@ struct SpringMapInfo
   {}
 };
 
+//! one file fetched by UnitsyncLib::ReadFilesVFS
+struct VfsFile
+{
+	VfsFile() : found(false) {}
+	std::string path;
+	bool found;              //!< false if unitsync could not open it
+	std::vector<char> data;  //!< file content, owned by the caller
+};
+typedef std::vector<VfsFile> VfsFileVector;
+
 /**
  * \brief Primitive class handling the unitsync library.
  *
@@ -123,6 +135,7 @@ public:
 
 	int GetMapCount();
 	std::string GetMapChecksum( int index );
+	std::string GetMapChecksumFromName( const std::string& mapName );
 	std::string GetMapName( int index );
 	int GetMapArchiveCount( int index );
 	std::string GetMapArchiveName( int arnr );
@@ -156,6 +169,29 @@ public:
 	 */
 	UnitsyncImage GetHeightmap( const std::string& mapFileName );
 
+	/**
+	 * @brief Get any of minimap, metalmap and heightmap in one locked batch.
+	 * NULL pointers are skipped, images unitsync failed to deliver are left invalid.
+	 * @note Throws only if unitsync is not loaded.
+	 */
+	void GetMapImages( const std::string& mapFileName, UnitsyncImage* minimap, UnitsyncImage* metalmap, UnitsyncImage* heightmap );
+
+	/**
+	 * @brief Unconverted GetMapImages(), \param which is a combination of MapImageFlags.
+	 * @note Throws only if unitsync is not loaded.
+	 */
+	void GetMapImageData( const std::string& mapFileName, int which, MapImageData& data );
+
+	/**
+	 * @brief Answer map image and map info queries from \param count worker processes.
+	 * Workers run \param worker_exe (lsl-unitsync-worker) on the currently loaded
+	 * unitsync and follow later Load() calls, see UnitsyncProcessPool.
+	 * @note Returns false if unitsync is not loaded or workers are unsupported here.
+	 */
+	bool StartWorkerProcesses( const std::string& worker_exe, size_t count );
+	void StopWorkerProcesses();
+	size_t GetWorkerProcessCount() const;
+
 	std::string GetPrimaryModChecksum( int index );
 	int GetPrimaryModIndex( const std::string& modName );
 	std::string GetPrimaryModName( int index );
@@ -200,6 +236,15 @@ public:
 	int ReadFileVFS( int handle, void* buffer, int bufferLength );
 	void CloseFileVFS( int handle );
 
+	/**
+	 * @brief Read all of \param paths in one locked batch, within the archives of \param modname.
+	 * Results are in the order of \param paths. Their buffers come from a pool, handing
+	 * them back through ReleaseVfsFiles() once decoded saves reallocating them next time.
+	 */
+	VfsFileVector ReadFilesVFS( const std::string& modname, const StringVector& paths );
+	//! returns the buffers of \param files to the pool and clears it
+	void ReleaseVfsFiles( VfsFileVector& files );
+
 	unsigned int GetValidMapCount( const std::string& modname );
 	std::string GetValidMapName( unsigned int MapIndex );
 
@@ -318,6 +363,13 @@ private:
 	//! the current loaded mod.
 	std::string m_current_mod;
 
+	//! out of process workers, not running unless StartWorkerProcesses() was called
+	UnitsyncProcessPool m_processes;
+
+	//! spare ReadFilesVFS buffers, guarded by m_vfs_buffers_lock, not m_lock
+	std::vector< std::vector<char> > m_vfs_buffers;
+	boost::mutex m_vfs_buffers_lock;
+
 	/**
 	 * Loads the unitsync library from path.
 	 * @note this function is not threadsafe if called from code not locked.
@@ -349,6 +401,9 @@ private:
 
 	void _ConvertSpringMapInfo( const SpringMapInfo& in, MapInfo& out );
 
+	//! GetMapImages() for a single image, throws if it failed
+	UnitsyncImage _GetMapImage( const std::string& mapFileName, int which );
+
 	void _SetCurrentMod( const std::string& modname );
 
 	/**
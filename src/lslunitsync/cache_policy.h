@@ -0,0 +1,140 @@
+#ifndef LSL_HEADERGUARD_CACHE_POLICY_H
+#define LSL_HEADERGUARD_CACHE_POLICY_H
+
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace LSL {
+
+/** \name admission policies for MostRecentlyUsedCache
+ *
+ * A policy splits a shard into a window that takes every new item and a main
+ * segment, sized by WindowBudget() with a floor of WindowItems() times the
+ * largest item in the shard. Items falling out of the window replace the main victim only if
+ * Admit() says so. One policy instance lives in each shard, under its lock.
+ */
+///@{
+
+//! plain LRU, the window is the whole shard and everything is admitted
+struct LruPolicy
+{
+	void Init( size_t /*budget*/ ) {}
+	size_t WindowBudget( size_t budget ) const { return budget; }
+	size_t WindowItems() const { return 0; }
+	void Record( size_t /*hash*/ ) {}
+	bool Admit( size_t /*candidate*/, size_t /*victim*/ ) const { return true; }
+};
+
+/** \brief W-TinyLFU: small LRU window in front of a frequency filtered main segment
+ *
+ * Access frequencies are estimated with a count-min sketch of 4 bit counters
+ * that is halved periodically, so a scan over the whole map list cannot push
+ * out the few maps actually in use: scanned items leave the window losing
+ * against the more frequently used main victim.
+ */
+class TinyLfuPolicy
+{
+public:
+	TinyLfuPolicy() : m_additions( 0 ), m_sample_size( 0 ) {}
+
+	void Init( size_t /*budget*/ )
+	{
+		m_table.assign( TABLE_SIZE, 0 );
+		m_additions = 0;
+		// every Record adds up to DEPTH, so counters average about DEPTH when halved
+		m_sample_size = TABLE_SIZE;
+	}
+
+	//! one percent of the shard, the most recent item always stays regardless
+	size_t WindowBudget( size_t budget ) const { return budget / 100; }
+	/** \brief but at least room for this many of the largest items seen, up to half the shard
+	 * With byte budgets and items of several hundred KB one percent is less than one
+	 * image, every new item would go straight into the frequency duel and lose it.
+	 */
+	size_t WindowItems() const { return 3; }
+
+	void Record( size_t hash )
+	{
+		for ( int i = 0; i < DEPTH; ++i ) {
+			boost::uint8_t& c = m_table[ Index( hash, i ) ];
+			if ( c < 15 )
+				++c;
+		}
+		// counted even when saturated, a full sketch would otherwise never age again
+		if ( ++m_additions >= m_sample_size )
+			Age();
+	}
+
+	bool Admit( size_t candidate, size_t victim ) const
+	{
+		return Frequency( candidate ) > Frequency( victim );
+	}
+
+	unsigned int Frequency( size_t hash ) const
+	{
+		unsigned int f = 15;
+		for ( int i = 0; i < DEPTH; ++i ) {
+			const unsigned int c = m_table[ Index( hash, i ) ];
+			if ( c < f )
+				f = c;
+		}
+		return f;
+	}
+
+private:
+	enum { TABLE_SIZE = 4096, DEPTH = 4 };
+
+	static size_t Index( size_t hash, int i )
+	{
+		// derive the row hashes from one 64 bit multiply each
+		static const boost::uint64_t seeds[DEPTH] = {
+			0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+		const boost::uint64_t h = ( boost::uint64_t(hash) + i ) * seeds[i];
+		return size_t( h >> 32 ) & ( TABLE_SIZE - 1 );
+	}
+
+	//! halve all counters so that old popularity fades
+	void Age()
+	{
+		for ( size_t i = 0; i < m_table.size(); ++i )
+			m_table[i] >>= 1;
+		m_additions /= 2;
+	}
+
+	std::vector<boost::uint8_t> m_table;
+	size_t m_additions;
+	size_t m_sample_size;
+};
+///@}
+
+} // namespace LSL
+
+/**
+ * \file cache_policy.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_CACHE_POLICY_H
@@ -1,6 +1,12 @@
 #include "image.h"
+#include "imagekernels.h"
 
 #include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
 
 //these need to go before cimg
 #ifdef HAVE_WX
@@ -39,10 +45,10 @@ namespace cimg_library {
 
 template < class T>
 //! extends cimg to loading images from in-memory buffer
-void load_mem( LSL::Util::uninitialized_array<char>& data, size_t size, const std::string& fn, CImg<T>& img) {
+void load_mem( const char* data, size_t size, const std::string& fn, CImg<T>& img) {
 	const char* filename = fn.c_str();
 
-	std::FILE *file =  fmemopen( (void*)data, size, "rb" );
+	std::FILE *file =  fmemopen( const_cast<char*>( data ), size, "rb" );
 
 	const char *const ext = cimg::split_filename(filename);
 	cimg::exception_mode() = 0;
@@ -109,9 +115,208 @@ void load_mem( LSL::Util::uninitialized_array<char>& data, size_t size, const st
 
 namespace LSL {
 
+namespace {
+
+const char RAW_IMAGE_MAGIC[8] = { 'L', 'S', 'L', 'R', 'A', 'W', '0', '1' };
+const boost::uint32_t RAW_IMAGE_MAX_SIDE = UnitsyncImage::RAW_MAX_SIDE;
+
+//! precedes the pixels in SaveRaw() files, native byte order, the files never leave the machine
+struct RawImageHeader
+{
+	char magic[8];
+	boost::uint32_t width;
+	boost::uint32_t height;
+	boost::uint32_t spectrum;
+	boost::uint32_t reserved;
+	RawImageHeader() : width(0), height(0), spectrum(0), reserved(0) {}
+};
+
+//! like CImg's save_png, but always 8 bit and with the zlib level under our control
+template < class Image >
+bool WritePng( std::FILE* f, const Image& img, bool fast )
+{
+	png_structp png = png_create_write_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+	if ( png == NULL )
+		return false;
+	png_infop info = png_create_info_struct( png );
+	if ( info == NULL ) {
+		png_destroy_write_struct( &png, NULL );
+		return false;
+	}
+	const int channels = std::min( img.spectrum(), 4 );
+	std::vector<png_byte> row( size_t(img.width()) * channels );
+	if ( setjmp( png_jmpbuf( png ) ) ) {
+		png_destroy_write_struct( &png, &info );
+		return false;
+	}
+	static const int color_types[4] = { PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA };
+	png_init_io( png, f );
+	png_set_IHDR( png, info, img.width(), img.height(), 8, color_types[channels - 1],
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT );
+	if ( fast ) {
+		png_set_compression_level( png, 1 );
+		png_set_filter( png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB );
+	}
+	png_write_info( png, info );
+	for ( int y = 0; y < img.height(); ++y ) {
+		for ( int c = 0; c < channels; ++c ) {
+			const unsigned char* plane = img.data( 0, y, 0, c );
+			for ( int x = 0; x < img.width(); ++x )
+				row[size_t(x) * channels + c] = plane[x];
+		}
+		png_write_row( png, &row[0] );
+	}
+	png_write_end( png, info );
+	png_destroy_write_struct( &png, &info );
+	return true;
+}
+
+//! shrinks width x height to fit into maxwidth x maxheight keeping the aspect ratio
+void FitSize( int& width, int& height, int maxwidth, int maxheight )
+{
+	if (height > maxheight) {
+		width = (float(maxheight) / height) * width;
+		height = maxheight;
+	}
+	if (width > maxwidth) {
+		height = (float(maxwidth) / width) * height;
+		width = maxwidth;
+	}
+	width = std::max(width, 1);
+	height = std::max(height, 1);
+}
+
+/** fills \p img with the average of the src_width x src_height source pixels
+ * each of its pixels covers, \p sample(y, rows) converts source row y into one
+ * row per channel of img.spectrum(). Enlarging degrades to nearest neighbour.
+ */
+template < class Image, class Sampler >
+void AreaAverage( Image& img, int src_width, int src_height, const Sampler& sample )
+{
+	const int width = img.width();
+	const int height = img.height();
+	const int channels = std::min( img.spectrum(), 4 );
+	const size_t plane = size_t(width) * height;
+	unsigned char* out = img.data();
+	unsigned char* rows[4];
+	if ( width == src_width && height == src_height ) {
+		// nothing to average, convert straight into the image
+		for ( int y = 0; y < height; ++y ) {
+			for ( int c = 0; c < channels; ++c )
+				rows[c] = out + c * plane + size_t(y) * width;
+			sample( y, rows );
+		}
+		return;
+	}
+	std::vector<unsigned char> buffer( size_t(src_width) * channels );
+	for ( int c = 0; c < channels; ++c )
+		rows[c] = &buffer[c * size_t(src_width)];
+	std::vector<int> columns( width + 1 );
+	for ( int x = 0; x <= width; ++x )
+		columns[x] = int( (long long)x * src_width / width );
+	// source rows are summed per column first, then the columns per destination pixel
+	std::vector<unsigned int> sums( size_t(src_width) * channels );
+	int sampled = -1;
+	for ( int y = 0; y < height; ++y ) {
+		const int sy0 = int( (long long)y * src_height / height );
+		const int sy1 = std::max( int( (long long)(y + 1) * src_height / height ), sy0 + 1 );
+		std::fill( sums.begin(), sums.end(), 0 );
+		for ( int sy = sy0; sy < sy1; ++sy ) {
+			if ( sy != sampled ) {
+				sample( sy, rows );
+				sampled = sy;
+			}
+			for ( int c = 0; c < channels; ++c ) {
+				const unsigned char* row = rows[c];
+				unsigned int* sum = &sums[c * size_t(src_width)];
+				for ( int sx = 0; sx < src_width; ++sx )
+					sum[sx] += row[sx];
+			}
+		}
+		for ( int c = 0; c < channels; ++c ) {
+			const unsigned int* sum = &sums[c * size_t(src_width)];
+			unsigned char* dst = out + c * plane + size_t(y) * width;
+			for ( int x = 0; x < width; ++x ) {
+				const int sx1 = std::max( columns[x + 1], columns[x] + 1 );
+				unsigned int total = 0;
+				for ( int sx = columns[x]; sx < sx1; ++sx )
+					total += sum[sx];
+				const unsigned int count = ( sx1 - columns[x] ) * ( sy1 - sy0 );
+				dst[x] = ( total + count / 2 ) / count;
+			}
+		}
+	}
+}
+
+//! RGB565 as unitsync's minimap comes
+class MinimapSampler
+{
+public:
+	MinimapSampler( const unsigned short* colors, int width ) : m_colors( colors ), m_width( width ) {}
+	void operator()( int y, unsigned char* const* rows ) const
+	{
+		ImageKernels::UnpackRGB565( m_colors + size_t(y) * m_width, m_width, rows[0], rows[1], rows[2] );
+	}
+private:
+	const unsigned short* m_colors;
+	const int m_width;
+};
+
+//! metal density goes to the green channel
+class MetalmapSampler
+{
+public:
+	MetalmapSampler( const unsigned char* data, int width ) : m_data( data ), m_width( width ) {}
+	void operator()( int y, unsigned char* const* rows ) const
+	{
+		memset( rows[0], 0, m_width );
+		memcpy( rows[1], m_data + size_t(y) * m_width, m_width );
+		memset( rows[2], 0, m_width );
+	}
+private:
+	const unsigned char* m_data;
+	const int m_width;
+};
+
+//! heights mapped through a palette built for the range present in the map
+class HeightmapSampler
+{
+public:
+	HeightmapSampler( const unsigned short* data, int width, int min, const std::vector<boost::uint32_t>& palette )
+		: m_data( data ), m_width( width ), m_min( min ), m_palette( palette ) {}
+	void operator()( int y, unsigned char* const* rows ) const
+	{
+		ImageKernels::MapPalette( m_data + size_t(y) * m_width, m_width, m_min, &m_palette[0], rows[0], rows[1], rows[2] );
+	}
+private:
+	const unsigned short* m_data;
+	const int m_width;
+	const int m_min;
+	const std::vector<boost::uint32_t>& m_palette;
+};
+
+//! reads back an existing image, for Rescale()
+template < class Image >
+class ImageSampler
+{
+public:
+	explicit ImageSampler( const Image& img ) : m_img( img ) {}
+	void operator()( int y, unsigned char* const* rows ) const
+	{
+		for ( int c = 0; c < m_img.spectrum() && c < 4; ++c )
+			memcpy( rows[c], m_img.data( 0, y, 0, c ), m_img.width() );
+	}
+private:
+	const Image& m_img;
+};
+
+} // namespace
+
 UnitsyncImage::UnitsyncImage( int width, int height )
 	: m_data_ptr( NewImagePtr(width, height) )
 {
+	if ( m_data_ptr )
+		m_data_ptr->fill( 0 );
 }
 
 UnitsyncImage::UnitsyncImage(const std::string &filename)
@@ -135,20 +340,17 @@ UnitsyncImage::PrivateImageType* UnitsyncImage::NewImagePtr(int width, int heigh
 	return NULL;
 }
 
-UnitsyncImage UnitsyncImage::FromMetalmapData(const Util::uninitialized_array<unsigned char>& data, int width, int height)
+UnitsyncImage UnitsyncImage::FromMetalmapData(const unsigned char* data, int width, int height, int maxwidth, int maxheight)
 {
-	PrivateImageType* img_p = NewImagePtr(width, height);
-	PrivateImageType& img = *img_p;
-	cimg_forXY(img,x,y) {
-		img(x,y,0,0) = 0;
-		img(x,y,0,1) = data[x+(y*width)];
-		img(x,y,0,2) = 0;
-	}
+	int out_width = width, out_height = height;
+	FitSize( out_width, out_height, maxwidth, maxheight );
+	PrivateImageType* img_p = NewImagePtr(out_width, out_height);
+	AreaAverage( *img_p, width, height, MetalmapSampler( data, width ) );
 	PrivateImagePtrType ptr( img_p );
 	return UnitsyncImage( ptr );
 }
 
-UnitsyncImage UnitsyncImage::FromVfsFileData( Util::uninitialized_array<char>& data, size_t size,
+UnitsyncImage UnitsyncImage::FromVfsFileData( const char* data, size_t size,
                                              const std::string& fn, bool useWhiteAsTransparent)
 {
 	PrivateImageType* img_p = new PrivateImageType( 100, 100, 1, 4 );
@@ -166,11 +368,20 @@ UnitsyncImage UnitsyncImage::FromVfsFileData( Util::uninitialized_array<char>& d
 }
 
 UnitsyncImage::UnitsyncImage()
-	: m_data_ptr( NewImagePtr() )
 {
 }
 
-void UnitsyncImage::Save(const std::string& path) const
+UnitsyncImage::UnitsyncImage( const UnitsyncImage& other )
+	: m_data_ptr( other.m_data_ptr )
+{
+}
+
+UnitsyncImage::UnitsyncImage( UnitsyncImage&& other )
+	: m_data_ptr( std::move( other.m_data_ptr ) )
+{
+}
+
+void UnitsyncImage::Save(const std::string& path, bool fast) const
 {
 	if (!isValid()) {
 		LslError("%s:%d (%s) %s failed, invalid image", __FILE__, __LINE__, __FUNCTION__, path.c_str());
@@ -181,11 +392,65 @@ void UnitsyncImage::Save(const std::string& path) const
 		LslError("%s:%d (%s) error creating file %s", __FILE__, __LINE__, __FUNCTION__, path.c_str());
 		return;
 	}
-	m_data_ptr->save_png(f);
+	if (!WritePng(f, *m_data_ptr, fast)) {
+		LslError("%s:%d (%s) error writing png %s", __FILE__, __LINE__, __FUNCTION__, path.c_str());
+	}
 	fclose(f);
 }
 
-void UnitsyncImage::Load(const std::string &path) const
+bool UnitsyncImage::SaveRaw(const std::string& path) const
+{
+	if (!isValid()) {
+		LslError("%s:%d (%s) %s failed, invalid image", __FILE__, __LINE__, __FUNCTION__, path.c_str());
+		return false;
+	}
+	if (GetWidth() > RAW_MAX_SIDE || GetHeight() > RAW_MAX_SIDE) {
+		LslWarning("%s:%d (%s) %s: %dx%d is too big for a raw image", __FILE__, __LINE__, __FUNCTION__, path.c_str(), GetWidth(), GetHeight());
+		return false;
+	}
+	FILE* f = Util::lslopen(path, "wb");
+	if (f == NULL) {
+		LslError("%s:%d (%s) error creating file %s", __FILE__, __LINE__, __FUNCTION__, path.c_str());
+		return false;
+	}
+	RawImageHeader header;
+	memcpy(header.magic, RAW_IMAGE_MAGIC, sizeof(header.magic));
+	header.width = m_data_ptr->width();
+	header.height = m_data_ptr->height();
+	header.spectrum = m_data_ptr->spectrum();
+	const size_t bytes = m_data_ptr->size() * sizeof(RawDataType);
+	const bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(m_data_ptr->data(), 1, bytes, f) == bytes;
+	fclose(f);
+	return ok;
+}
+
+bool UnitsyncImage::LoadRaw(const std::string& path)
+{
+	FILE* f = Util::lslopen(path, "rb");
+	if (f == NULL)
+		return false;
+	RawImageHeader header;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1
+		&& memcmp(header.magic, RAW_IMAGE_MAGIC, sizeof(header.magic)) == 0
+		&& header.width > 0 && header.width <= RAW_IMAGE_MAX_SIDE
+		&& header.height > 0 && header.height <= RAW_IMAGE_MAX_SIDE
+		&& header.spectrum > 0 && header.spectrum <= 4;
+	if (ok) {
+		PrivateImageType* img_p = new PrivateImageType(header.width, header.height, 1, header.spectrum);
+		const size_t bytes = img_p->size() * sizeof(RawDataType);
+		// the trailing getc makes sure there's no garbage after the pixels
+		ok = fread(img_p->data(), 1, bytes, f) == bytes && fgetc(f) == EOF;
+		if (ok)
+			m_data_ptr.reset(img_p);
+		else
+			delete img_p;
+	}
+	fclose(f);
+	return ok;
+}
+
+void UnitsyncImage::Load(const std::string &path)
 {
     try {
 		FILE* f = Util::lslopen(path, "rb");
@@ -193,8 +458,10 @@ void UnitsyncImage::Load(const std::string &path) const
 			LslError("%s:%d (%s) could not open file %s", __FILE__, __LINE__, __FUNCTION__, path.c_str());
 			return;
 		}
-		m_data_ptr->load_png(f);
+		PrivateImagePtrType img_p( new PrivateImageType() );
+		img_p->load_png(f);
 		fclose(f);
+		m_data_ptr = img_p;
 	} catch ( cimg_library::CImgIOException & c ) {
 		LslError("%s:%d (%s) %s failed: %s", __FILE__, __LINE__, __FUNCTION__, path.c_str(), c.what());
     } catch ( cimg_library::CImgException& c ) {
@@ -202,25 +469,18 @@ void UnitsyncImage::Load(const std::string &path) const
     }
 }
 
-UnitsyncImage UnitsyncImage::FromMinimapData(const UnitsyncImage::RawDataType *colors, int width, int height)
+UnitsyncImage UnitsyncImage::FromMinimapData(const unsigned short* colors, int width, int height, int maxwidth, int maxheight)
 {
-	PrivateImageType* img_p = NewImagePtr(width, height);
-	PrivateImageType& img = *img_p;
-	cimg_forXY(img,x,y) {
-		int at = x+(y*width);
-		img(x,y,0,0) = (unsigned char)( (( colors[at] >> 11 )/31.0)*255.0 );
-		img(x,y,0,1) = (unsigned char)( (( (colors[at] >> 5) & 63 )/63.0)*255.0 );
-		img(x,y,0,2) = (unsigned char)( (( colors[at] & 31 )/31.0)*255.0 );
-	}
+	int out_width = width, out_height = height;
+	FitSize( out_width, out_height, maxwidth, maxheight );
+	PrivateImageType* img_p = NewImagePtr(out_width, out_height);
+	AreaAverage( *img_p, width, height, MinimapSampler( colors, width ) );
 	PrivateImagePtrType ptr( img_p );
 	return UnitsyncImage( ptr );
 }
 
-UnitsyncImage UnitsyncImage::FromHeightmapData(const Util::uninitialized_array<unsigned short>& grayscale, int width, int height)
+UnitsyncImage UnitsyncImage::FromHeightmapData(const unsigned short* grayscale, int width, int height, int maxwidth, int maxheight)
 {
-	PrivateImageType* img_p = NewImagePtr(width, height);
-	PrivateImageType& img = *img_p;
-
 	// the height is mapped to this "palette" of colors
 	// the colors are linearly interpolated
 	const unsigned char points[][3] = {
@@ -234,26 +494,25 @@ UnitsyncImage UnitsyncImage::FromHeightmapData(const Util::uninitialized_array<u
 	const int numPoints = sizeof(points) / sizeof(points[0]);
 
 	// find range of values present in the height data returned by unitsync
-	int min = 65536;
-	int max = 0;
-
-	for ( int i = 0; i < width*height; i++ ) {
-		if (grayscale[i] < min) min = grayscale[i];
-		if (grayscale[i] > max) max = grayscale[i];
+	if ( width <= 0 || height <= 0 ) {
+		return UnitsyncImage( 1, 1 );
 	}
+	boost::uint16_t lowest, highest;
+	ImageKernels::MinMax( grayscale, size_t(width) * height, lowest, highest );
+	const int min = lowest;
+	const int max = highest;
 
 	// prevent division by zero -- heightmap wouldn't contain any information anyway
 	if (min == max) {
-		delete img_p;
 		return UnitsyncImage( 1, 1 );
 	}
 
-	// perform the mapping From 16 bit grayscale to 24 bit true color
+	// perform the mapping From 16 bit grayscale to 24 bit true color,
+	// once per height present instead of once per pixel
 	const double range = max - min + 1;
-//	for ( int i = 0; i < width*height; i++ ) {
-	cimg_forXY(img,x,y) {
-		const int i = x + (y*width);
-		const double value = (grayscale[i] - min) / (range / (numPoints - 1));
+	std::vector<boost::uint32_t> palette( max - min + 1 );
+	for ( int h = min; h <= max; ++h ) {
+		const double value = (h - min) / (range / (numPoints - 1));
 		const int idx1 = int(value);
 		const int idx2 = idx1 + 1;
 		const int t = int(256.0 * (value - std::floor(value)));
@@ -261,18 +520,23 @@ UnitsyncImage UnitsyncImage::FromHeightmapData(const Util::uninitialized_array<u
 		//assert(idx1 >= 0 && idx1 < numPoints-1);
 		//assert(idx2 >= 1 && idx2 < numPoints);
 		//assert(t >= 0 && t <= 255);
-		cimg_forC(img,j) {
-			img(x,y,0,j) = (points[idx1][j] * (255 - t) + points[idx2][j] * t) / 255;
+		for ( int j = 0; j < 3; ++j ) {
+			const boost::uint32_t channel = (points[idx1][j] * (255 - t) + points[idx2][j] * t) / 255;
+			palette[h - min] |= channel << ( 8 * j );
 		}
 	}
 
+	int out_width = width, out_height = height;
+	FitSize( out_width, out_height, maxwidth, maxheight );
+	PrivateImageType* img_p = NewImagePtr(out_width, out_height);
+	AreaAverage( *img_p, width, height, HeightmapSampler( grayscale, width, min, palette ) );
 	PrivateImagePtrType ptr( img_p );
 	return UnitsyncImage( ptr );
 }
 
 int UnitsyncImage::GetHeight() const
 {
-	return m_data_ptr->height();
+	return m_data_ptr ? m_data_ptr->height() : 0;
 }
 
 void UnitsyncImage::Rescale(const int new_width, const int new_height)
@@ -282,7 +546,15 @@ void UnitsyncImage::Rescale(const int new_width, const int new_height)
 		return;
 	}
 	if ((GetWidth() == new_width) && (GetHeight() == new_height)) return; //no size change
-    m_data_ptr->resize( new_width, new_height, 1 /*z*/, 3 /*c*/, 5 /*interpolation type*/);
+	if ((new_width <= GetWidth()) && (new_height <= GetHeight())) {
+		// cubic interpolation only looks at the nearest source pixels and aliases when shrinking
+		const PrivateImageType& src = *m_data_ptr;
+		PrivateImageType* img_p = new PrivateImageType( new_width, new_height, 1, src.spectrum() );
+		AreaAverage( *img_p, src.width(), src.height(), ImageSampler<PrivateImageType>( src ) );
+		m_data_ptr.reset( img_p );
+		return;
+	}
+	m_data_ptr.reset( new PrivateImageType( m_data_ptr->get_resize( new_width, new_height, 1 /*z*/, m_data_ptr->spectrum() /*c*/, 5 /*interpolation type*/) ) );
 }
 
 void UnitsyncImage::MakeTransparent(unsigned short r, unsigned short g, unsigned short b)
@@ -296,11 +568,10 @@ void UnitsyncImage::MakeTransparent(unsigned short r, unsigned short g, unsigned
 	}
 
 	//no alpha channel, create new image with alpha channel
-	PrivateImageType& img = *m_data_ptr;
-	PrivateImageType* tmp = new PrivateImageType(img.width(), img.height(), 1, 4 );
+	const PrivateImageType& img = *m_data_ptr;
+	PrivateImageType* tmp = new PrivateImageType( img.get_channels(0, 3) );
 	PrivateImageType& img2 = *tmp;
 
-	img2 = img.channels(0, 3);
 	cimg_forXY(img2,x,y) {
 		if ((img2(x,y,0,0) == r) && (img2(x,y,0,1) == g) && (img2(x,y,0,2) == b)) { //pixel is white, make transparent
 			img2(x,y,0,3) = 0;
@@ -308,12 +579,36 @@ void UnitsyncImage::MakeTransparent(unsigned short r, unsigned short g, unsigned
 			img2(x,y,0,3) = 255;
 		}
 	}
-	*m_data_ptr = img2;
+	m_data_ptr.reset( tmp );
+}
+
+void UnitsyncImage::Paste( const UnitsyncImage& src, int x, int y )
+{
+	if (!isValid() || !src.isValid())
+		return;
+	// the one change made in place, so detach from other copies first
+	if (!m_data_ptr.unique())
+		m_data_ptr.reset( new PrivateImageType( *m_data_ptr ) );
+	m_data_ptr->draw_image( x, y, 0, 0, *src.m_data_ptr );
+}
+
+void UnitsyncImage::Paste( const UnitsyncImage& src, int x, int y, int src_x, int src_y, int width, int height )
+{
+	if (!isValid() || !src.isValid() || width <= 0 || height <= 0)
+		return;
+	if (!m_data_ptr.unique())
+		m_data_ptr.reset( new PrivateImageType( *m_data_ptr ) );
+	m_data_ptr->draw_image( x, y, 0, 0, src.m_data_ptr->get_crop( src_x, src_y, src_x + width - 1, src_y + height - 1 ) );
 }
 
 int UnitsyncImage::GetWidth() const
 {
-	return m_data_ptr->width();
+	return m_data_ptr ? m_data_ptr->width() : 0;
+}
+
+size_t UnitsyncImage::MemoryUsage() const
+{
+	return m_data_ptr ? m_data_ptr->size() * sizeof(RawDataType) : 0;
 }
 
 void UnitsyncImage::RescaleIfBigger(const int maxwidth, const int maxheight) {
@@ -321,30 +616,79 @@ void UnitsyncImage::RescaleIfBigger(const int maxwidth, const int maxheight) {
 
 	int height= GetHeight();
 	int width = GetWidth();
-	bool rescale=false;
-	if (height > maxheight) {
-		width = (float(maxheight) / height) * width;
-		height = maxheight;
-		rescale = true;
-	}
-	if (width > maxwidth) {
-		height = (float(maxwidth) / width) * height;
-		width = maxwidth;
-		rescale = true;
-	}
-	if (rescale) {
+	FitSize(width, height, maxwidth, maxheight);
+	if ((width != GetWidth()) || (height != GetHeight())) {
 		Rescale(width, height);
 	}
 }
 
 UnitsyncImage& UnitsyncImage::operator= (const UnitsyncImage& other)
 {
-	const PrivateImageType& src = *other.m_data_ptr;
-	PrivateImageType& dest = *m_data_ptr;
-	dest = src;
+	m_data_ptr = other.m_data_ptr;
+	return *this;
+}
+
+UnitsyncImage& UnitsyncImage::operator= (UnitsyncImage&& other)
+{
+	m_data_ptr = std::move( other.m_data_ptr );
 	return *this;
 }
 
+UnitsyncImagePyramid::UnitsyncImagePyramid( const UnitsyncImage& base, int min_size )
+{
+	typedef UnitsyncImage::PrivateImageType
+		Image;
+	m_levels.push_back( base );
+	if ( !base.isValid() )
+		return;
+	for (;;) {
+		const Image& src = *m_levels.back().m_data_ptr;
+		const int width = src.width() / 2;
+		const int height = src.height() / 2;
+		if ( width < min_size || height < min_size )
+			break;
+		Image* img_p = new Image( width, height, 1, src.spectrum() );
+		if ( src.width() % 2 == 0 && src.height() % 2 == 0 ) {
+			for ( int c = 0; c < src.spectrum(); ++c )
+				for ( int y = 0; y < height; ++y )
+					ImageKernels::HalveRows( src.data( 0, 2 * y, 0, c ), src.data( 0, 2 * y + 1, 0, c ), width, img_p->data( 0, y, 0, c ) );
+		} else {
+			// odd sides leave some pixels covering three source pixels
+			AreaAverage( *img_p, src.width(), src.height(), ImageSampler<Image>( src ) );
+		}
+		m_levels.push_back( UnitsyncImage( UnitsyncImage::PrivateImagePtrType( img_p ) ) );
+	}
+}
+
+UnitsyncImage UnitsyncImagePyramid::Scaled( int width, int height ) const
+{
+	if ( !isValid() )
+		return UnitsyncImage();
+	size_t level = m_levels.size() - 1;
+	while ( level > 0 && ( m_levels[level].GetWidth() < width || m_levels[level].GetHeight() < height ) )
+		--level;
+	UnitsyncImage img( m_levels[level] );
+	img.Rescale( width, height );
+	return img;
+}
+
+int UnitsyncImagePyramid::GetWidth() const
+{
+	return m_levels.empty() ? 0 : m_levels[0].GetWidth();
+}
+
+int UnitsyncImagePyramid::GetHeight() const
+{
+	return m_levels.empty() ? 0 : m_levels[0].GetHeight();
+}
+
+size_t UnitsyncImagePyramid::MemoryUsage() const
+{
+	size_t bytes = 0;
+	for ( size_t i = 0; i < m_levels.size(); ++i )
+		bytes += m_levels[i].MemoryUsage();
+	return bytes;
+}
 
 #ifdef HAVE_WX
 wxBitmap UnitsyncImage::wxbitmap() const
@@ -358,7 +702,7 @@ wxImage UnitsyncImage::wximage () const
 		return wxImage(1,1);
 	}
     wxImage img(m_data_ptr->width(), m_data_ptr->height());
-    const auto ptr = *m_data_ptr;
+    const PrivateImageType& ptr = *m_data_ptr;
     cimg_forXY(ptr,x,y) {
         img.SetRGB(x, y, ptr(x,y,0,0), ptr(x,y,0,1), ptr(x,y,0,2));
     }
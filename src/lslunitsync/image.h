@@ -1,6 +1,7 @@
 #ifndef LSL_IMAGE_H
 #define LSL_IMAGE_H
 
+#include <vector>
 #include <boost/shared_ptr.hpp>
 
 //we really, really don't want to include the cimg
@@ -17,18 +18,17 @@ struct CImg;
 
 namespace LSL {
 
-namespace Util {
-template <class T>
-class uninitialized_array;
-}
-
 /** we use this class mostly to hide the cimg implementation details
- * \todo decide/implement COW
+ * pixels are RGB8, or RGBA8 after MakeTransparent()
+ * Copies share the pixel buffer. Changes either swap in a new one (Load,
+ * Rescale, MakeTransparent) or, for Paste, copy it first if it is shared. So
+ * copying is a refcount increment, moving is free and caches can hand out
+ * their images.
  */
 class UnitsyncImage
 {
 private:
-    typedef unsigned short
+    typedef unsigned char
         RawDataType;
     typedef cimg_library::CImg<RawDataType>
         PrivateImageType;
@@ -36,23 +36,35 @@ private:
 		PrivateImagePtrType;
 public:
 	UnitsyncImage();
+	UnitsyncImage( const UnitsyncImage& other );
+	UnitsyncImage( UnitsyncImage&& other );
 	UnitsyncImage& operator= (const UnitsyncImage& other);
+	UnitsyncImage& operator= (UnitsyncImage&& other);
+	//! black RGB image
 	explicit UnitsyncImage( int width, int height );
 	UnitsyncImage( const std::string& filename );
 
-    //! delegates save to cimg library, format is deducted from last path compoment (ie. after the last dot)
-	void Save( const std::string& path ) const;
+    //! saves as 8 bit png, \param fast trades file size for speed (zlib level 1, cheapest row filter)
+	void Save( const std::string& path, bool fast = false ) const;
     //! same principle as \ref Save
-	void Load( const std::string& path ) const;
+	void Load( const std::string& path );
+	//! longest side SaveRaw writes and LoadRaw accepts
+	static const int RAW_MAX_SIDE = 1 << 14;
+	//! uncompressed pixel dump, a small header followed by the buffer as it is in memory
+	bool SaveRaw( const std::string& path ) const;
+	//! reads a \ref SaveRaw file with a single read, false if it is missing or damaged
+	bool LoadRaw( const std::string& path );
 
   /** \name factory functions
    * \brief creating UnitsyncImage from raw data pointers
+   * Map data is converted and, if bigger than maxwidth x maxheight, area
+   * averaged down to fit in the same pass, like RescaleIfBigger() would.
    **/
   ///@{
-	static UnitsyncImage FromMinimapData( const RawDataType* data, int width, int height );
-	static UnitsyncImage FromHeightmapData( const Util::uninitialized_array<unsigned short>& data, int width, int height );
-	static UnitsyncImage FromMetalmapData( const Util::uninitialized_array<unsigned char>& data, int width, int height );
-	static UnitsyncImage FromVfsFileData( Util::uninitialized_array<char>& data, size_t size, const std::string& fn, bool useWhiteAsTransparent = true );
+	static UnitsyncImage FromMinimapData( const unsigned short* data, int width, int height, int maxwidth = 512, int maxheight = 512 );
+	static UnitsyncImage FromHeightmapData( const unsigned short* data, int width, int height, int maxwidth = 512, int maxheight = 512 );
+	static UnitsyncImage FromMetalmapData( const unsigned char* data, int width, int height, int maxwidth = 512, int maxheight = 512 );
+	static UnitsyncImage FromVfsFileData( const char* data, size_t size, const std::string& fn, bool useWhiteAsTransparent = true );
     ///@}
 
     #ifdef HAVE_WX
@@ -61,19 +73,53 @@ public:
     #endif
 	int GetWidth() const;
 	int GetHeight() const;
+	//! shrinking averages the covered pixels, enlarging interpolates bicubic
 	void Rescale( const int new_width, const int new_height);
 	//rescale image to a max resolution 512x512 with keeping aspect ratio
 	void RescaleIfBigger(const int maxwidth= 512, const int maxheight=512);
 
 	bool isValid() const { return ((GetWidth()>0) && (GetHeight()>0));}
+	//! bytes held by the pixel buffer, used for cache budgets
+	size_t MemoryUsage() const;
 	// makes given color transparent
 	void MakeTransparent(unsigned short r = 255, unsigned short g = 255, unsigned short b = 255);
+	//! draws \param src with its top left corner at \param x, \param y, clipped to this image
+	void Paste( const UnitsyncImage& src, int x, int y );
+	//! same, for the \param width x \param height part of \param src at \param src_x, \param src_y
+	void Paste( const UnitsyncImage& src, int x, int y, int src_x, int src_y, int width, int height );
 private:
+	friend class UnitsyncImagePyramid;
 	UnitsyncImage( PrivateImagePtrType ptr );
 	static PrivateImageType* NewImagePtr( int width = 0, int height = 0 );
 	PrivateImagePtrType m_data_ptr;
 };
 
+/** \brief An image and its successively halved copies
+ *
+ * Built once per map image with a 2x2 box filter, so previews of any size
+ * only area average the smallest level that is still big enough instead of
+ * shrinking the full image again. Copies share the levels.
+ */
+class UnitsyncImagePyramid
+{
+public:
+	UnitsyncImagePyramid() {}
+	//! halves \param base until a side would drop below \param min_size
+	explicit UnitsyncImagePyramid( const UnitsyncImage& base, int min_size = 16 );
+
+	//! \param width x \param height from the nearest level, enlarging starts at the full image
+	UnitsyncImage Scaled( int width, int height ) const;
+
+	int GetWidth() const;
+	int GetHeight() const;
+	size_t GetLevelCount() const { return m_levels.size(); }
+	bool isValid() const { return !m_levels.empty() && m_levels[0].isValid(); }
+	//! bytes held by all levels, used for cache budgets
+	size_t MemoryUsage() const;
+private:
+	std::vector<UnitsyncImage> m_levels;
+};
+
 } //namespace LSL
 
 /**
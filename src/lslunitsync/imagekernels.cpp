@@ -0,0 +1,325 @@
+#include "imagekernels.h"
+
+#include <atomic>
+#include <algorithm>
+
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+// no global -m flags needed, the vector versions are compiled per function
+#define LSL_X86_KERNELS 1
+#include <immintrin.h>
+#define LSL_TARGET_SSE2 __attribute__((target("sse2")))
+#define LSL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace LSL {
+
+namespace ImageKernels {
+
+namespace {
+
+typedef boost::uint8_t
+	u8;
+typedef boost::uint16_t
+	u16;
+typedef boost::uint32_t
+	u32;
+
+std::atomic<int>& LevelInUse()
+{
+	static std::atomic<int> level( Detect() );
+	return level;
+}
+
+// exact (v * 255) / 31 and (v * 255) / 63 within 16 bits, so the vector versions can use them too
+inline u8 Expand5( unsigned int v ) { return u8( ( v * 1053 ) >> 7 ); }
+inline u8 Expand6( unsigned int v ) { return u8( ( v * 259 + 3 ) >> 6 ); }
+
+void MinMaxScalar( const u16* data, size_t count, u16& min, u16& max )
+{
+	// locals and no branches, so the compiler can keep them in registers or vectorize
+	u16 lowest = min, highest = max;
+	for ( size_t i = 0; i < count; ++i ) {
+		lowest = std::min( lowest, data[i] );
+		highest = std::max( highest, data[i] );
+	}
+	min = lowest;
+	max = highest;
+}
+
+void UnpackRGB565Scalar( const u16* colors, size_t count, u8* r, u8* g, u8* b )
+{
+	for ( size_t i = 0; i < count; ++i ) {
+		const unsigned int c = colors[i];
+		r[i] = Expand5( c >> 11 );
+		g[i] = Expand6( ( c >> 5 ) & 63 );
+		b[i] = Expand5( c & 31 );
+	}
+}
+
+void MapPaletteScalar( const u16* data, size_t count, u16 offset, const u32* palette, u8* r, u8* g, u8* b )
+{
+	for ( size_t i = 0; i < count; ++i ) {
+		const u32 color = palette[data[i] - offset];
+		r[i] = u8( color );
+		g[i] = u8( color >> 8 );
+		b[i] = u8( color >> 16 );
+	}
+}
+
+void HalveRowsScalar( const u8* top, const u8* bottom, size_t count, u8* out )
+{
+	for ( size_t i = 0; i < count; ++i )
+		out[i] = u8( ( top[2 * i] + top[2 * i + 1] + bottom[2 * i] + bottom[2 * i + 1] + 2 ) >> 2 );
+}
+
+#ifdef LSL_X86_KERNELS
+
+LSL_TARGET_SSE2
+void MinMaxSSE2( const u16* data, size_t count, u16& min, u16& max )
+{
+	// SSE2 only compares signed words, flipping the top bit maps unsigned order onto signed
+	const __m128i bias = _mm_set1_epi16( short(0x8000) );
+	__m128i vmin = _mm_set1_epi16( 0x7fff );
+	__m128i vmax = _mm_set1_epi16( short(0x8000) );
+	size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 ) {
+		const __m128i v = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)( data + i ) ), bias );
+		vmin = _mm_min_epi16( vmin, v );
+		vmax = _mm_max_epi16( vmax, v );
+	}
+	u16 lows[8], highs[8];
+	_mm_storeu_si128( (__m128i*)lows, _mm_xor_si128( vmin, bias ) );
+	_mm_storeu_si128( (__m128i*)highs, _mm_xor_si128( vmax, bias ) );
+	if ( i > 0 ) {
+		MinMaxScalar( lows, 8, min, max );
+		MinMaxScalar( highs, 8, min, max );
+	}
+	MinMaxScalar( data + i, count - i, min, max );
+}
+
+LSL_TARGET_SSE2
+void UnpackRGB565SSE2( const u16* colors, size_t count, u8* r, u8* g, u8* b )
+{
+	const __m128i mask5 = _mm_set1_epi16( 31 );
+	const __m128i mask6 = _mm_set1_epi16( 63 );
+	const __m128i mul5 = _mm_set1_epi16( 1053 );
+	const __m128i mul6 = _mm_set1_epi16( 259 );
+	const __m128i add6 = _mm_set1_epi16( 3 );
+	size_t i = 0;
+	for ( ; i + 16 <= count; i += 16 ) {
+		__m128i red[2], green[2], blue[2];
+		for ( int k = 0; k < 2; ++k ) {
+			const __m128i c = _mm_loadu_si128( (const __m128i*)( colors + i + k * 8 ) );
+			red[k] = _mm_srli_epi16( _mm_mullo_epi16( _mm_srli_epi16( c, 11 ), mul5 ), 7 );
+			green[k] = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_and_si128( _mm_srli_epi16( c, 5 ), mask6 ), mul6 ), add6 ), 6 );
+			blue[k] = _mm_srli_epi16( _mm_mullo_epi16( _mm_and_si128( c, mask5 ), mul5 ), 7 );
+		}
+		_mm_storeu_si128( (__m128i*)( r + i ), _mm_packus_epi16( red[0], red[1] ) );
+		_mm_storeu_si128( (__m128i*)( g + i ), _mm_packus_epi16( green[0], green[1] ) );
+		_mm_storeu_si128( (__m128i*)( b + i ), _mm_packus_epi16( blue[0], blue[1] ) );
+	}
+	UnpackRGB565Scalar( colors + i, count - i, r + i, g + i, b + i );
+}
+
+LSL_TARGET_SSE2
+void HalveRowsSSE2( const u8* top, const u8* bottom, size_t count, u8* out )
+{
+	// _mm_avg_epu8 rounds twice, sum exactly in 16 bits instead
+	const __m128i low_byte = _mm_set1_epi16( 0xff );
+	const __m128i two = _mm_set1_epi16( 2 );
+	size_t i = 0;
+	for ( ; i + 16 <= count; i += 16 ) {
+		__m128i halves[2];
+		for ( int k = 0; k < 2; ++k ) {
+			const __m128i t = _mm_loadu_si128( (const __m128i*)( top + 2 * i + k * 16 ) );
+			const __m128i b = _mm_loadu_si128( (const __m128i*)( bottom + 2 * i + k * 16 ) );
+			const __m128i sum = _mm_add_epi16(
+				_mm_add_epi16( _mm_and_si128( t, low_byte ), _mm_srli_epi16( t, 8 ) ),
+				_mm_add_epi16( _mm_and_si128( b, low_byte ), _mm_srli_epi16( b, 8 ) ) );
+			halves[k] = _mm_srli_epi16( _mm_add_epi16( sum, two ), 2 );
+		}
+		_mm_storeu_si128( (__m128i*)( out + i ), _mm_packus_epi16( halves[0], halves[1] ) );
+	}
+	HalveRowsScalar( top + 2 * i, bottom + 2 * i, count - i, out + i );
+}
+
+LSL_TARGET_AVX2
+void MinMaxAVX2( const u16* data, size_t count, u16& min, u16& max )
+{
+	__m256i vmin = _mm256_set1_epi16( short(0xffff) );
+	__m256i vmax = _mm256_setzero_si256();
+	size_t i = 0;
+	for ( ; i + 16 <= count; i += 16 ) {
+		const __m256i v = _mm256_loadu_si256( (const __m256i*)( data + i ) );
+		vmin = _mm256_min_epu16( vmin, v );
+		vmax = _mm256_max_epu16( vmax, v );
+	}
+	u16 lows[16], highs[16];
+	_mm256_storeu_si256( (__m256i*)lows, vmin );
+	_mm256_storeu_si256( (__m256i*)highs, vmax );
+	if ( i > 0 ) {
+		MinMaxScalar( lows, 16, min, max );
+		MinMaxScalar( highs, 16, min, max );
+	}
+	MinMaxScalar( data + i, count - i, min, max );
+}
+
+LSL_TARGET_AVX2
+void UnpackRGB565AVX2( const u16* colors, size_t count, u8* r, u8* g, u8* b )
+{
+	const __m256i mask5 = _mm256_set1_epi16( 31 );
+	const __m256i mask6 = _mm256_set1_epi16( 63 );
+	const __m256i mul5 = _mm256_set1_epi16( 1053 );
+	const __m256i mul6 = _mm256_set1_epi16( 259 );
+	const __m256i add6 = _mm256_set1_epi16( 3 );
+	size_t i = 0;
+	for ( ; i + 32 <= count; i += 32 ) {
+		__m256i red[2], green[2], blue[2];
+		for ( int k = 0; k < 2; ++k ) {
+			const __m256i c = _mm256_loadu_si256( (const __m256i*)( colors + i + k * 16 ) );
+			red[k] = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_srli_epi16( c, 11 ), mul5 ), 7 );
+			green[k] = _mm256_srli_epi16( _mm256_add_epi16( _mm256_mullo_epi16( _mm256_and_si256( _mm256_srli_epi16( c, 5 ), mask6 ), mul6 ), add6 ), 6 );
+			blue[k] = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_and_si256( c, mask5 ), mul5 ), 7 );
+		}
+		// packs work per 128 bit lane, the permute puts the quarters back in order
+		_mm256_storeu_si256( (__m256i*)( r + i ), _mm256_permute4x64_epi64( _mm256_packus_epi16( red[0], red[1] ), 0xD8 ) );
+		_mm256_storeu_si256( (__m256i*)( g + i ), _mm256_permute4x64_epi64( _mm256_packus_epi16( green[0], green[1] ), 0xD8 ) );
+		_mm256_storeu_si256( (__m256i*)( b + i ), _mm256_permute4x64_epi64( _mm256_packus_epi16( blue[0], blue[1] ), 0xD8 ) );
+	}
+	UnpackRGB565Scalar( colors + i, count - i, r + i, g + i, b + i );
+}
+
+LSL_TARGET_AVX2
+void MapPaletteAVX2( const u16* data, size_t count, u16 offset, const u32* palette, u8* r, u8* g, u8* b )
+{
+	const __m256i base = _mm256_set1_epi32( offset );
+	const __m256i low_byte = _mm256_set1_epi32( 0xff );
+	size_t i = 0;
+	for ( ; i + 16 <= count; i += 16 ) {
+		const __m256i index0 = _mm256_sub_epi32( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( data + i ) ) ), base );
+		const __m256i index1 = _mm256_sub_epi32( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( data + i + 8 ) ) ), base );
+		const __m256i color0 = _mm256_i32gather_epi32( (const int*)palette, index0, 4 );
+		const __m256i color1 = _mm256_i32gather_epi32( (const int*)palette, index1, 4 );
+		const __m256i red = _mm256_permute4x64_epi64( _mm256_packus_epi32(
+			_mm256_and_si256( color0, low_byte ), _mm256_and_si256( color1, low_byte ) ), 0xD8 );
+		const __m256i green = _mm256_permute4x64_epi64( _mm256_packus_epi32(
+			_mm256_and_si256( _mm256_srli_epi32( color0, 8 ), low_byte ), _mm256_and_si256( _mm256_srli_epi32( color1, 8 ), low_byte ) ), 0xD8 );
+		const __m256i blue = _mm256_permute4x64_epi64( _mm256_packus_epi32(
+			_mm256_and_si256( _mm256_srli_epi32( color0, 16 ), low_byte ), _mm256_and_si256( _mm256_srli_epi32( color1, 16 ), low_byte ) ), 0xD8 );
+		// 16 red bytes in the low half, 16 green in the high half
+		const __m256i red_green = _mm256_permute4x64_epi64( _mm256_packus_epi16( red, green ), 0xD8 );
+		const __m256i blues = _mm256_permute4x64_epi64( _mm256_packus_epi16( blue, blue ), 0xD8 );
+		_mm_storeu_si128( (__m128i*)( r + i ), _mm256_castsi256_si128( red_green ) );
+		_mm_storeu_si128( (__m128i*)( g + i ), _mm256_extracti128_si256( red_green, 1 ) );
+		_mm_storeu_si128( (__m128i*)( b + i ), _mm256_castsi256_si128( blues ) );
+	}
+	MapPaletteScalar( data + i, count - i, offset, palette, r + i, g + i, b + i );
+}
+
+LSL_TARGET_AVX2
+void HalveRowsAVX2( const u8* top, const u8* bottom, size_t count, u8* out )
+{
+	const __m256i low_byte = _mm256_set1_epi16( 0xff );
+	const __m256i two = _mm256_set1_epi16( 2 );
+	size_t i = 0;
+	for ( ; i + 32 <= count; i += 32 ) {
+		__m256i halves[2];
+		for ( int k = 0; k < 2; ++k ) {
+			const __m256i t = _mm256_loadu_si256( (const __m256i*)( top + 2 * i + k * 32 ) );
+			const __m256i b = _mm256_loadu_si256( (const __m256i*)( bottom + 2 * i + k * 32 ) );
+			const __m256i sum = _mm256_add_epi16(
+				_mm256_add_epi16( _mm256_and_si256( t, low_byte ), _mm256_srli_epi16( t, 8 ) ),
+				_mm256_add_epi16( _mm256_and_si256( b, low_byte ), _mm256_srli_epi16( b, 8 ) ) );
+			halves[k] = _mm256_srli_epi16( _mm256_add_epi16( sum, two ), 2 );
+		}
+		_mm256_storeu_si256( (__m256i*)( out + i ), _mm256_permute4x64_epi64( _mm256_packus_epi16( halves[0], halves[1] ), 0xD8 ) );
+	}
+	HalveRowsScalar( top + 2 * i, bottom + 2 * i, count - i, out + i );
+}
+
+#endif // LSL_X86_KERNELS
+
+} // namespace
+
+Level Detect()
+{
+#ifdef LSL_X86_KERNELS
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return LEVEL_AVX2;
+	if ( __builtin_cpu_supports( "sse2" ) )
+		return LEVEL_SSE2;
+#endif
+	return LEVEL_SCALAR;
+}
+
+Level Current()
+{
+	return Level( LevelInUse().load( std::memory_order_relaxed ) );
+}
+
+Level Use( Level level )
+{
+	const Level used = level < Detect() ? level : Detect();
+	LevelInUse().store( used, std::memory_order_relaxed );
+	return used;
+}
+
+const char* Name( Level level )
+{
+	switch ( level ) {
+		case LEVEL_AVX2: return "avx2";
+		case LEVEL_SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
+
+void MinMax( const u16* data, size_t count, u16& min, u16& max )
+{
+	min = 0xffff;
+	max = 0;
+	switch ( Current() ) {
+#ifdef LSL_X86_KERNELS
+		case LEVEL_AVX2: MinMaxAVX2( data, count, min, max ); break;
+		case LEVEL_SSE2: MinMaxSSE2( data, count, min, max ); break;
+#endif
+		default: MinMaxScalar( data, count, min, max ); break;
+	}
+}
+
+void UnpackRGB565( const u16* colors, size_t count, u8* r, u8* g, u8* b )
+{
+	switch ( Current() ) {
+#ifdef LSL_X86_KERNELS
+		case LEVEL_AVX2: UnpackRGB565AVX2( colors, count, r, g, b ); break;
+		case LEVEL_SSE2: UnpackRGB565SSE2( colors, count, r, g, b ); break;
+#endif
+		default: UnpackRGB565Scalar( colors, count, r, g, b ); break;
+	}
+}
+
+void MapPalette( const u16* data, size_t count, u16 offset, const u32* palette, u8* r, u8* g, u8* b )
+{
+	switch ( Current() ) {
+#ifdef LSL_X86_KERNELS
+		// SSE2 has no gather, a scalar lookup is as good as it gets there
+		case LEVEL_AVX2: MapPaletteAVX2( data, count, offset, palette, r, g, b ); break;
+#endif
+		default: MapPaletteScalar( data, count, offset, palette, r, g, b ); break;
+	}
+}
+
+void HalveRows( const u8* top, const u8* bottom, size_t count, u8* out )
+{
+	switch ( Current() ) {
+#ifdef LSL_X86_KERNELS
+		case LEVEL_AVX2: HalveRowsAVX2( top, bottom, count, out ); break;
+		case LEVEL_SSE2: HalveRowsSSE2( top, bottom, count, out ); break;
+#endif
+		default: HalveRowsScalar( top, bottom, count, out ); break;
+	}
+}
+
+} // namespace ImageKernels
+
+} // namespace LSL
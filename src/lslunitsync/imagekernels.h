@@ -0,0 +1,76 @@
+#ifndef LSL_HEADERGUARD_IMAGEKERNELS_H
+#define LSL_HEADERGUARD_IMAGEKERNELS_H
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace LSL {
+
+/** \brief Pixel loops behind UnitsyncImage's map data conversion
+ *
+ * Each kernel exists as scalar code and, on x86 with gcc or clang, as SSE2
+ * and AVX2 code picked at runtime for the CPU we run on. All versions give
+ * identical results. Outputs are planar, one row per channel, as CImg keeps them.
+ */
+namespace ImageKernels {
+
+enum Level {
+	LEVEL_SCALAR = 0,
+	LEVEL_SSE2,
+	LEVEL_AVX2
+};
+
+//! best level this CPU and build support
+Level Detect();
+//! level in use, Detect() unless changed by Use()
+Level Current();
+//! use at most \param level, for benchmarks and tests; returns the level actually used
+Level Use( Level level );
+const char* Name( Level level );
+
+//! smallest and largest of \param count values, count must be > 0
+void MinMax( const boost::uint16_t* data, size_t count, boost::uint16_t& min, boost::uint16_t& max );
+
+//! RGB565 to 8 bit channels, exactly (c * 255) / 31 resp. / 63
+void UnpackRGB565( const boost::uint16_t* colors, size_t count,
+		boost::uint8_t* r, boost::uint8_t* g, boost::uint8_t* b );
+
+//! looks up data[i] - \param offset in \param palette, entries are 0x00BBGGRR
+void MapPalette( const boost::uint16_t* data, size_t count, boost::uint16_t offset, const boost::uint32_t* palette,
+		boost::uint8_t* r, boost::uint8_t* g, boost::uint8_t* b );
+
+//! 2x2 box filter, out[i] is the rounded average of top[2i], top[2i+1], bottom[2i] and bottom[2i+1]
+void HalveRows( const boost::uint8_t* top, const boost::uint8_t* bottom, size_t count, boost::uint8_t* out );
+
+} // namespace ImageKernels
+
+} // namespace LSL
+
+/**
+ * \file imagekernels.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_IMAGEKERNELS_H
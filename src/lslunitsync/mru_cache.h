@@ -2,97 +2,266 @@
 #define LSL_HEADERGUARD_MRU_CACHE_H
 
 #include <lslutils/debug.h>
+#include "cache_policy.h"
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 #include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/noncopyable.hpp>
 #ifdef WIN32 //undefine windows header pollution
 #ifdef GetUserName
 #undef GetUserName
 #endif
 #endif
-#include <list>
-#include <map>
 
 namespace LSL {
 
-/// Thread safe MRU cache (works like a std::map but has maximum size)
-template<typename TKey, typename TValue>
-class MostRecentlyUsedCache
+//! default cost function, the cache capacity is an item count
+struct CacheItemCount
+{
+	template < class T >
+	size_t operator()( const T& ) const { return 1; }
+};
+
+//! cost function for values reporting their heap footprint via MemoryUsage(), capacity is in bytes
+struct CacheItemBytes
+{
+	template < class T >
+	size_t operator()( const T& value ) const { return value.MemoryUsage(); }
+};
+
+/** \brief Thread safe MRU cache (works like a std::map but has maximum size)
+ *
+ * Keys are spread over independently locked shards, each one a hash map whose
+ * nodes double as the LRU lists, so concurrent callers rarely contend and an entry
+ * costs one allocation. The capacity is measured with \a TSize, which lets image
+ * caches budget bytes instead of items. \a TPolicy decides which items are kept
+ * when a shard is full (see cache_policy.h).
+ */
+template<typename TKey, typename TValue, typename TSize = CacheItemCount, typename TPolicy = LruPolicy>
+class MostRecentlyUsedCache : public boost::noncopyable
 {
 public:
-	//! name parameter might be used to identify stats in dgb output
-	MostRecentlyUsedCache(int max_size, const std::string& name = "" )
-		: m_size(0),
+	/** \param max_size capacity in units of \a TSize, split evenly over the shards
+	 *  \param name might be used to identify stats in dgb output
+	 */
+	MostRecentlyUsedCache(size_t max_size, const std::string& name = "", size_t shards = 8 )
+		: m_shards( std::max<size_t>( 1, std::min<size_t>( shards, max_size / 4 ) ) ),
 		m_max_size(max_size),
 		m_cache_hits(0),
 		m_cache_misses(0),
+		m_rejected(0),
 		m_name(name)
 	{
+		for ( size_t i = 0; i < m_shards.size(); ++i ) {
+			Shard& shard = m_shards[i];
+			shard.budget = std::max<size_t>( 1, max_size / m_shards.size() );
+			shard.policy.Init( shard.budget );
+			shard.window_budget = std::min( shard.budget, shard.policy.WindowBudget( shard.budget ) );
+		}
 	}
 
 	~MostRecentlyUsedCache()
 	{
-		LslDebug( "%s - cache hits: %d misses: %d", m_name.c_str(), m_cache_hits, m_cache_misses );
+		LslDebug( "%s - cache hits: %lu misses: %lu hit rate: %.1f%% rejected: %lu",
+				m_name.c_str(), Hits(), Misses(), HitRate() * 100.0, Rejected() );
 	}
 
 	void Add( const TKey& name, const TValue& img )
 	{
-		boost::mutex::scoped_lock lock(m_lock);
-		while ( m_size >= m_max_size ) {
-			--m_size;
-			m_iterator_map.erase( m_items.back().first );
-			m_items.pop_back();
+		const size_t cost = TSize()( img );
+		const size_t hash = boost::hash<TKey>()( name );
+		Shard& shard = GetShard( hash );
+		boost::mutex::scoped_lock lock(shard.lock);
+		shard.policy.Record( hash );
+		typename Shard::Map::iterator it = shard.items.find( name );
+		if ( it != shard.items.end() ) {
+			shard.Unlink( &*it );
+			it->second.value = img;
+		} else {
+			it = shard.items.insert( typename Shard::Map::value_type( name, Node( img, hash ) ) ).first;
 		}
-		++m_size;
-		m_items.push_front( CacheItem( name, img ) );
-		m_iterator_map[name] = m_items.begin();
+		it->second.cost = cost;
+		shard.max_cost = std::max( shard.max_cost, cost );
+		// new and updated items always enter the window
+		shard.PushFront( &*it, false );
+		m_rejected += shard.Balance();
 	}
 
 	bool TryGet( const TKey& name, TValue& img )
 	{
-		boost::mutex::scoped_lock lock(m_lock);
-		typename IteratorMap::iterator it = m_iterator_map.find( name );
-		if ( it == m_iterator_map.end() ) {
+		const size_t hash = boost::hash<TKey>()( name );
+		Shard& shard = GetShard( hash );
+		boost::mutex::scoped_lock lock(shard.lock);
+		shard.policy.Record( hash );
+		typename Shard::Map::iterator it = shard.items.find( name );
+		if ( it == shard.items.end() ) {
 			++m_cache_misses;
 			return false;
 		}
-		// reinsert at front, so that most recently used items are always at front
-		m_items.push_front( *it->second );
-		m_items.erase( it->second );
-		it->second = m_items.begin();
-		// return image
-		img = it->second->second;
+		// move to front, so that most recently used items are always at front
+		const bool main = it->second.main;
+		shard.Unlink( &*it );
+		shard.PushFront( &*it, main );
+		img = it->second.value;
 		++m_cache_hits;
 		return true;
 	}
 
 	void Clear()
 	{
-		boost::mutex::scoped_lock lock(m_lock);
-		m_size = 0;
-		m_items.clear();
-		m_iterator_map.clear();
+		for ( size_t i = 0; i < m_shards.size(); ++i ) {
+			Shard& shard = m_shards[i];
+			boost::mutex::scoped_lock lock(shard.lock);
+			shard.items.clear();
+			shard.lists[0] = shard.lists[1] = List();
+			shard.max_cost = 0;
+		}
+	}
+
+	//! summed cost of all cached items
+	size_t Used() const
+	{
+		size_t used = 0;
+		for ( size_t i = 0; i < m_shards.size(); ++i ) {
+			boost::mutex::scoped_lock lock(m_shards[i].lock);
+			used += m_shards[i].lists[0].used + m_shards[i].lists[1].used;
+		}
+		return used;
+	}
+	size_t Capacity() const { return m_max_size; }
+	unsigned long Hits() const { return m_cache_hits; }
+	unsigned long Misses() const { return m_cache_misses; }
+	//! items dropped by the policy right after leaving the window
+	unsigned long Rejected() const { return m_rejected; }
+	double HitRate() const
+	{
+		const unsigned long hits = Hits(), total = hits + Misses();
+		return total ? double(hits) / total : 0.0;
 	}
 
 private:
-	typedef std::pair<TKey, TValue> CacheItem;
-	typedef std::list<CacheItem> CacheItemList;
-	typedef std::map<TKey, typename CacheItemList::iterator> IteratorMap;
-
-	mutable boost::mutex m_lock;
-	CacheItemList m_items;
-	IteratorMap m_iterator_map;
-	int m_size;
-	const int m_max_size;
-	int m_cache_hits;
-	int m_cache_misses;
+	struct Node
+	{
+		Node( const TValue& v, size_t h ) : value( v ), hash( h ), cost( 0 ), main( false ), prev( NULL ), next( NULL ) {}
+		TValue value;
+		size_t hash;
+		size_t cost;
+		bool main; /// in the main segment, otherwise in the window
+		//! intrusive LRU links between map entries, stable since the map is node based
+		std::pair<const TKey, Node>* prev;
+		std::pair<const TKey, Node>* next;
+	};
+	typedef std::pair<const TKey, Node> Entry;
+
+	struct List
+	{
+		List() : head( NULL ), tail( NULL ), used( 0 ) {}
+		Entry* head;
+		Entry* tail;
+		size_t used;
+	};
+
+	struct Shard
+	{
+		typedef boost::unordered_map<TKey, Node> Map;
+
+		Shard() : budget( 0 ), window_budget( 0 ), max_cost( 0 ) {}
+		Shard( const Shard& ) : budget( 0 ), window_budget( 0 ), max_cost( 0 ) {}
+
+		void Unlink( Entry* e )
+		{
+			List& l = lists[e->second.main];
+			if ( e->second.prev ) e->second.prev->second.next = e->second.next;
+			else l.head = e->second.next;
+			if ( e->second.next ) e->second.next->second.prev = e->second.prev;
+			else l.tail = e->second.prev;
+			e->second.prev = e->second.next = NULL;
+			l.used -= e->second.cost;
+		}
+		void PushFront( Entry* e, bool main )
+		{
+			List& l = lists[main];
+			e->second.main = main;
+			e->second.next = l.head;
+			if ( l.head ) l.head->second.prev = e;
+			l.head = e;
+			if ( !l.tail ) l.tail = e;
+			l.used += e->second.cost;
+		}
+		void Evict( Entry* e )
+		{
+			Unlink( e );
+			items.erase( e->first );
+		}
+		//! move window overflow into the main segment as far as the policy admits it, returns the number of rejects
+		unsigned long Balance()
+		{
+			unsigned long rejected = 0;
+			List& window = lists[0];
+			List& main = lists[1];
+			const size_t window_floor = std::min( budget / 2, policy.WindowItems() * max_cost );
+			const size_t window_size = std::max( window_budget, window_floor );
+			const size_t main_budget = budget - window_size;
+			// an item larger than the window stays until the next insert
+			while ( window.used > window_size && window.tail != window.head ) {
+				Entry* candidate = window.tail;
+				Unlink( candidate );
+				bool admitted = true;
+				while ( main.tail && main.used + candidate->second.cost > main_budget ) {
+					if ( !policy.Admit( candidate->second.hash, main.tail->second.hash ) ) {
+						admitted = false;
+						break;
+					}
+					Evict( main.tail );
+				}
+				if ( main.used + candidate->second.cost > main_budget ) {
+					items.erase( candidate->first );
+					if ( !admitted )
+						++rejected;
+				} else {
+					PushFront( candidate, true );
+				}
+			}
+			while ( main.used > main_budget && main.tail )
+				Evict( main.tail );
+			return rejected;
+		}
+
+		mutable boost::mutex lock;
+		Map items;
+		List lists[2]; /// window, main
+		size_t budget;
+		size_t window_budget;
+		//! largest item cost seen, for the policy's window floor
+		size_t max_cost;
+		TPolicy policy;
+	};
+
+	Shard& GetShard( size_t h )
+	{
+		h ^= h >> 16; // the low bits also pick the bucket inside the shard
+		return m_shards[ h % m_shards.size() ];
+	}
+
+	std::vector<Shard> m_shards;
+	const size_t m_max_size;
+	std::atomic<unsigned long> m_cache_hits;
+	std::atomic<unsigned long> m_cache_misses;
+	std::atomic<unsigned long> m_rejected;
 	const std::string m_name;
 };
 
 class UnitsyncImage;
+class UnitsyncImagePyramid;
 struct MapInfo;
-typedef MostRecentlyUsedCache<std::string,UnitsyncImage> MostRecentlyUsedImageCache;
-typedef MostRecentlyUsedCache<std::string,MapInfo> MostRecentlyUsedMapInfoCache;
+typedef MostRecentlyUsedCache<std::string,UnitsyncImage,CacheItemBytes,TinyLfuPolicy> MostRecentlyUsedImageCache;
+typedef MostRecentlyUsedCache<std::string,UnitsyncImagePyramid,CacheItemBytes,TinyLfuPolicy> MostRecentlyUsedImagePyramidCache;
+typedef MostRecentlyUsedCache<std::string,MapInfo,CacheItemCount,TinyLfuPolicy> MostRecentlyUsedMapInfoCache;
 typedef MostRecentlyUsedCache<std::string,std::vector<std::string> > MostRecentlyUsedArrayStringCache;
 
 } // namespace LSL
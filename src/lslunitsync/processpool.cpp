@@ -0,0 +1,561 @@
+#include "processpool.h"
+
+#include <cstring>
+#include <map>
+#include <boost/cstdint.hpp>
+
+#ifndef WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
+
+#include <lslutils/debug.h>
+#include <lslutils/logging.h>
+#include <lslutils/misc.h>
+#include <lslutils/conversion.h>
+
+#include "c_api.h"
+#include "profiler.h"
+
+namespace LSL {
+
+namespace {
+
+enum Request {
+	REQ_MAP_IMAGES = 1,
+	REQ_MAP_INFO
+};
+
+enum Status {
+	STATUS_OK = 0,
+	STATUS_ERROR
+};
+
+//! consecutive dead workers after which the pool gives up
+const unsigned int MAX_FAILURES = 3;
+//! an uncompressed 2k x 2k heightmap is 8M, anything this big is garbage
+const boost::uint32_t MAX_MESSAGE_SIZE = 64 << 20;
+//! where the worker finds its end of the socket pair
+const int WORKER_FD = 3;
+
+//! messages are only exchanged on one machine, so everything is in host byte order
+class MessageWriter
+{
+public:
+	template < class T >
+	void Put( T value )
+	{
+		m_data.append( reinterpret_cast<const char*>( &value ), sizeof(value) );
+	}
+	void PutString( const std::string& str )
+	{
+		Put<boost::uint32_t>( str.size() );
+		m_data.append( str );
+	}
+	template < class T >
+	void PutVector( const std::vector<T>& vec )
+	{
+		Put<boost::uint32_t>( vec.size() );
+		if ( !vec.empty() )
+			m_data.append( reinterpret_cast<const char*>( &vec[0] ), vec.size() * sizeof(T) );
+	}
+	const std::string& Data() const { return m_data; }
+
+private:
+	std::string m_data;
+};
+
+class MessageReader
+{
+public:
+	explicit MessageReader( const std::string& data ) : m_data( data ), m_pos( 0 ) {}
+
+	template < class T >
+	T Get()
+	{
+		T value;
+		Read( &value, sizeof(value) );
+		return value;
+	}
+	std::string GetString()
+	{
+		const boost::uint32_t size = Get<boost::uint32_t>();
+		Check( size );
+		const std::string str = m_data.substr( m_pos, size );
+		m_pos += size;
+		return str;
+	}
+	template < class T >
+	void GetVector( std::vector<T>& vec )
+	{
+		const boost::uint32_t size = Get<boost::uint32_t>();
+		Check( size_t(size) * sizeof(T) );
+		vec.resize( size );
+		if ( size > 0 )
+			Read( &vec[0], size * sizeof(T) );
+	}
+
+private:
+	void Check( size_t size ) const
+	{
+		if ( size > m_data.size() - m_pos )
+			LSL_THROW( unitsync, "truncated unitsync worker message" );
+	}
+	void Read( void* dest, size_t size )
+	{
+		Check( size );
+		memcpy( dest, m_data.data() + m_pos, size );
+		m_pos += size;
+	}
+
+	const std::string& m_data;
+	size_t m_pos;
+};
+
+void PutMapImageData( MessageWriter& out, const MapImageData& data )
+{
+	out.Put<boost::int32_t>( data.minimap_size );
+	out.PutVector( data.minimap );
+	out.Put<boost::int32_t>( data.metal_width );
+	out.Put<boost::int32_t>( data.metal_height );
+	out.PutVector( data.metal );
+	out.Put<boost::int32_t>( data.height_width );
+	out.Put<boost::int32_t>( data.height_height );
+	out.PutVector( data.height );
+}
+
+void ParseMapImageData( MessageReader& in, MapImageData& data )
+{
+	data.minimap_size = in.Get<boost::int32_t>();
+	in.GetVector( data.minimap );
+	data.metal_width = in.Get<boost::int32_t>();
+	data.metal_height = in.Get<boost::int32_t>();
+	in.GetVector( data.metal );
+	data.height_width = in.Get<boost::int32_t>();
+	data.height_height = in.Get<boost::int32_t>();
+	in.GetVector( data.height );
+	// sizes come from another process, don't let a confused one make us read out of bounds
+	if ( data.minimap.size() != size_t(data.minimap_size) * data.minimap_size
+		|| data.metal.size() != size_t(data.metal_width) * data.metal_height
+		|| data.height.size() != size_t(data.height_width) * data.height_height )
+		LSL_THROW( unitsync, "inconsistent map image sizes from unitsync worker" );
+}
+
+void PutMapInfo( MessageWriter& out, const MapInfo& info )
+{
+	out.PutString( info.description );
+	out.Put<boost::int32_t>( info.tidalStrength );
+	out.Put<boost::int32_t>( info.gravity );
+	out.Put<float>( info.maxMetal );
+	out.Put<boost::int32_t>( info.extractorRadius );
+	out.Put<boost::int32_t>( info.minWind );
+	out.Put<boost::int32_t>( info.maxWind );
+	out.Put<boost::int32_t>( info.width );
+	out.Put<boost::int32_t>( info.height );
+	out.Put<boost::uint32_t>( info.positions.size() );
+	for ( size_t i = 0; i < info.positions.size(); ++i ) {
+		out.Put<boost::int32_t>( info.positions[i].x );
+		out.Put<boost::int32_t>( info.positions[i].y );
+	}
+	out.PutString( info.author );
+}
+
+void ParseMapInfo( MessageReader& in, MapInfo& info )
+{
+	info.description = in.GetString();
+	info.tidalStrength = in.Get<boost::int32_t>();
+	info.gravity = in.Get<boost::int32_t>();
+	info.maxMetal = in.Get<float>();
+	info.extractorRadius = in.Get<boost::int32_t>();
+	info.minWind = in.Get<boost::int32_t>();
+	info.maxWind = in.Get<boost::int32_t>();
+	info.width = in.Get<boost::int32_t>();
+	info.height = in.Get<boost::int32_t>();
+	const boost::uint32_t count = in.Get<boost::uint32_t>();
+	info.positions.clear();
+	for ( boost::uint32_t i = 0; i < count; ++i ) {
+		StartPos pos;
+		pos.x = in.Get<boost::int32_t>();
+		pos.y = in.Get<boost::int32_t>();
+		info.positions.push_back( pos );
+	}
+	info.author = in.GetString();
+}
+
+//! throws the worker's error message if the request failed there
+void CheckStatus( MessageReader& in )
+{
+	if ( in.Get<boost::uint8_t>() != STATUS_OK )
+		LSL_THROW( unitsync, in.GetString() );
+}
+
+/** \brief unitsync index of \param mapname in this worker
+ * Indexes are only valid after GetMapCount() filled unitsync's map list, and
+ * the host's may differ if the archives changed before this worker started.
+ */
+int WorkerMapIndex( const std::string& mapname )
+{
+	static std::map<std::string, int> indexes;
+	std::map<std::string, int>::const_iterator it = indexes.find( mapname );
+	if ( it == indexes.end() || susynclib().GetMapName( it->second ) != mapname ) {
+		indexes.clear();
+		const int count = susynclib().GetMapCount();
+		for ( int i = 0; i < count; ++i )
+			indexes[susynclib().GetMapName( i )] = i;
+		it = indexes.find( mapname );
+		if ( it == indexes.end() )
+			LSL_THROWF( unitsync, "unitsync worker doesn't know map %s", mapname.c_str() );
+	}
+	return it->second;
+}
+
+std::string HandleRequest( const std::string& request )
+{
+	MessageWriter out;
+	try {
+		MessageReader in( request );
+		const int type = in.Get<boost::uint8_t>();
+		switch ( type ) {
+			case REQ_MAP_IMAGES: {
+				const std::string mapname = in.GetString();
+				const int which = in.Get<boost::int32_t>();
+				MapImageData data;
+				susynclib().GetMapImageData( mapname, which, data );
+				out.Put<boost::uint8_t>( STATUS_OK );
+				PutMapImageData( out, data );
+				break;
+			}
+			case REQ_MAP_INFO: {
+				const std::string mapname = in.GetString();
+				const int version = in.Get<boost::int32_t>();
+				const MapInfo info = susynclib().GetMapInfoEx( WorkerMapIndex( mapname ), version );
+				out.Put<boost::uint8_t>( STATUS_OK );
+				PutMapInfo( out, info );
+				break;
+			}
+			default:
+				LSL_THROWF( unitsync, "unknown unitsync worker request %d", type );
+		}
+	} catch ( std::exception& e ) {
+		MessageWriter error;
+		error.Put<boost::uint8_t>( STATUS_ERROR );
+		error.PutString( e.what() );
+		return error.Data();
+	}
+	return out.Data();
+}
+
+#ifndef WIN32
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL; // a dead peer must not SIGPIPE us
+#else
+const int SEND_FLAGS = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+bool WriteAll( int fd, const char* data, size_t size )
+{
+	while ( size > 0 ) {
+		const ssize_t n = send( fd, data, size, SEND_FLAGS );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return false;
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool ReadAll( int fd, char* data, size_t size )
+{
+	while ( size > 0 ) {
+		const ssize_t n = recv( fd, data, size, 0 );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return false;
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool WriteMessage( int fd, const std::string& message )
+{
+	const boost::uint32_t size = message.size();
+	return WriteAll( fd, reinterpret_cast<const char*>( &size ), sizeof(size) )
+		&& WriteAll( fd, message.data(), message.size() );
+}
+
+bool ReadMessage( int fd, std::string& message )
+{
+	boost::uint32_t size;
+	if ( !ReadAll( fd, reinterpret_cast<char*>( &size ), sizeof(size) ) || size > MAX_MESSAGE_SIZE )
+		return false;
+	message.resize( size );
+	return size == 0 || ReadAll( fd, &message[0], size );
+}
+#endif // WIN32
+
+} // namespace
+
+UnitsyncProcessPool::UnitsyncProcessPool()
+	: m_generation( 0 ),
+	m_failures( 0 ),
+	m_crashes( 0 )
+{
+}
+
+UnitsyncProcessPool::~UnitsyncProcessPool()
+{
+	Stop();
+}
+
+bool UnitsyncProcessPool::Start( const std::string& worker_exe, const std::string& unitsync_path, size_t count )
+{
+#ifdef WIN32
+	LslWarning( "unitsync worker processes are not supported on this platform" );
+	return false;
+#else
+	if ( count == 0 || !Util::FileExists( worker_exe ) ) {
+		LslWarning( "can't start unitsync workers from %s", worker_exe.c_str() );
+		return false;
+	}
+	Stop();
+	boost::mutex::scoped_lock lock( m_lock );
+	m_worker_exe = worker_exe;
+	m_unitsync_path = unitsync_path;
+	m_processes.assign( count, Process() );
+	++m_generation;
+	m_failures = 0;
+	LslDebug( "using %d unitsync worker processes", int(count) );
+	return true;
+#endif
+}
+
+void UnitsyncProcessPool::Stop()
+{
+	std::vector<Process> stopped;
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		// Call() uses its process unlocked, wait until every one is back
+		size_t i = 0;
+		while ( i < m_processes.size() ) {
+			if ( m_processes[i].busy ) {
+				m_idle.wait( lock );
+				i = 0;
+			} else {
+				++i;
+			}
+		}
+		stopped.swap( m_processes );
+	}
+	// Terminate() may wait for each worker to exit, queries see an empty pool meanwhile
+	for ( size_t i = 0; i < stopped.size(); ++i )
+		Terminate( stopped[i] );
+}
+
+void UnitsyncProcessPool::Reset( const std::string& unitsync_path )
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	m_unitsync_path = unitsync_path;
+	++m_generation;
+	m_failures = 0;
+}
+
+bool UnitsyncProcessPool::IsRunning() const
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	return !m_processes.empty() && m_failures < MAX_FAILURES;
+}
+
+size_t UnitsyncProcessPool::GetProcessCount() const
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	return m_processes.size();
+}
+
+unsigned long UnitsyncProcessPool::Crashes() const
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	return m_crashes;
+}
+
+bool UnitsyncProcessPool::GetMapImageData( const std::string& mapname, int which, MapImageData& data )
+{
+	MessageWriter request;
+	request.Put<boost::uint8_t>( REQ_MAP_IMAGES );
+	request.PutString( mapname );
+	request.Put<boost::int32_t>( which );
+	// wait is the time spent waiting for an idle worker, execution the round trip
+	static UnitsyncCallStats& stats = UnitsyncProfiler::Register( "worker:GetMapImageData" );
+	std::string response;
+	if ( !Call( stats, request.Data(), response ) )
+		return false;
+	MessageReader in( response );
+	CheckStatus( in );
+	ParseMapImageData( in, data );
+	return true;
+}
+
+bool UnitsyncProcessPool::GetMapInfoEx( const std::string& mapname, int version, MapInfo& info )
+{
+	MessageWriter request;
+	request.Put<boost::uint8_t>( REQ_MAP_INFO );
+	request.PutString( mapname );
+	request.Put<boost::int32_t>( version );
+	static UnitsyncCallStats& stats = UnitsyncProfiler::Register( "worker:GetMapInfoEx" );
+	std::string response;
+	if ( !Call( stats, request.Data(), response ) )
+		return false;
+	MessageReader in( response );
+	CheckStatus( in );
+	ParseMapInfo( in, info );
+	return true;
+}
+
+bool UnitsyncProcessPool::Call( UnitsyncCallStats& stats, const std::string& request, std::string& response )
+{
+#ifdef WIN32
+	return false;
+#else
+	UnitsyncCallTimer timer( stats );
+	Process* proc = NULL;
+	bool respawn = false;
+	unsigned int generation;
+	std::string worker_exe, unitsync_path;
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		while ( proc == NULL ) {
+			if ( m_processes.empty() || m_failures >= MAX_FAILURES )
+				return false;
+			for ( size_t i = 0; i < m_processes.size() && proc == NULL; ++i ) {
+				if ( !m_processes[i].busy )
+					proc = &m_processes[i];
+			}
+			if ( proc == NULL )
+				m_idle.wait( lock );
+		}
+		// Stop() waits for busy processes, so proc stays valid after unlocking
+		proc->busy = true;
+		timer.Locked();
+		respawn = proc->pid == 0 || proc->generation != m_generation;
+		generation = m_generation;
+		worker_exe = m_worker_exe;
+		unitsync_path = m_unitsync_path;
+	}
+
+	bool answered = true;
+	if ( respawn ) {
+		Terminate( *proc );
+		answered = Spawn( *proc, worker_exe, unitsync_path );
+		proc->generation = generation;
+	}
+	answered = answered && WriteMessage( proc->fd, request ) && ReadMessage( proc->fd, response );
+	if ( !answered )
+		Terminate( *proc );
+
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		proc->busy = false;
+		if ( answered ) {
+			m_failures = 0;
+		} else {
+			++m_crashes;
+			if ( ++m_failures == MAX_FAILURES )
+				LslError( "unitsync workers keep dying, running queries in-process again" );
+		}
+	}
+	m_idle.notify_all();
+	if ( !answered )
+		LSL_THROW( unitsync, "unitsync worker died" );
+	return true;
+#endif
+}
+
+bool UnitsyncProcessPool::Spawn( Process& proc, const std::string& worker_exe, const std::string& unitsync_path )
+{
+#ifdef WIN32
+	return false;
+#else
+	int fds[2];
+	if ( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) != 0 ) {
+		LslError( "can't create unitsync worker socket: %s", strerror( errno ) );
+		return false;
+	}
+	// neither end may leak into other workers
+	fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+	fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+#ifdef SO_NOSIGPIPE
+	const int on = 1;
+	setsockopt( fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on) );
+#endif
+	// prepare everything before forking, the child may only use async-signal-safe calls until exec
+	const std::string fd_arg = Util::ToString( WORKER_FD );
+	const char* argv[] = { worker_exe.c_str(), unitsync_path.c_str(), fd_arg.c_str(), NULL };
+	const pid_t pid = fork();
+	if ( pid < 0 ) {
+		LslError( "can't fork unitsync worker: %s", strerror( errno ) );
+		close( fds[0] );
+		close( fds[1] );
+		return false;
+	}
+	if ( pid == 0 ) {
+		if ( fds[1] == WORKER_FD )
+			fcntl( WORKER_FD, F_SETFD, 0 );
+		else
+			dup2( fds[1], WORKER_FD ); // dup2 clears FD_CLOEXEC on the copy
+		execv( argv[0], const_cast<char* const*>( argv ) );
+		_exit( 127 );
+	}
+	close( fds[1] );
+	proc.pid = pid;
+	proc.fd = fds[0];
+	return true;
+#endif
+}
+
+void UnitsyncProcessPool::Terminate( Process& proc )
+{
+#ifndef WIN32
+	if ( proc.fd >= 0 ) {
+		// an idle worker exits by itself once its socket is closed
+		close( proc.fd );
+		proc.fd = -1;
+	}
+	if ( proc.pid > 0 ) {
+		const pid_t pid = proc.pid;
+		proc.pid = 0;
+		// give unitsync a moment to shut down cleanly before killing a stuck worker
+		for ( int i = 0; i < 200; ++i ) {
+			const pid_t ret = waitpid( pid, NULL, WNOHANG );
+			if ( ret == pid || ( ret < 0 && errno != EINTR ) )
+				return;
+			usleep( 10000 );
+		}
+		kill( pid, SIGKILL );
+		while ( waitpid( pid, NULL, 0 ) < 0 && errno == EINTR ) {}
+	}
+#endif
+}
+
+int RunUnitsyncWorker( int fd )
+{
+#ifdef WIN32
+	return 1;
+#else
+	std::string request;
+	while ( ReadMessage( fd, request ) ) {
+		if ( !WriteMessage( fd, HandleRequest( request ) ) )
+			return 1;
+	}
+	return 0;
+#endif
+}
+
+} // namespace LSL
@@ -0,0 +1,137 @@
+#ifndef LSL_HEADERGUARD_PROCESSPOOL_H
+#define LSL_HEADERGUARD_PROCESSPOOL_H
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "data.h"
+
+namespace LSL {
+
+class UnitsyncCallStats;
+
+//! which images UnitsyncLib::GetMapImageData fetches
+enum MapImageFlags {
+	MAP_IMAGE_MINIMAP = 1,
+	MAP_IMAGE_METALMAP = 2,
+	MAP_IMAGE_HEIGHTMAP = 4
+};
+
+//! unconverted map images as unitsync hands them out, empty vectors for images not fetched or failed
+struct MapImageData
+{
+	MapImageData()
+		: minimap_size(0), metal_width(0), metal_height(0), height_width(0), height_height(0) {}
+	std::vector<unsigned short> minimap; //!< RGB565, minimap_size squared
+	int minimap_size;
+	std::vector<unsigned char> metal;
+	int metal_width;
+	int metal_height;
+	std::vector<unsigned short> height;
+	int height_width;
+	int height_height;
+};
+
+/** \brief Runs unitsync queries in separate worker processes
+ *
+ * Each worker is an lsl-unitsync-worker process with its own copy of unitsync
+ * loaded, so queries on different workers run in parallel and a crash inside
+ * unitsync only takes down that worker. Workers are spawned on first use and
+ * respawned after they died or the pool was reset. Only available on POSIX
+ * systems, Start() fails elsewhere.
+ */
+class UnitsyncProcessPool : public boost::noncopyable
+{
+public:
+	UnitsyncProcessPool();
+	~UnitsyncProcessPool();
+
+	//! use up to \param count processes running \param worker_exe on \param unitsync_path
+	bool Start( const std::string& worker_exe, const std::string& unitsync_path, size_t count );
+	//! terminates all workers, waits for running queries to finish first
+	void Stop();
+	//! workers are respawned on next use, so they see archives added since they started
+	void Reset( const std::string& unitsync_path );
+	bool IsRunning() const;
+	size_t GetProcessCount() const;
+	//! number of workers that died while answering a query
+	unsigned long Crashes() const;
+
+	/**
+	 * \name queries
+	 * Return false if the pool is not running, the caller should then ask the
+	 * in-process library. Throw Exceptions::unitsync if the query failed or
+	 * its worker died, retrying in-process would risk the same crash there.
+	 */
+	///@{
+	bool GetMapImageData( const std::string& mapname, int which, MapImageData& data );
+	//! by name, the workers' unitsync indexes need not match ours
+	bool GetMapInfoEx( const std::string& mapname, int version, MapInfo& info );
+	///@}
+
+private:
+	struct Process
+	{
+		Process() : pid(0), fd(-1), busy(false), generation(0) {}
+		int pid;
+		int fd; //!< our end of the socket pair
+		bool busy;
+		unsigned int generation;
+	};
+
+	//! runs one request on an idle worker, false if the pool is not running
+	bool Call( UnitsyncCallStats& stats, const std::string& request, std::string& response );
+	bool Spawn( Process& proc, const std::string& worker_exe, const std::string& unitsync_path );
+	void Terminate( Process& proc );
+
+	std::vector<Process> m_processes;
+	std::string m_worker_exe;
+	std::string m_unitsync_path;
+	unsigned int m_generation;
+	//! consecutive workers that died without answering, the pool stops itself after a few
+	unsigned int m_failures;
+	unsigned long m_crashes;
+	mutable boost::mutex m_lock;
+	boost::condition_variable m_idle;
+};
+
+/** \brief request loop of a worker process
+ *
+ * Answers requests arriving on \param fd with the in-process susynclib(),
+ * which has to be loaded already. Returns once the pool closed its end.
+ */
+int RunUnitsyncWorker( int fd );
+
+} // namespace LSL
+
+/**
+ * \file processpool.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_PROCESSPOOL_H
@@ -0,0 +1,241 @@
+#include "profiler.h"
+
+#include <map>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
+
+#include <lslutils/logging.h>
+#include <lslutils/misc.h>
+
+namespace LSL {
+
+namespace {
+
+typedef std::map<std::string, UnitsyncCallStats*>
+	StatsMap;
+
+// both are leaked on purpose, function local statics in c_api.cpp hold references until exit
+StatsMap& Registry()
+{
+	static StatsMap* registry = new StatsMap;
+	return *registry;
+}
+
+boost::mutex& RegistryLock()
+{
+	static boost::mutex* lock = new boost::mutex;
+	return *lock;
+}
+
+boost::uint64_t TotalNs( const UnitsyncCallProfile& profile )
+{
+	return profile.wait.total_ns + profile.exec.total_ns;
+}
+
+bool MoreExpensive( const UnitsyncCallProfile& a, const UnitsyncCallProfile& b )
+{
+	return TotalNs( a ) > TotalNs( b );
+}
+
+void AppendJson( std::string& out, const char* key, const UnitsyncCallProfile::Timing& timing )
+{
+	char buf[128];
+	snprintf( buf, sizeof(buf), "\"%s\":{\"total_us\":%llu,\"max_us\":%llu,\"histogram\":[", key,
+		(unsigned long long)( timing.total_ns / 1000 ), (unsigned long long)( timing.max_ns / 1000 ) );
+	out += buf;
+	bool first = true;
+	for ( size_t i = 0; i < timing.histogram.size(); ++i ) {
+		if ( timing.histogram[i] == 0 )
+			continue;
+		snprintf( buf, sizeof(buf), "%s[%llu,%llu]", first ? "" : ",",
+			(unsigned long long)UnitsyncCallStats::BucketLowerBound( i ), (unsigned long long)timing.histogram[i] );
+		out += buf;
+		first = false;
+	}
+	out += "]}";
+}
+
+void CopyTiming( const std::atomic<boost::uint64_t>& total, const std::atomic<boost::uint64_t>& max,
+		const std::atomic<boost::uint64_t>* histogram, UnitsyncCallProfile::Timing& out )
+{
+	out.total_ns = total.load( std::memory_order_relaxed );
+	out.max_ns = max.load( std::memory_order_relaxed );
+	out.histogram.resize( UnitsyncCallStats::BUCKET_COUNT );
+	for ( size_t i = 0; i < UnitsyncCallStats::BUCKET_COUNT; ++i )
+		out.histogram[i] = histogram[i].load( std::memory_order_relaxed );
+}
+
+} // namespace
+
+UnitsyncCallStats::UnitsyncCallStats( const std::string& name )
+	: m_name( name )
+{
+	Reset();
+}
+
+void UnitsyncCallStats::Record( boost::uint64_t wait_ns, boost::uint64_t exec_ns )
+{
+	m_calls.fetch_add( 1, std::memory_order_relaxed );
+	Add( m_wait, wait_ns );
+	Add( m_exec, exec_ns );
+}
+
+void UnitsyncCallStats::Reset()
+{
+	m_calls.store( 0, std::memory_order_relaxed );
+	Clear( m_wait );
+	Clear( m_exec );
+}
+
+size_t UnitsyncCallStats::BucketIndex( boost::uint64_t us )
+{
+	if ( us < 4 )
+		return size_t( us );
+	int octave = 2;
+	while ( ( us >> ( octave + 1 ) ) != 0 )
+		++octave;
+	const size_t sub = size_t( us >> ( octave - 2 ) ) & 3;
+	return std::min<size_t>( 4 + ( octave - 2 ) * 4 + sub, BUCKET_COUNT - 1 );
+}
+
+boost::uint64_t UnitsyncCallStats::BucketLowerBound( size_t bucket )
+{
+	if ( bucket < 4 )
+		return bucket;
+	const int octave = int( bucket - 4 ) / 4 + 2;
+	const boost::uint64_t sub = ( bucket - 4 ) % 4;
+	return ( 4 + sub ) << ( octave - 2 );
+}
+
+void UnitsyncCallStats::Add( Timing& timing, boost::uint64_t ns )
+{
+	timing.total_ns.fetch_add( ns, std::memory_order_relaxed );
+	boost::uint64_t max = timing.max_ns.load( std::memory_order_relaxed );
+	while ( ns > max && !timing.max_ns.compare_exchange_weak( max, ns, std::memory_order_relaxed ) ) {}
+	timing.histogram[BucketIndex( ns / 1000 )].fetch_add( 1, std::memory_order_relaxed );
+}
+
+void UnitsyncCallStats::Clear( Timing& timing )
+{
+	timing.total_ns.store( 0, std::memory_order_relaxed );
+	timing.max_ns.store( 0, std::memory_order_relaxed );
+	for ( size_t i = 0; i < BUCKET_COUNT; ++i )
+		timing.histogram[i].store( 0, std::memory_order_relaxed );
+}
+
+UnitsyncCallStats& UnitsyncProfiler::Register( const std::string& name )
+{
+	boost::mutex::scoped_lock lock( RegistryLock() );
+	UnitsyncCallStats*& stats = Registry()[name];
+	if ( stats == NULL )
+		stats = new UnitsyncCallStats( name );
+	return *stats;
+}
+
+std::string UnitsyncProfiler::SectionName( const std::string& signature )
+{
+	// "ret LSL::UnitsyncLib::Name(args)" -> "Name(args)"
+	const size_t paren = signature.find( '(' );
+	if ( paren == std::string::npos )
+		return signature;
+	size_t begin = paren;
+	while ( begin > 0 && ( isalnum( (unsigned char)signature[begin - 1] ) || signature[begin - 1] == '_' ) )
+		--begin;
+	return signature.substr( begin );
+}
+
+std::vector<UnitsyncCallProfile> UnitsyncProfiler::Snapshot()
+{
+	std::vector<UnitsyncCallProfile> ret;
+	{
+		boost::mutex::scoped_lock lock( RegistryLock() );
+		for ( StatsMap::const_iterator it = Registry().begin(); it != Registry().end(); ++it ) {
+			const UnitsyncCallStats& stats = *it->second;
+			UnitsyncCallProfile profile;
+			profile.name = stats.m_name;
+			profile.calls = stats.m_calls.load( std::memory_order_relaxed );
+			if ( profile.calls == 0 )
+				continue;
+			CopyTiming( stats.m_wait.total_ns, stats.m_wait.max_ns, stats.m_wait.histogram, profile.wait );
+			CopyTiming( stats.m_exec.total_ns, stats.m_exec.max_ns, stats.m_exec.histogram, profile.exec );
+			ret.push_back( profile );
+		}
+	}
+	std::stable_sort( ret.begin(), ret.end(), MoreExpensive );
+	return ret;
+}
+
+void UnitsyncProfiler::Reset()
+{
+	boost::mutex::scoped_lock lock( RegistryLock() );
+	for ( StatsMap::iterator it = Registry().begin(); it != Registry().end(); ++it )
+		it->second->Reset();
+}
+
+std::string UnitsyncProfiler::ToJson()
+{
+	const std::vector<UnitsyncCallProfile> profiles = Snapshot();
+	std::string out = "{\"functions\":[";
+	for ( size_t i = 0; i < profiles.size(); ++i ) {
+		const UnitsyncCallProfile& profile = profiles[i];
+		char buf[64];
+		snprintf( buf, sizeof(buf), "\",\"calls\":%llu,", (unsigned long long)profile.calls );
+		out += i == 0 ? "{\"name\":\"" : ",{\"name\":\"";
+		// names are C++ identifiers, maybe with a prefix, nothing needs escaping
+		out += profile.name;
+		out += buf;
+		AppendJson( out, "wait", profile.wait );
+		out += ",";
+		AppendJson( out, "exec", profile.exec );
+		out += "}";
+	}
+	out += "]}\n";
+	return out;
+}
+
+bool UnitsyncProfiler::DumpJson( const std::string& path )
+{
+	FILE* f = Util::lslopen( path, "wb" );
+	if ( f == NULL ) {
+		LslWarning( "couldn't write unitsync profile to %s", path.c_str() );
+		return false;
+	}
+	const std::string json = ToJson();
+	const bool ok = fwrite( json.data(), 1, json.size(), f ) == json.size();
+	fclose( f );
+	return ok;
+}
+
+void UnitsyncCallTimer::Locked()
+{
+	m_locked = Clock::now();
+	m_wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( m_locked - m_start ).count();
+	m_held = true;
+	m_was_locked = true;
+}
+
+void UnitsyncCallTimer::Unlocked()
+{
+	if ( !m_held )
+		return;
+	m_exec_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - m_locked ).count();
+	m_held = false;
+}
+
+UnitsyncCallTimer::~UnitsyncCallTimer()
+{
+	Unlocked();
+	if ( !m_was_locked )
+		return;
+	m_stats.Record( m_wait_ns, m_exec_ns );
+#ifndef NDEBUG
+	const boost::uint64_t total_ms = ( m_wait_ns + m_exec_ns ) / 1000000;
+	if ( total_ms > 10 )
+		LslDebug( "Slow Unitsync call (%s) took: %dms, %dms of it waiting for the lock",
+			m_stats.GetName().c_str(), int(total_ms), int(m_wait_ns / 1000000) );
+#endif
+}
+
+} // namespace LSL
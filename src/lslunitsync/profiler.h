@@ -0,0 +1,165 @@
+#ifndef LSL_HEADERGUARD_PROFILER_H
+#define LSL_HEADERGUARD_PROFILER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace LSL {
+
+/** \brief Timings of one locked unitsync section
+ *
+ * Lock wait and execution time are kept apart, each as totals, maximum and a
+ * log-linear histogram of microseconds: four buckets per power of two, so a
+ * bucket is at most 25% wide. Updates are lock-free, reads may tear between
+ * counters, which is fine for statistics.
+ */
+class UnitsyncCallStats : public boost::noncopyable
+{
+public:
+	enum { BUCKET_COUNT = 132 }; // up to 2^34 us, about 4.7 hours
+
+	explicit UnitsyncCallStats( const std::string& name );
+	void Record( boost::uint64_t wait_ns, boost::uint64_t exec_ns );
+	void Reset();
+
+	const std::string& GetName() const { return m_name; }
+
+	//! histogram bucket of a duration of \param us microseconds
+	static size_t BucketIndex( boost::uint64_t us );
+	//! smallest duration in microseconds that lands in \param bucket
+	static boost::uint64_t BucketLowerBound( size_t bucket );
+
+private:
+	friend class UnitsyncProfiler;
+
+	struct Timing
+	{
+		std::atomic<boost::uint64_t> total_ns;
+		std::atomic<boost::uint64_t> max_ns;
+		std::atomic<boost::uint64_t> histogram[BUCKET_COUNT];
+	};
+	static void Add( Timing& timing, boost::uint64_t ns );
+	static void Clear( Timing& timing );
+
+	const std::string m_name;
+	std::atomic<boost::uint64_t> m_calls;
+	Timing m_wait;
+	Timing m_exec;
+};
+
+//! copy of UnitsyncCallStats taken by UnitsyncProfiler::Snapshot()
+struct UnitsyncCallProfile
+{
+	struct Timing
+	{
+		Timing() : total_ns(0), max_ns(0) {}
+		boost::uint64_t total_ns;
+		boost::uint64_t max_ns;
+		//! UnitsyncCallStats::BUCKET_COUNT counts, see UnitsyncCallStats::BucketLowerBound
+		std::vector<boost::uint64_t> histogram;
+	};
+
+	UnitsyncCallProfile() : calls(0) {}
+	std::string name;
+	boost::uint64_t calls;
+	Timing wait; //!< waiting for the unitsync lock
+	Timing exec; //!< holding it
+};
+
+/** \brief Registry of UnitsyncCallStats, always on in all builds
+ *
+ * Every public UnitsyncLib function registers its signature once and then
+ * records each call, a section is cheap enough to time unconditionally.
+ */
+class UnitsyncProfiler
+{
+public:
+	//! stats for \param name, created on first use and never freed
+	static UnitsyncCallStats& Register( const std::string& name );
+	//! "Name(parameters)" of a BOOST_CURRENT_FUNCTION \param signature, overloads stay apart
+	static std::string SectionName( const std::string& signature );
+	//! all registered sections, most expensive (wait plus execution) first
+	static std::vector<UnitsyncCallProfile> Snapshot();
+	static void Reset();
+	//! Snapshot() as JSON, histograms list only non-empty buckets as [lower bound in us, count]
+	static std::string ToJson();
+	static bool DumpJson( const std::string& path );
+};
+
+/** \brief Times one call into UnitsyncCallStats
+ *
+ * Construct before taking the lock and call Locked() once it is held, the
+ * destructor records the rest as execution time. A call that releases the lock
+ * in between uses one Section per locked part instead, time spent unlocked is
+ * then neither wait nor execution. Nothing is recorded if the lock was never taken.
+ */
+class UnitsyncCallTimer : public boost::noncopyable
+{
+public:
+	typedef std::chrono::steady_clock
+		Clock;
+
+	explicit UnitsyncCallTimer( UnitsyncCallStats& stats )
+		: m_stats( stats ), m_start( Clock::now() ), m_locked( m_start ),
+		m_wait_ns( 0 ), m_exec_ns( 0 ), m_held( false ), m_was_locked( false ) {}
+	~UnitsyncCallTimer();
+
+	void Locked();
+
+	//! one more locked part of the call, construct before taking the lock
+	class Section : public boost::noncopyable
+	{
+	public:
+		explicit Section( UnitsyncCallTimer& timer ) : m_timer( timer ) { m_timer.m_start = Clock::now(); }
+		~Section() { m_timer.Unlocked(); }
+		void Locked() { m_timer.Locked(); }
+	private:
+		UnitsyncCallTimer& m_timer;
+	};
+
+private:
+	void Unlocked();
+
+	UnitsyncCallStats& m_stats;
+	Clock::time_point m_start;
+	Clock::time_point m_locked;
+	boost::uint64_t m_wait_ns;
+	boost::uint64_t m_exec_ns;
+	bool m_held;
+	bool m_was_locked;
+};
+
+} // namespace LSL
+
+/**
+ * \file profiler.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_PROFILER_H
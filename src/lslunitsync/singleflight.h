@@ -0,0 +1,130 @@
+#ifndef LSL_HEADERGUARD_SINGLEFLIGHT_H
+#define LSL_HEADERGUARD_SINGLEFLIGHT_H
+
+#include <map>
+#include <exception>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace LSL {
+
+/** \brief Coalesces concurrent loads of the same key
+ *
+ * The first caller of Do() for a key runs the load, callers arriving while it
+ * is in flight wait and receive the same result (or exception). Nothing is
+ * cached beyond the flight itself, that is left to the caller's cache.
+ */
+template < class TKey, class TValue >
+class SingleFlight : public boost::noncopyable
+{
+public:
+	SingleFlight() : m_coalesced( 0 ) {}
+
+	template < class F >
+	TValue Do( const TKey& key, F load )
+	{
+		CallPtr call;
+		bool leader = false;
+		{
+			boost::mutex::scoped_lock lock( m_lock );
+			typename CallMap::iterator it = m_calls.find( key );
+			if ( it == m_calls.end() ) {
+				call = boost::make_shared<Call>();
+				m_calls[key] = call;
+				leader = true;
+			} else {
+				call = it->second;
+				++m_coalesced;
+			}
+		}
+		if ( !leader ) {
+			boost::mutex::scoped_lock lock( call->lock );
+			while ( !call->done )
+				call->cond.wait( lock );
+			if ( call->error )
+				std::rethrow_exception( call->error );
+			return call->value;
+		}
+		TValue value;
+		std::exception_ptr error;
+		try {
+			value = load();
+		} catch ( ... ) {
+			error = std::current_exception();
+		}
+		{
+			boost::mutex::scoped_lock lock( m_lock );
+			m_calls.erase( key );
+		}
+		{
+			boost::mutex::scoped_lock lock( call->lock );
+			call->value = value;
+			call->error = error;
+			call->done = true;
+		}
+		call->cond.notify_all();
+		if ( error )
+			std::rethrow_exception( error );
+		return value;
+	}
+
+	//! number of callers that attached to a load already in flight
+	unsigned long Coalesced() const
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		return m_coalesced;
+	}
+
+private:
+	struct Call
+	{
+		Call() : done( false ) {}
+		boost::mutex lock;
+		boost::condition_variable cond;
+		bool done;
+		TValue value;
+		std::exception_ptr error;
+	};
+	typedef boost::shared_ptr<Call>
+		CallPtr;
+	typedef std::map<TKey, CallPtr>
+		CallMap;
+
+	CallMap m_calls;
+	unsigned long m_coalesced;
+	mutable boost::mutex m_lock;
+};
+
+} // namespace LSL
+
+/**
+ * \file singleflight.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_SINGLEFLIGHT_H
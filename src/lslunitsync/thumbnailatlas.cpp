@@ -0,0 +1,171 @@
+#include "thumbnailatlas.h"
+
+#include <cstdio>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+#include <lslutils/misc.h>
+#include <lslutils/conversion.h>
+
+namespace LSL {
+
+namespace {
+const std::string ATLAS_INDEX_HEADER = "lsl thumbnail atlas 1";
+}
+
+ThumbnailAtlas::ThumbnailAtlas()
+	: m_cell_size( 0 ),
+	m_columns( 0 ),
+	m_rows( 0 ),
+	m_cells( 0 )
+{
+}
+
+ThumbnailAtlas::ThumbnailAtlas( int cell_size )
+	: m_cell_size( std::max( cell_size, 0 ) ),
+	m_columns( 0 ),
+	m_rows( 0 ),
+	m_cells( 0 )
+{
+}
+
+void ThumbnailAtlas::CellPosition( size_t cell, int& x, int& y ) const
+{
+	x = int( cell % m_columns ) * m_cell_size;
+	y = int( cell / m_columns ) * m_cell_size;
+}
+
+size_t ThumbnailAtlas::CellIndex( const Entry& entry ) const
+{
+	return size_t( entry.y / m_cell_size ) * m_columns + entry.x / m_cell_size;
+}
+
+void ThumbnailAtlas::Reserve( size_t count )
+{
+	if ( m_cell_size <= 0 || count <= size_t( m_columns ) * m_rows )
+		return;
+	// near square, but never wider than a raw image may be
+	const int max_columns = std::max( UnitsyncImage::RAW_MAX_SIDE / m_cell_size, 1 );
+	const int columns = std::min( std::max( int( std::ceil( std::sqrt( double( count ) ) ) ), 1 ), max_columns );
+	const int rows = int( ( count + columns - 1 ) / columns );
+	UnitsyncImage image( columns * m_cell_size, rows * m_cell_size );
+	for ( EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it ) {
+		Entry& e = it->second;
+		const size_t cell = CellIndex( e );
+		const int x = int( cell % columns ) * m_cell_size;
+		const int y = int( cell / columns ) * m_cell_size;
+		image.Paste( m_image, x, y, e.x, e.y, e.width, e.height );
+		e.x = x;
+		e.y = y;
+	}
+	m_image = std::move( image );
+	m_columns = columns;
+	m_rows = rows;
+}
+
+void ThumbnailAtlas::Add( const std::string& name, const UnitsyncImage& thumbnail )
+{
+	if ( m_cell_size <= 0 )
+		return;
+	EntryMap::const_iterator it = m_entries.find( name );
+	const bool replace = it != m_entries.end();
+	if ( !replace && m_cells >= size_t( m_columns ) * m_rows )
+		Reserve( std::max<size_t>( m_cells * 2, 1 ) );
+	const size_t cell = replace ? CellIndex( it->second ) : m_cells++;
+	Entry entry;
+	CellPosition( cell, entry.x, entry.y );
+	if ( replace )
+		m_image.Paste( UnitsyncImage( m_cell_size, m_cell_size ), entry.x, entry.y );
+	if ( thumbnail.isValid() ) {
+		UnitsyncImage thumb( thumbnail );
+		thumb.RescaleIfBigger( m_cell_size, m_cell_size );
+		entry.width = thumb.GetWidth();
+		entry.height = thumb.GetHeight();
+		m_image.Paste( thumb, entry.x, entry.y );
+	}
+	m_entries[name] = entry;
+}
+
+bool ThumbnailAtlas::Get( const std::string& name, Entry& entry ) const
+{
+	EntryMap::const_iterator it = m_entries.find( name );
+	if ( it == m_entries.end() )
+		return false;
+	entry = it->second;
+	return true;
+}
+
+bool ThumbnailAtlas::Save( const std::string& path ) const
+{
+	if ( m_cell_size <= 0 || !m_image.isValid() )
+		return false;
+	// image first, Load() rejects an index pointing outside of an older image
+	if ( !m_image.SaveRaw( path ) )
+		return false;
+	FILE* f = Util::lslopen( path + ".index", "w" );
+	if ( f == NULL )
+		return false;
+	fprintf( f, "%s\t%d\t%d\n", ATLAS_INDEX_HEADER.c_str(), m_cell_size, m_columns );
+	for ( EntryMap::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it ) {
+		const Entry& e = it->second;
+		fprintf( f, "%s\t%d\t%d\t%d\t%d\n", it->first.c_str(), e.x, e.y, e.width, e.height );
+	}
+	const bool ok = ferror( f ) == 0;
+	fclose( f );
+	return ok;
+}
+
+bool ThumbnailAtlas::Load( const std::string& path )
+{
+	*this = ThumbnailAtlas( m_cell_size );
+	FILE* f = Util::lslopen( path + ".index", "r" );
+	if ( f == NULL )
+		return false;
+	StringVector lines;
+	char buf[1024];
+	while ( fgets( buf, sizeof(buf), f ) != NULL ) {
+		std::string line( buf );
+		if ( !line.empty() && line[line.size() - 1] == '\n' )
+			line.resize( line.size() - 1 );
+		lines.push_back( line );
+	}
+	fclose( f );
+	if ( lines.empty() || m_cell_size <= 0 )
+		return false;
+	// the header has the cell size and column count the image was laid out with
+	const StringVector header = Util::StringTokenize( lines[0], "\t" );
+	if ( header.size() != 3 || header[0] != ATLAS_INDEX_HEADER || Util::FromString<int>( header[1] ) != m_cell_size )
+		return false;
+	const int columns = Util::FromString<int>( header[2] );
+	UnitsyncImage image;
+	if ( columns <= 0 || !image.LoadRaw( path ) || image.GetWidth() != columns * m_cell_size || image.GetHeight() % m_cell_size != 0 )
+		return false;
+
+	EntryMap entries;
+	size_t cells = 0;
+	for ( size_t l = 1; l < lines.size(); ++l ) {
+		const StringVector tokens = Util::StringTokenize( lines[l], "\t" );
+		if ( tokens.size() != 5 )
+			return false;
+		Entry e;
+		e.x = Util::FromString<int>( tokens[1] );
+		e.y = Util::FromString<int>( tokens[2] );
+		e.width = Util::FromString<int>( tokens[3] );
+		e.height = Util::FromString<int>( tokens[4] );
+		if ( e.x < 0 || e.y < 0 || e.x % m_cell_size != 0 || e.y % m_cell_size != 0
+				|| e.x >= image.GetWidth() || e.y >= image.GetHeight()
+				|| e.width < 0 || e.width > m_cell_size || e.height < 0 || e.height > m_cell_size )
+			return false;
+		entries[tokens[0]] = e;
+		cells = std::max( cells, size_t( e.y / m_cell_size ) * columns + e.x / m_cell_size + 1 );
+	}
+	m_image = std::move( image );
+	m_columns = columns;
+	m_rows = m_image.GetHeight() / m_cell_size;
+	m_entries.swap( entries );
+	m_cells = cells;
+	return true;
+}
+
+} // namespace LSL
@@ -0,0 +1,97 @@
+#ifndef LSL_HEADERGUARD_THUMBNAILATLAS_H
+#define LSL_HEADERGUARD_THUMBNAILATLAS_H
+
+#include "image.h"
+
+#include <map>
+#include <string>
+
+namespace LSL {
+
+/** \brief Many small images packed into one, plus where each one sits
+ *
+ * Thumbnails go into square cells laid out on a near-square grid, so neither
+ * side of the image outgrows UnitsyncImage::RAW_MAX_SIDE long before the other.
+ * Reserve() sizes the image for a known count at once; adding past that
+ * doubles the capacity and moves the cells to the new grid. A thumbnail smaller
+ * than its cell keeps its size and sits in the cell's top left corner. Copies
+ * share the image, see UnitsyncImage.
+ */
+class ThumbnailAtlas
+{
+public:
+	struct Entry
+	{
+		Entry() : x(0), y(0), width(0), height(0) {}
+		int x;
+		int y;
+		int width; //!< 0 if there was no image to pack
+		int height;
+	};
+	typedef std::map<std::string, Entry>
+		EntryMap;
+
+	//! an empty atlas without cells, GetCellSize() is 0
+	ThumbnailAtlas();
+	explicit ThumbnailAtlas( int cell_size );
+
+	//! makes room for \param count thumbnails in total, moving the ones already added if the grid changes
+	void Reserve( size_t count );
+	//! adds or replaces \param name, a \param thumbnail bigger than a cell is shrunk to fit
+	void Add( const std::string& name, const UnitsyncImage& thumbnail );
+	bool Contains( const std::string& name ) const { return m_entries.find( name ) != m_entries.end(); }
+	bool Get( const std::string& name, Entry& entry ) const;
+
+	const UnitsyncImage& GetImage() const { return m_image; }
+	const EntryMap& GetEntries() const { return m_entries; }
+	int GetCellSize() const { return m_cell_size; }
+	size_t GetCount() const { return m_entries.size(); }
+
+	//! the image as UnitsyncImage::SaveRaw at \param path, the coordinate table at path + ".index"
+	bool Save( const std::string& path ) const;
+	//! false, leaving the atlas empty, if the files are missing, damaged or for another cell size
+	bool Load( const std::string& path );
+
+private:
+	//! top left corner of cell \param cell
+	void CellPosition( size_t cell, int& x, int& y ) const;
+	size_t CellIndex( const Entry& entry ) const;
+
+	int m_cell_size;
+	int m_columns;
+	int m_rows;
+	size_t m_cells; //!< cells in use, entries are never removed
+	UnitsyncImage m_image;
+	EntryMap m_entries;
+};
+
+} // namespace LSL
+
+/**
+ * \file thumbnailatlas.h
+ * \section LICENSE
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#endif // LSL_HEADERGUARD_THUMBNAILATLAS_H
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <stdexcept>
 #include <clocale>
 #include <set>
@@ -11,6 +12,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
 #include <iterator>
 
 #include "c_api.h"
@@ -42,9 +44,14 @@
 namespace LSL {
 
 Unitsync::Unitsync():
+	m_archives_generation( 0 ),
 	m_cache_thread( new WorkerThread ),
-	m_map_image_cache( 30, "m_map_image_cache" ),         // may take about 300k per image ( 512x512 24 bpp minimap )
-	m_tiny_minimap_cache( 200, "m_tiny_minimap_cache" ), // takes at most 30k per image (   100x100 24 bpp minimap )
+	// unitsync calls are serialized, the threads scale decoding and rescaling
+	m_worker_pool( new WorkerPool( LSL::Util::config().GetWorkerThreadCount() ) ),
+	m_next_prefetch_token( 0 ),
+	m_atlas_job_queued( false ),
+	m_map_image_cache( 48 << 20, "m_map_image_cache" ),         // bytes, 512x512 RGB8 minimap takes 768k
+	m_map_pyramid_cache( 32 << 20, "m_map_pyramid_cache" ), // bytes, a pyramid takes 4/3 of its 512x512 base, 1M
 	m_mapinfo_cache( 1000000, "m_mapinfo_cache" ),       // this one is just misused as thread safe std::map ...
 	m_sides_cache( 200, "m_sides_cache" )               // another misuse
 {
@@ -61,6 +68,8 @@ enum ASYNC_EVENTS {
 Unitsync::~Unitsync()
 {
 	ClearCache();
+	delete m_worker_pool;
+	m_worker_pool = NULL;
 	delete m_cache_thread;
 	m_cache_thread = NULL;
 }
@@ -89,6 +98,8 @@ bool Unitsync::LoadUnitSyncLib( const std::string& unitsyncloc )
 	if (ret)
 	{
 		m_cache_path = LSL::Util::config().GetCachePath();
+		if ( !m_cache_path.empty() )
+			m_binary_cache.Open( m_cache_path + "unitsync.cache" );
 		PopulateArchiveList();
 	}
 	return ret;
@@ -96,86 +107,385 @@ bool Unitsync::LoadUnitSyncLib( const std::string& unitsyncloc )
 
 void Unitsync::ClearCache()
 {
-	m_maps_list.clear();
-	m_mods_list.clear();
+	CancelAllPrefetches();
+	// keep what was learned since the last save (lazily fetched deps and hashes)
+	bool has_index;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		has_index = !m_archive_index.empty();
+	}
+	if ( has_index )
+		SaveArchiveIndex();
+	m_binary_cache.Close();
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		++m_archives_generation;
+		m_pending_checksums.clear();
+		m_maps_list.clear();
+		m_mods_list.clear();
+		m_maps_unchained_hash.clear();
+		m_mods_unchained_hash.clear();
+		m_maps_archive_name.clear();
+		m_mods_archive_name.clear();
+		m_archive_index.clear();
+		m_map_catalog.Clear();
+		m_mod_catalog.Clear();
+	}
 	m_mod_array.clear();
 	m_map_array.clear();
-	m_unsorted_mod_array.clear();
-	m_unsorted_map_array.clear();
 	m_map_image_cache.Clear();
+	m_map_pyramid_cache.Clear();
+	{
+		// the next request loads it again, maybe from another cache dir
+		boost::mutex::scoped_lock lock(m_atlas_lock);
+		m_thumbnail_atlas = ThumbnailAtlas();
+	}
 	m_mapinfo_cache.Clear();
-	m_maps_unchained_hash.clear();
-	m_mods_unchained_hash.clear();
-	m_shortname_to_name_map.clear();
 	m_sides_cache.Clear();
 	m_map_gameoptions.clear();
 	m_game_gameoptions.clear();
 }
 
+class ArchiveChecksumWorkItem : public WorkItem
+{
+public:
+	ArchiveChecksumWorkItem( Unitsync* usync, unsigned int generation )
+		: m_usync(usync), m_generation(generation) {}
+
+	void Run()
+	{
+		m_usync->ComputePendingChecksums( m_generation );
+	}
+
+private:
+	Unitsync* m_usync;
+	unsigned int m_generation;
+};
+
 void Unitsync::PopulateArchiveList()
 {
+	// only names are fetched here, everything else comes from the archive index
+	// for unchanged archives; missing checksums are filled in by the cache thread
+	ArchiveIndex previous;
+	LoadArchiveIndex( previous );
+	ArchiveIndex index;
+	std::vector<PendingChecksum> pending;
+	LocalArchivesVector maps_list, mods_list, maps_unchained_hash, mods_unchained_hash, maps_archive_name, mods_archive_name;
+	ArchiveCatalog map_catalog, mod_catalog;
+	// base archives are shared by most maps and games, stat them once
+	std::map<std::string, std::string> stamps;
 
 	int numMaps = susynclib().GetMapCount();
 	for ( int i = 0; i < numMaps; i++ )
 	{
-		std::string name, hash, archivename, unchainedhash;
+		ArchiveIndexEntry entry;
+		entry.kind = "map";
+		StringVector chain;
 		try
 		{
-			name = susynclib().GetMapName( i );
-			hash = susynclib().GetMapChecksum( i );
+			entry.name = susynclib().GetMapName( i );
 			int count = susynclib().GetMapArchiveCount( i );
 			if ( count > 0 )
 			{
-				archivename =  susynclib().GetMapArchiveName( 0 );
-				unchainedhash = susynclib().GetArchiveChecksum( archivename );
+				entry.archivename =  susynclib().GetMapArchiveName( 0 );
 			}
+			for ( int j = 1; j < count; ++j )
+				chain.push_back( susynclib().GetMapArchiveName( j ) );
 			//PrefetchMap( name ); // DEBUG
 		} catch (...) { continue; }
-		try
-		{
-			m_maps_list[name] = hash;
-			if ( !unchainedhash.empty() ) m_maps_unchained_hash[name] = unchainedhash;
-			if ( !archivename.empty() ) m_maps_archive_name[name] = archivename;
-			assert(!name.empty());
-			m_map_array.push_back( name );
-		} catch (...)
-		{
-			LslError( "Found map with hash collision: %s hash: %s", name.c_str(), hash.c_str() );
+		const std::string& name = entry.name;
+		assert(!name.empty());
+		RestoreIndexEntry( entry, chain, previous, stamps );
+		if ( !map_catalog.Add( i, name, entry.hash ) ) {
+			LslError( "Found map with hash collision: %s", name.c_str() );
+			continue;
+		}
+		maps_list[name] = entry.hash;
+		if ( entry.hash.empty() ) {
+			PendingChecksum p = { name, entry.archivename, false };
+			pending.push_back( p );
 		}
+		if ( !entry.unchainedhash.empty() ) maps_unchained_hash[name] = entry.unchainedhash;
+		if ( !entry.archivename.empty() ) maps_archive_name[name] = entry.archivename;
+		m_map_array.push_back( name );
+		index["map\t" + name] = entry;
 	}
 	int numMods = susynclib().GetPrimaryModCount();
 	for ( int i = 0; i < numMods; i++ )
 	{
-		std::string name, hash, archivename, unchainedhash;
+		ArchiveIndexEntry entry;
+		entry.kind = "mod";
+		StringVector chain;
 		try
 		{
-			name = susynclib().GetPrimaryModName( i );
-			hash = susynclib().GetPrimaryModChecksum( i );
+			entry.name = susynclib().GetPrimaryModName( i );
 			int count = susynclib().GetPrimaryModArchiveCount( i );
 			if ( count > 0 )
 			{
-				archivename = susynclib().GetPrimaryModArchive( i );
-				unchainedhash = susynclib().GetArchiveChecksum( archivename );
+				entry.archivename = susynclib().GetPrimaryModArchive( i );
+			}
+			for ( int j = 0; j < count; ++j ) {
+				const std::string archive = susynclib().GetPrimaryModArchiveList( j );
+				if ( archive != entry.archivename )
+					chain.push_back( archive );
 			}
 		} catch (...) { continue; }
-		try
-		{
-			m_mods_list[name] = hash;
-			if ( !unchainedhash.empty() )  m_mods_unchained_hash[name] = unchainedhash;
-			if ( !archivename.empty() ) m_mods_archive_name[name] = archivename;
-			m_mod_array.push_back( name );
-			m_shortname_to_name_map[
-					std::make_pair(susynclib().GetPrimaryModShortName( i ),
-								   susynclib().GetPrimaryModVersion( i )) ] = name;
-		} catch (...)
-		{
-			LslError( "Found game with hash collision: %s hash: %s", name.c_str(), hash.c_str() );
+		const std::string& name = entry.name;
+		if ( mod_catalog.Contains( name ) ) {
+			LslError( "Found game with hash collision: %s", name.c_str() );
+			continue;
 		}
+		if ( !RestoreIndexEntry( entry, chain, previous, stamps ) ) {
+			try
+			{
+				entry.shortname = susynclib().GetPrimaryModShortName( i );
+				entry.version = susynclib().GetPrimaryModVersion( i );
+			} catch (...) {}
+		}
+		mods_list[name] = entry.hash;
+		if ( entry.hash.empty() ) {
+			PendingChecksum p = { name, entry.archivename, true };
+			pending.push_back( p );
+		}
+		if ( !entry.unchainedhash.empty() ) mods_unchained_hash[name] = entry.unchainedhash;
+		if ( !entry.archivename.empty() ) mods_archive_name[name] = entry.archivename;
+		m_mod_array.push_back( name );
+		mod_catalog.Add( i, name, entry.hash, entry.shortname, entry.version );
+		index["mod\t" + name] = entry;
 	}
-	m_unsorted_mod_array = m_mod_array;
-	m_unsorted_map_array = m_map_array;
+	LslDebug( "archive index: %d of %d archives need checksumming", int(pending.size()), int(index.size()) );
 	std::sort( m_map_array.begin(), m_map_array.end() , &CompareStringNoCase );
 	std::sort( m_mod_array.begin(), m_mod_array.end() , &CompareStringNoCase  );
+
+	unsigned int generation;
+	bool has_pending;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		m_maps_list.swap( maps_list );
+		m_mods_list.swap( mods_list );
+		m_maps_unchained_hash.swap( maps_unchained_hash );
+		m_mods_unchained_hash.swap( mods_unchained_hash );
+		m_maps_archive_name.swap( maps_archive_name );
+		m_mods_archive_name.swap( mods_archive_name );
+		m_archive_index.swap( index );
+		m_map_catalog.Swap( map_catalog );
+		m_mod_catalog.Swap( mod_catalog );
+		m_pending_checksums.swap( pending );
+		generation = m_archives_generation;
+		has_pending = !m_pending_checksums.empty();
+	}
+	if ( !has_pending ) {
+		SaveArchiveIndex();
+		return;
+	}
+	if ( m_cache_thread )
+		m_cache_thread->DoWork( new ArchiveChecksumWorkItem( this, generation ), 1000 );
+}
+
+bool Unitsync::StatArchive( const std::string& archivename, std::string& path, boost::uintmax_t& size, std::time_t& mtime ) const
+{
+	try {
+		path = susynclib().GetArchivePath( archivename );
+		if ( path.empty() )
+			return false;
+		if ( !boost::algorithm::ends_with( path, archivename ) )
+			path = Util::EnsureDelimiter( path ) + archivename;
+		const boost::filesystem::path fspath( path );
+		mtime = boost::filesystem::last_write_time( fspath );
+		size = boost::filesystem::is_directory( fspath ) ? 0 : boost::filesystem::file_size( fspath );
+	} catch (...) {
+		return false;
+	}
+	return true;
+}
+
+bool Unitsync::RestoreIndexEntry( ArchiveIndexEntry& entry, const StringVector& chain, const ArchiveIndex& previous,
+								  std::map<std::string, std::string>& stamps ) const
+{
+	if ( entry.archivename.empty() )
+		return false;
+	// fingerprint of the dependencies, empty if one of them is unknown or a directory
+	std::string chainstamp;
+	for ( const std::string& archive: chain ) {
+		std::map<std::string, std::string>::iterator stamp = stamps.find( archive );
+		if ( stamp == stamps.end() ) {
+			std::string path;
+			boost::uintmax_t size = 0;
+			std::time_t mtime = 0;
+			const bool known = StatArchive( archive, path, size, mtime ) && size != 0;
+			stamp = stamps.insert( std::make_pair( archive, known
+				? archive + ":" + Util::ToString( size ) + ":" + Util::ToString( long(mtime) ) : std::string() ) ).first;
+		}
+		if ( stamp->second.empty() ) {
+			chainstamp.clear();
+			break;
+		}
+		chainstamp += stamp->second + ";";
+	}
+	if ( chain.empty() )
+		chainstamp = "-";
+	entry.chainstamp = chainstamp;
+	if ( !StatArchive( entry.archivename, entry.path, entry.size, entry.mtime ) )
+		return false;
+	ArchiveIndex::const_iterator it = previous.find( entry.path );
+	if ( it == previous.end() )
+		return false;
+	const ArchiveIndexEntry& old = it->second;
+	// directory archives (.sdd) can change without touching the directory's mtime, never trust them
+	if ( entry.size == 0 || old.size != entry.size || old.mtime != entry.mtime
+		 || old.kind != entry.kind || old.name != entry.name || old.archivename != entry.archivename )
+		return false;
+	entry = old;
+	// the archive itself is unchanged, but a replaced dependency changes the chained hash
+	if ( chainstamp.empty() || chainstamp != old.chainstamp )
+		entry.hash.clear();
+	entry.chainstamp = chainstamp;
+	return true;
+}
+
+std::string Unitsync::GetArchiveHash( const std::string& name, bool ismod ) const
+{
+	LocalArchivesVector& list = ismod ? m_mods_list : m_maps_list;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		LocalArchivesVector::const_iterator it = list.find( name );
+		if ( it == list.end() )
+			return std::string();
+		if ( !it->second.empty() )
+			return it->second;
+	}
+	std::string hash;
+	try {
+		hash = ismod ? susynclib().GetPrimaryModChecksumFromName( name ) : susynclib().GetMapChecksumFromName( name );
+	} catch (...) {
+		return std::string();
+	}
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	LocalArchivesVector::iterator it = list.find( name );
+	if ( it != list.end() )
+		it->second = hash;
+	( ismod ? m_mod_catalog : m_map_catalog ).SetHash( name, hash );
+	return hash;
+}
+
+void Unitsync::ComputePendingChecksums( unsigned int generation )
+{
+	size_t total;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		total = m_pending_checksums.size();
+	}
+	size_t done = 0;
+	while ( true )
+	{
+		PendingChecksum item;
+		{
+			boost::mutex::scoped_lock lock(m_archives_lock);
+			if ( generation != m_archives_generation || m_pending_checksums.empty() )
+				break;
+			item = m_pending_checksums.back();
+			m_pending_checksums.pop_back();
+		}
+		// GetArchiveHash skips the unitsync call if a caller already needed this one
+		GetArchiveHash( item.name, item.ismod );
+		std::string unchainedhash;
+		try {
+			if ( !item.archivename.empty() )
+				unchainedhash = susynclib().GetArchiveChecksum( item.archivename );
+		} catch (...) {}
+		{
+			boost::mutex::scoped_lock lock(m_archives_lock);
+			if ( generation != m_archives_generation )
+				break;
+			if ( !unchainedhash.empty() )
+				( item.ismod ? m_mods_unchained_hash : m_maps_unchained_hash )[item.name] = unchainedhash;
+			ArchiveIndex::iterator entry = m_archive_index.find( ( item.ismod ? "mod\t" : "map\t" ) + item.name );
+			if ( entry != m_archive_index.end() )
+				entry->second.unchainedhash = unchainedhash;
+		}
+		++done;
+		if ( done % 50 == 0 || done == total )
+			sig_ArchiveChecksumProgress( done, total );
+	}
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	const bool current = generation == m_archives_generation;
+	lock.unlock();
+	if ( done > 0 && current ) {
+		SaveArchiveIndex();
+		// end of the cold start pass, write what the infos loaded so far added
+		m_binary_cache.Flush();
+	}
+}
+
+std::string Unitsync::GetArchiveIndexPath() const
+{
+	return m_cache_path + "archives.index";
+}
+
+namespace {
+const std::string ARCHIVE_INDEX_HEADER = "lsl archive index 2";
+}
+
+void Unitsync::LoadArchiveIndex( ArchiveIndex& index ) const
+{
+	// one archive per line, tab separated:
+	// kind name archivename path size mtime hash unchainedhash shortname version chainstamp depsknown deps...
+	StringVector lines;
+	if ( m_cache_path.empty() || !GetCacheFile( GetArchiveIndexPath(), lines ) )
+		return;
+	if ( lines.empty() || lines[0] != ARCHIVE_INDEX_HEADER )
+		return;
+	for ( size_t l = 1; l < lines.size(); ++l ) {
+		const StringVector tokens = Util::StringTokenize( lines[l], "\t", boost::algorithm::token_compress_off );
+		if ( tokens.size() < 12 || tokens[3].empty() )
+			continue;
+		ArchiveIndexEntry entry;
+		entry.kind = tokens[0];
+		entry.name = tokens[1];
+		entry.archivename = tokens[2];
+		entry.path = tokens[3];
+		entry.size = Util::FromString<boost::uintmax_t>( tokens[4] );
+		entry.mtime = Util::FromString<long>( tokens[5] );
+		entry.hash = tokens[6];
+		entry.unchainedhash = tokens[7];
+		entry.shortname = tokens[8];
+		entry.version = tokens[9];
+		entry.chainstamp = tokens[10];
+		entry.depsknown = tokens[11] == "1";
+		entry.deps.assign( tokens.begin() + 12, tokens.end() );
+		index[entry.path] = entry;
+	}
+}
+
+void Unitsync::SaveArchiveIndex()
+{
+	if ( m_cache_path.empty() )
+		return;
+	StringVector lines;
+	lines.push_back( ARCHIVE_INDEX_HEADER );
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		for ( ArchiveIndex::const_iterator it = m_archive_index.begin(); it != m_archive_index.end(); ++it ) {
+			const ArchiveIndexEntry& entry = it->second;
+			const LocalArchivesVector& list = entry.kind == "mod" ? m_mods_list : m_maps_list;
+			LocalArchivesVector::const_iterator hash = list.find( entry.name );
+			if ( entry.path.empty() || hash == list.end() || hash->second.empty() )
+				continue;
+			std::string line = entry.kind + "\t" + entry.name + "\t" + entry.archivename + "\t" + entry.path
+					+ "\t" + Util::ToString( entry.size ) + "\t" + Util::ToString( long(entry.mtime) )
+					+ "\t" + hash->second + "\t" + entry.unchainedhash
+					+ "\t" + entry.shortname + "\t" + entry.version + "\t" + entry.chainstamp
+					+ "\t" + ( entry.depsknown ? "1" : "0" );
+			for ( const std::string& dep: entry.deps )
+				line += "\t" + dep;
+			lines.push_back( line );
+		}
+	}
+	try {
+		SetCacheFile( GetArchiveIndexPath(), lines );
+	} catch ( std::exception& e ) {
+		LslWarning( "couldn't write archive index: %s", e.what() );
+	}
 }
 
 bool Unitsync::_LoadUnitSyncLib( const std::string& unitsyncloc )
@@ -225,10 +535,12 @@ StringVector Unitsync::GetModList() const
 bool Unitsync::ModExists( const std::string& modname, const std::string& hash ) const
 {
 	TRY_LOCK(false)
-	LocalArchivesVector::const_iterator itor = m_mods_list.find(modname);
-	if ( itor == m_mods_list.end() ) return false;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		if ( !m_mod_catalog.Contains( modname ) ) return false;
+	}
 	if (hash.empty() || hash == "0") return true;
-	return itor->second == hash;
+	return GetArchiveHash( modname, true ) == hash;
 }
 
 UnitsyncMod Unitsync::GetMod( const std::string& modname )
@@ -236,7 +548,7 @@ UnitsyncMod Unitsync::GetMod( const std::string& modname )
 	UnitsyncMod m;
 	TRY_LOCK(m);
 	m.name = modname;
-	m.hash = m_mods_list[modname];
+	m.hash = GetArchiveHash( modname, true );
 	return m;
 }
 
@@ -246,7 +558,7 @@ UnitsyncMod Unitsync::GetMod( int index )
 	UnitsyncMod m;
 	TRY_LOCK(m);
 	m.name = m_mod_array[index];
-	m.hash = m_mods_list[m.name];
+	m.hash = GetArchiveHash( m.name, true );
 	return m;
 }
 
@@ -271,10 +583,12 @@ StringVector Unitsync::GetModValidMapList( const std::string& modname ) const
 bool Unitsync::MapExists( const std::string& mapname, const std::string& hash ) const
 {
 	TRY_LOCK(false)
-	LocalArchivesVector::const_iterator itor = m_maps_list.find(mapname);
-	if ( itor == m_maps_list.end() ) return false;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		if ( !m_map_catalog.Contains( mapname ) ) return false;
+	}
 	if (hash.empty() || hash == "0") return true;
-	return itor->second == hash;
+	return GetArchiveHash( mapname, false ) == hash;
 }
 
 UnitsyncMap Unitsync::GetMap( int index )
@@ -284,7 +598,7 @@ UnitsyncMap Unitsync::GetMap( int index )
 	if ( index < 0 )
 		return m;
 	m.name = m_map_array[index];
-	m.hash = m_maps_list[m.name];
+	m.hash = GetArchiveHash( m.name, false );
 	m.info = _GetMapInfoEx( m.name );
 	return m;
 }
@@ -331,32 +645,186 @@ void GetOptionEntry(const int i, GameOptions& ret)
 }
 
 
-GameOptions Unitsync::GetMapOptions( const std::string& name )
+namespace {
+const std::string GAMEOPTIONS_CACHE_VERSION = "1";
+
+//! floats go through their bit pattern, exact and independent of the locale
+std::string PackFloat( float value )
 {
-	GameOptions ret;
-	TRY_LOCK(ret)
+	boost::uint32_t bits;
+	memcpy( &bits, &value, sizeof(bits) );
+	return Util::ToString( bits );
+}
 
-	assert(!name.empty());
-	if (m_map_gameoptions.find(name) != m_map_gameoptions.end()) {
-		return m_map_gameoptions[name];
+float UnpackFloat( const std::string& str )
+{
+	const boost::uint32_t bits = Util::FromString<boost::uint32_t>( str );
+	float value;
+	memcpy( &value, &bits, sizeof(value) );
+	return value;
+}
+
+void PackOptionModel( const mmOptionModel& opt, StringVector& list )
+{
+	list.push_back( Util::ToString( int(opt.type) ) );
+	list.push_back( opt.key );
+	list.push_back( opt.name );
+	list.push_back( opt.description );
+	list.push_back( opt.section );
+	list.push_back( opt.ct_type_string );
+}
+
+//! flattens \param opts to one string per field, the reverse of UnpackGameOptions
+StringVector PackGameOptions( const GameOptions& opts )
+{
+	StringVector list;
+	list.push_back( GAMEOPTIONS_CACHE_VERSION );
+	for ( OptionMapFloat::const_iterator it = opts.float_map.begin(); it != opts.float_map.end(); ++it ) {
+		PackOptionModel( it->second, list );
+		list.push_back( PackFloat( it->second.def ) );
+		list.push_back( PackFloat( it->second.stepping ) );
+		list.push_back( PackFloat( it->second.min ) );
+		list.push_back( PackFloat( it->second.max ) );
+	}
+	for ( OptionMapBool::const_iterator it = opts.bool_map.begin(); it != opts.bool_map.end(); ++it ) {
+		PackOptionModel( it->second, list );
+		list.push_back( it->second.def ? "1" : "0" );
+	}
+	for ( OptionMapString::const_iterator it = opts.string_map.begin(); it != opts.string_map.end(); ++it ) {
+		PackOptionModel( it->second, list );
+		list.push_back( it->second.def );
+		list.push_back( Util::ToString( it->second.max_len ) );
+	}
+	for ( OptionMapList::const_iterator it = opts.list_map.begin(); it != opts.list_map.end(); ++it ) {
+		PackOptionModel( it->second, list );
+		list.push_back( it->second.def );
+		list.push_back( Util::ToString( it->second.listitems.size() ) );
+		for ( ListItemVec::const_iterator item = it->second.listitems.begin(); item != it->second.listitems.end(); ++item ) {
+			list.push_back( item->key );
+			list.push_back( item->name );
+			list.push_back( item->desc );
+		}
+	}
+	for ( OptionMapSection::const_iterator it = opts.section_map.begin(); it != opts.section_map.end(); ++it ) {
+		PackOptionModel( it->second, list );
 	}
+	return list;
+}
 
-	int count = susynclib().GetMapOptionCount(name);
-	for (int i = 0; i < count; ++i)
-	{
+//! false if \param list is from another version or truncated, \param opts is undefined then
+bool UnpackGameOptions( const StringVector& list, GameOptions& opts )
+{
+	if ( list.empty() || list[0] != GAMEOPTIONS_CACHE_VERSION )
+		return false;
+	size_t pos = 1;
+	while ( pos < list.size() ) {
+		if ( list.size() - pos < 6 )
+			return false;
+		const int type = Util::FromString<int>( list[pos] );
+		const std::string& key = list[pos + 1];
+		const std::string& name = list[pos + 2];
+		const std::string& desc = list[pos + 3];
+		const std::string& section = list[pos + 4];
+		const std::string& style = list[pos + 5];
+		pos += 6;
+		switch ( type ) {
+			case Enum::opt_float: {
+				if ( list.size() - pos < 4 )
+					return false;
+				opts.float_map[key] = mmOptionFloat( name, key, desc, UnpackFloat( list[pos] ), UnpackFloat( list[pos + 1] ),
+													UnpackFloat( list[pos + 2] ), UnpackFloat( list[pos + 3] ), section, style );
+				pos += 4;
+				break;
+			}
+			case Enum::opt_bool: {
+				if ( list.size() - pos < 1 )
+					return false;
+				opts.bool_map[key] = mmOptionBool( name, key, desc, list[pos] == "1", section, style );
+				pos += 1;
+				break;
+			}
+			case Enum::opt_string: {
+				if ( list.size() - pos < 2 )
+					return false;
+				opts.string_map[key] = mmOptionString( name, key, desc, list[pos], Util::FromString<unsigned int>( list[pos + 1] ), section, style );
+				pos += 2;
+				break;
+			}
+			case Enum::opt_list: {
+				if ( list.size() - pos < 2 )
+					return false;
+				mmOptionList& opt = opts.list_map[key];
+				opt = mmOptionList( name, key, desc, list[pos], section, style );
+				const size_t items = Util::FromString<size_t>( list[pos + 1] );
+				pos += 2;
+				if ( ( list.size() - pos ) / 3 < items )
+					return false;
+				for ( size_t j = 0; j < items; ++j, pos += 3 )
+					opt.addItem( list[pos], list[pos + 1], list[pos + 2] );
+				break;
+			}
+			case Enum::opt_section: {
+				opts.section_map[key] = mmOptionSection( name, key, desc, section, style );
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+}
+
+GameOptions Unitsync::_GetGameOptions( const std::string& name, bool ismod )
+{
+	std::map<std::string, GameOptions>& loaded = ismod ? m_game_gameoptions : m_map_gameoptions;
+	const std::string hash = GetArchiveHash( name, ismod );
+	const std::string cachekey = ( ismod ? "mod\t" : "map\t" ) + name + "-" + hash;
+	std::map<std::string, GameOptions>::const_iterator it = loaded.find( cachekey );
+	if ( it != loaded.end() )
+		return it->second;
+
+	GameOptions ret;
+	StringVector cached;
+	if ( !hash.empty() && m_binary_cache.GetStringList( BinaryCache::KIND_OPTIONS, cachekey, cached ) ) {
+		if ( UnpackGameOptions( cached, ret ) ) {
+			loaded[cachekey] = ret;
+			return ret;
+		}
+		ret = GameOptions();
+	}
+
+	// every option costs a handful of unitsync calls, list options one more per item
+	const int count = ismod ? susynclib().GetModOptionCount( name ) : susynclib().GetMapOptionCount( name );
+	for ( int i = 0; i < count; ++i ) {
 		GetOptionEntry( i, ret );
 	}
-	m_map_gameoptions[name] = ret;
+	loaded[cachekey] = ret;
+	// without a hash a changed archive could not be told apart, keep those in memory only
+	if ( !hash.empty() )
+		m_binary_cache.SetStringList( BinaryCache::KIND_OPTIONS, cachekey, PackGameOptions( ret ) );
 	return ret;
 }
 
+GameOptions Unitsync::GetMapOptions( const std::string& name )
+{
+	GameOptions ret;
+	TRY_LOCK(ret)
+
+	assert(!name.empty());
+	return _GetGameOptions( name, false );
+}
+
 StringVector Unitsync::GetMapDeps( const std::string& mapname )
 {
 	assert(!mapname.empty());
 	StringVector ret;
+	if ( GetIndexedDeps( "map\t" + mapname, ret ) )
+		return ret;
 	try
 	{
-		ret = susynclib().GetMapDeps( Util::IndexInSequence( m_unsorted_map_array, mapname ) );
+		ret = susynclib().GetMapDeps( GetCatalogIndex( mapname, false ) );
+		SetIndexedDeps( "map\t" + mapname, ret );
 	}
 	catch( Exceptions::unitsync& u ) {}
 	return ret;
@@ -365,13 +833,12 @@ StringVector Unitsync::GetMapDeps( const std::string& mapname )
 UnitsyncMap Unitsync::GetMap( const std::string& mapname )
 {
 	assert(!mapname.empty());
-	const int i = Util::IndexInSequence( m_map_array, mapname );
 	UnitsyncMap m;
-	if( i < 0 ) {
+	if( GetCatalogIndex( mapname, false ) < 0 ) {
 		LSL_THROWF( unitsync, "Map does not exist: %s", mapname.c_str());
 	}
-	m.name = m_map_array[i];
-	m.hash = m_maps_list[m.name];
+	m.name = mapname;
+	m.hash = GetArchiveHash( m.name, false );
 	m.info = _GetMapInfoEx( m.name );
 	return m;
 }
@@ -381,17 +848,8 @@ GameOptions Unitsync::GetModOptions( const std::string& name )
 	assert(!name.empty());
 	GameOptions ret;
 	TRY_LOCK(ret)
-	if (m_game_gameoptions.find(name) != m_game_gameoptions.end()) {
-		return m_game_gameoptions[name];
-	}
 	if(!IsLoaded()) return ret;
-	int count = susynclib().GetModOptionCount(name);
-	for (int i = 0; i < count; ++i)
-	{
-		GetOptionEntry(i, ret );
-	}
-	m_game_gameoptions[name] = ret;
-	return ret;
+	return _GetGameOptions( name, true );
 }
 
 StringVector Unitsync::GetModDeps( const std::string& modname ) const
@@ -399,33 +857,56 @@ StringVector Unitsync::GetModDeps( const std::string& modname ) const
 	assert(!modname.empty());
 	StringVector ret;
 	TRY_LOCK(ret)
+	if ( GetIndexedDeps( "mod\t" + modname, ret ) )
+		return ret;
 	try
 	{
-		ret = susynclib().GetModDeps( Util::IndexInSequence( m_unsorted_mod_array, modname ) );
+		ret = susynclib().GetModDeps( GetCatalogIndex( modname, true ) );
+		SetIndexedDeps( "mod\t" + modname, ret );
 	}
 	catch( Exceptions::unitsync& u ) {}
 	return ret;
 }
 
+bool Unitsync::GetIndexedDeps( const std::string& key, StringVector& deps ) const
+{
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	ArchiveIndex::const_iterator it = m_archive_index.find( key );
+	if ( it == m_archive_index.end() || !it->second.depsknown )
+		return false;
+	deps = it->second.deps;
+	return true;
+}
+
+void Unitsync::SetIndexedDeps( const std::string& key, const StringVector& deps ) const
+{
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	ArchiveIndex::iterator it = m_archive_index.find( key );
+	if ( it == m_archive_index.end() )
+		return;
+	it->second.deps = deps;
+	it->second.depsknown = true;
+}
+
 StringVector Unitsync::GetSides( const std::string& modname )
 {
 	assert(!modname.empty());
 	StringVector ret;
 	TRY_LOCK(ret);
-	const std::string cachefile = GetFileCachePath(modname, true ) + ".sides";
-	if (m_sides_cache.TryGet( cachefile, ret)) { //first return from mru cache
+	const std::string cachekey = modname + "-" + GetArchiveHash( modname, true );
+	if (m_sides_cache.TryGet( cachekey, ret)) { //first return from mru cache
 		return ret;
 	}
 
-	if (!GetCacheFile(cachefile, ret) && (ModExists(modname))) { // cache file failed, try from lsl
+	if (!m_binary_cache.GetStringList( BinaryCache::KIND_SIDES, cachekey, ret ) && (ModExists(modname))) { // cache failed, try from lsl
 		try {
 			ret = susynclib().GetSides( modname );
-			SetCacheFile(cachefile, ret); //store into cachefile
+			m_binary_cache.SetStringList( BinaryCache::KIND_SIDES, cachekey, ret );
 		} catch( Exceptions::unitsync& u ) {
 			LSL_THROWF(unitsync, "Error in GetSides: %s", modname.c_str());
 		}
 	}
-	m_sides_cache.Add(cachefile, ret); //store into mru
+	m_sides_cache.Add(cachekey, ret); //store into mru
 	return ret;
 }
 
@@ -433,48 +914,78 @@ StringVector Unitsync::GetSides( const std::string& modname )
 UnitsyncImage Unitsync::GetSidePicture( const std::string& modname, const std::string& SideName )
 {
 	assert(!modname.empty());
-
-	const std::string cachepath = GetFileCachePath( modname, true, false) +"-side-" +SideName + ".png";
 	UnitsyncImage img;
 	TRY_LOCK(img);
+	std::vector<UnitsyncImage> imgs;
+	if ( !_GetSidePictures( modname, StringVector( 1, SideName ), imgs ) )
+		LSL_THROWF( unitsync, "%s: cannot find side picture %s\n", modname.c_str(), SideName.c_str() );
+	return imgs[0];
+}
 
-	if (Util::FileExists(cachepath)) {
-		img = UnitsyncImage( cachepath );
+std::vector<UnitsyncImage> Unitsync::GetSidePictures( const std::string& modname )
+{
+	assert(!modname.empty());
+	std::vector<UnitsyncImage> imgs;
+	TRY_LOCK(imgs);
+	_GetSidePictures( modname, GetSides( modname ), imgs );
+	return imgs;
+}
+
+bool Unitsync::_GetSidePictures( const std::string& modname, const StringVector& sides, std::vector<UnitsyncImage>& imgs )
+{
+	imgs.assign( sides.size(), UnitsyncImage() );
+	std::vector<std::string> cachepaths( sides.size() );
+	std::vector<size_t> missing;
+	for ( size_t i = 0; i < sides.size(); ++i ) {
+		cachepaths[i] = GetFileCachePath( modname, true, false ) + "-side-" + sides[i] + ".png";
+		if ( Util::FileExists( cachepaths[i] ) )
+			imgs[i] = UnitsyncImage( cachepaths[i] );
+		if ( !imgs[i].isValid() ) //image seems invalid, recreate
+			missing.push_back( i );
 	}
+	if ( missing.empty() )
+		return true;
 
-	if (!img.isValid()) { //image seems invalid, recreate
-		std::string ImgName("SidePics");
-		ImgName += "/";
-		ImgName += boost::to_lower_copy( SideName );
-		try {
-			img = GetImage( modname, ImgName + ".png", false );
-		}
-		catch ( Exceptions::unitsync& u ){
-			img = GetImage( modname, ImgName + ".bmp", true);
+	// png and bmp of every missing side in one go, the bmp is only used if there is no png
+	StringVector paths;
+	for ( size_t i = 0; i < missing.size(); ++i ) {
+		const std::string imgname = "SidePics/" + boost::to_lower_copy( sides[missing[i]] );
+		paths.push_back( imgname + ".png" );
+		paths.push_back( imgname + ".bmp" );
+	}
+	VfsFileVector files = susynclib().ReadFilesVFS( modname, paths );
+	bool found = true;
+	for ( size_t i = 0; i < missing.size(); ++i ) {
+		const VfsFile* file = &files[2 * i];
+		bool useWhiteAsTransparent = false;
+		if ( file->data.empty() ) {
+			file = &files[2 * i + 1];
+			useWhiteAsTransparent = true;
 		}
-
-		if (img.isValid()) {
-			img.Save(cachepath);
+		if ( file->data.empty() ) {
+			found = false;
+			continue;
 		}
+		UnitsyncImage& img = imgs[missing[i]];
+		img = UnitsyncImage::FromVfsFileData( &file->data[0], file->data.size(), file->path, useWhiteAsTransparent );
+		if ( img.isValid() )
+			img.Save( cachepaths[missing[i]] );
 	}
-	return img;
+	susynclib().ReleaseVfsFiles( files );
+	return found;
 }
 
 UnitsyncImage Unitsync::GetImage( const std::string& modname, const std::string& image_path, bool useWhiteAsTransparent  ) const
 {
 	assert(!modname.empty());
-	susynclib().SetCurrentMod( modname );
-	int ini = susynclib().OpenFileVFS ( image_path );
-	if( !ini )
+	VfsFileVector files = susynclib().ReadFilesVFS( modname, StringVector( 1, image_path ) );
+	if ( !files[0].found )
 		LSL_THROWF( unitsync, "%s: cannot find image %s\n", modname.c_str(), image_path.c_str());
-	int FileSize = susynclib().FileSizeVFS(ini);
-	if (FileSize == 0) {
-		susynclib().CloseFileVFS(ini);
+	if ( files[0].data.empty() )
 		LSL_THROWF( unitsync, "%s: image has size 0 %s\n", modname.c_str(), image_path.c_str() );
-	}
-	Util::uninitialized_array<char> FileContent(FileSize);
-	susynclib().ReadFileVFS(ini, FileContent, FileSize);
-	return UnitsyncImage::FromVfsFileData( FileContent, FileSize, image_path, useWhiteAsTransparent );
+	UnitsyncImage img = UnitsyncImage::FromVfsFileData( &files[0].data[0], files[0].data.size(), image_path, useWhiteAsTransparent );
+	susynclib().ReleaseVfsFiles( files );
+	return img;
 }
 
 StringVector Unitsync::GetAIList( const std::string& modname ) const
@@ -534,11 +1045,11 @@ GameOptions Unitsync::GetAIOptions( const std::string& modname, int index )
 StringVector Unitsync::GetUnitsList( const std::string& modname )
 {
 	assert(!modname.empty());
-	const std::string cachefile = GetFileCachePath( modname, true ) + ".units";
+	const std::string cachekey = modname + "-" + GetArchiveHash( modname, true );
 	StringVector cache;
 	TRY_LOCK(cache)
 
-	if (!GetCacheFile(cachefile, cache)) { //cache read failed
+	if (!m_binary_cache.GetStringList( BinaryCache::KIND_UNITS, cachekey, cache )) { //cache read failed
 		susynclib().SetCurrentMod( modname );
 		while ( susynclib().ProcessUnitsNoChecksum() > 0 ) {}
 		const int unitcount = susynclib().GetUnitCount();
@@ -546,7 +1057,7 @@ StringVector Unitsync::GetUnitsList( const std::string& modname )
 		{
 			cache.push_back( susynclib().GetFullUnitName(i) + " (" + susynclib().GetUnitName(i) + ")" );
 		}
-		SetCacheFile(cachefile, cache);
+		m_binary_cache.SetStringList( BinaryCache::KIND_UNITS, cachekey, cache );
 	}
 	return cache;
 }
@@ -564,35 +1075,21 @@ UnitsyncImage Unitsync::GetMinimap( const std::string& mapname, int width, int h
 	if (mapname.empty()) {
 		return img;
 	}
-
-	const bool tiny = ( width <= 100 && height <= 100 );
-	if ( tiny && m_tiny_minimap_cache.TryGet( mapname, img ) ) {
-
-		lslSize image_size = lslSize(img.GetWidth(), img.GetHeight()).MakeFit( lslSize(width, height) );
-		if ( image_size.GetWidth() != img.GetWidth() || image_size.GetHeight() != img.GetHeight() ) {
-			img.Rescale( image_size.GetWidth(), image_size.GetHeight() );
-		}
+	const UnitsyncImagePyramid pyramid = _GetMapImagePyramid( mapname, ".minimap.png", &Unitsync::GetMinimap );
+	if ( !pyramid.isValid() ) {
 		return img;
 	}
-
-	img = GetMinimap( mapname );
 	// special resizing code because minimap is always square,
 	// and we need to resize it to the correct aspect ratio.
-	if (img.isValid())
-	{
-		try {
-			MapInfo mapinfo = _GetMapInfoEx( mapname );
+	try {
+		MapInfo mapinfo = _GetMapInfoEx( mapname );
 
-			lslSize image_size = lslSize(mapinfo.width, mapinfo.height).MakeFit( lslSize(width, height) );
-			img.Rescale( image_size.GetWidth(), image_size.GetHeight() );
-		}
-		catch (...) {
-			img = UnitsyncImage( 1, 1 );
-		}
+		lslSize image_size = lslSize(mapinfo.width, mapinfo.height).MakeFit( lslSize(width, height) );
+		return pyramid.Scaled( image_size.GetWidth(), image_size.GetHeight() );
+	}
+	catch (...) {
+		return UnitsyncImage( 1, 1 );
 	}
-	if ( tiny )
-		m_tiny_minimap_cache.Add( mapname, img );
-	return img;
 }
 
 UnitsyncImage Unitsync::GetMetalmap( const std::string& mapname )
@@ -603,7 +1100,7 @@ UnitsyncImage Unitsync::GetMetalmap( const std::string& mapname )
 UnitsyncImage Unitsync::GetMetalmap( const std::string& mapname, int width, int height )
 {
 	TRY_LOCK(UnitsyncImage())
-	return _GetScaledMapImage( mapname, &Unitsync::GetMetalmap, width, height );
+	return _GetScaledMapImage( mapname, ".metalmap.png", &Unitsync::GetMetalmap, width, height );
 }
 
 UnitsyncImage Unitsync::GetHeightmap( const std::string& mapname )
@@ -614,7 +1111,43 @@ UnitsyncImage Unitsync::GetHeightmap( const std::string& mapname )
 UnitsyncImage Unitsync::GetHeightmap( const std::string& mapname, int width, int height )
 {
 	TRY_LOCK(UnitsyncImage())
-	return _GetScaledMapImage( mapname, &Unitsync::GetHeightmap, width, height );
+	return _GetScaledMapImage( mapname, ".heightmap.png", &Unitsync::GetHeightmap, width, height );
+}
+
+namespace {
+bool RawImageCache()
+{
+	return LSL::Util::config().GetImageCacheFormat() != "png";
+}
+
+//! raw files get their own extension, so switching formats never misreads one
+std::string MapImageCacheFile( const std::string& cachepath, const std::string& imagename )
+{
+	if ( !RawImageCache() )
+		return cachepath + imagename;
+	return cachepath + boost::algorithm::replace_last_copy( imagename, ".png", ".raw" );
+}
+
+//! invalid if the file is missing or unreadable
+UnitsyncImage LoadMapImageCacheFile( const std::string& cachefile )
+{
+	UnitsyncImage img;
+	if ( !Util::FileExists( cachefile ) )
+		return img;
+	if ( RawImageCache() )
+		img.LoadRaw( cachefile );
+	else
+		img = UnitsyncImage( cachefile );
+	return img;
+}
+
+void SaveMapImageCacheFile( const UnitsyncImage& img, const std::string& cachefile )
+{
+	if ( RawImageCache() )
+		img.SaveRaw( cachefile );
+	else
+		img.Save( cachefile, true );
+}
 }
 
 UnitsyncImage Unitsync::_GetMapImage( const std::string& mapname, const std::string& imagename, UnitsyncImage (UnitsyncLib::*loadMethod)(const std::string&) )
@@ -623,17 +1156,19 @@ UnitsyncImage Unitsync::_GetMapImage( const std::string& mapname, const std::str
 	if ( m_map_image_cache.TryGet( mapname + imagename, img ) ) {
 		return img;
 	}
+	return m_image_flights.Do( mapname + imagename, boost::bind( &Unitsync::_LoadMapImage, this, mapname, imagename, loadMethod ) );
+}
 
-	const std::string cachefile = GetFileCachePath( mapname, false, false) + imagename;
-	if (Util::FileExists(cachefile)) {
-		img = UnitsyncImage( cachefile );
-	}
+UnitsyncImage Unitsync::_LoadMapImage( const std::string& mapname, const std::string& imagename, UnitsyncImage (UnitsyncLib::*loadMethod)(const std::string&) )
+{
+	const std::string cachefile = MapImageCacheFile( GetFileCachePath( mapname, false, false), imagename );
+	UnitsyncImage img = LoadMapImageCacheFile( cachefile );
 
 	if (!img.isValid()) { //image seems invalid, recreate
 		try {
 		//convert and save
 		img = (susynclib().*loadMethod)( mapname );
-		img.Save( cachefile );
+		SaveMapImageCacheFile( img, cachefile );
 		} catch (...) { //we failed horrible, use dummy image
 			//dummy image
 			img = UnitsyncImage( 1, 1 );
@@ -643,75 +1178,95 @@ UnitsyncImage Unitsync::_GetMapImage( const std::string& mapname, const std::str
 	return img;
 }
 
-UnitsyncImage Unitsync::_GetScaledMapImage( const std::string& mapname, UnitsyncImage (Unitsync::*loadMethod)(const std::string&), int width, int height )
+void Unitsync::GetAllMapImages( const std::string& mapname, UnitsyncImage& minimap, UnitsyncImage& metalmap, UnitsyncImage& heightmap, MapInfo& info )
 {
-	UnitsyncImage img = (this->*loadMethod) ( mapname );
-	if (img.isValid())
-	{
-		lslSize image_size = lslSize(img.GetWidth(), img.GetHeight()).MakeFit( lslSize(width, height) );
-		img.Rescale( image_size.GetWidth(), image_size.GetHeight() );
+	assert(!mapname.empty());
+	try {
+		info = _GetMapInfoEx( mapname );
+	} catch ( Exceptions::unitsync& e ) {}
+
+	static const char* const imagenames[3] = { ".minimap.png", ".metalmap.png", ".heightmap.png" };
+	UnitsyncImage* images[3] = { &minimap, &metalmap, &heightmap };
+	UnitsyncImage* missing[3] = { NULL, NULL, NULL };
+	const std::string cachepath = GetFileCachePath( mapname, false, false );
+	bool any_missing = false;
+	for ( int i = 0; i < 3; ++i ) {
+		if ( m_map_image_cache.TryGet( mapname + imagenames[i], *images[i] ) )
+			continue;
+		*images[i] = LoadMapImageCacheFile( MapImageCacheFile( cachepath, imagenames[i] ) );
+		if ( images[i]->isValid() ) {
+			m_map_image_cache.Add( mapname + imagenames[i], *images[i] );
+			continue;
+		}
+		missing[i] = images[i];
+		any_missing = true;
+	}
+	if ( !any_missing )
+		return;
+
+	try {
+		susynclib().GetMapImages( mapname, missing[0], missing[1], missing[2] );
+	} catch (...) {}
+	for ( int i = 0; i < 3; ++i ) {
+		if ( !missing[i] )
+			continue;
+		if ( missing[i]->isValid() ) {
+			try {
+				SaveMapImageCacheFile( *missing[i], MapImageCacheFile( cachepath, imagenames[i] ) );
+			} catch (...) {}
+		} else {
+			//dummy image
+			*missing[i] = UnitsyncImage( 1, 1 );
+		}
+		m_map_image_cache.Add( mapname + imagenames[i], *missing[i] );
 	}
-	return img;
+}
+
+UnitsyncImagePyramid Unitsync::_GetMapImagePyramid( const std::string& mapname, const std::string& imagename, UnitsyncImage (Unitsync::*loadMethod)(const std::string&) )
+{
+	UnitsyncImagePyramid pyramid;
+	if ( m_map_pyramid_cache.TryGet( mapname + imagename, pyramid ) ) {
+		return pyramid;
+	}
+	return m_pyramid_flights.Do( mapname + imagename, boost::bind( &Unitsync::_LoadMapImagePyramid, this, mapname, imagename, loadMethod ) );
+}
+
+UnitsyncImagePyramid Unitsync::_LoadMapImagePyramid( const std::string& mapname, const std::string& imagename, UnitsyncImage (Unitsync::*loadMethod)(const std::string&) )
+{
+	const UnitsyncImagePyramid pyramid( (this->*loadMethod)( mapname ) );
+	if ( pyramid.isValid() )
+		m_map_pyramid_cache.Add( mapname + imagename, pyramid );
+	return pyramid;
+}
+
+UnitsyncImage Unitsync::_GetScaledMapImage( const std::string& mapname, const std::string& imagename, UnitsyncImage (Unitsync::*loadMethod)(const std::string&), int width, int height )
+{
+	const UnitsyncImagePyramid pyramid = _GetMapImagePyramid( mapname, imagename, loadMethod );
+	if ( !pyramid.isValid() )
+		return UnitsyncImage();
+	lslSize image_size = lslSize(pyramid.GetWidth(), pyramid.GetHeight()).MakeFit( lslSize(width, height) );
+	return pyramid.Scaled( image_size.GetWidth(), image_size.GetHeight() );
 }
 
 MapInfo Unitsync::_GetMapInfoEx( const std::string& mapname )
 {
 	MapInfo info;
-	info.width = 1;
-	info.height = 1;
 	if ( m_mapinfo_cache.TryGet( mapname, info ) )
 		return info;
-	const std::string cachefile = GetFileCachePath( mapname, false, false) + ".infoex";
-	StringVector cache;
-	if (GetCacheFile(cachefile, cache) && cache.size()>=11) { //cache file failed
-			info.author = cache[0];
-			info.tidalStrength =  Util::FromString<long>( cache[1] );
-			info.gravity = Util::FromString<long>( cache[2] );
-			info.maxMetal = Util::FromString<double>( cache[3] );
-			info.extractorRadius = Util::FromString<double>( cache[4] );
-			info.minWind = Util::FromString<long>( cache[5] );
-			info.maxWind = Util::FromString<long>( cache[6] );
-			info.width = Util::FromString<long>( cache[7] );
-			info.height = Util::FromString<long>( cache[8] );
-			const StringVector posinfo = Util::StringTokenize( cache[9], " ");
-			for( const std::string pos: posinfo )
-			{
-				StartPos position;
-				position.x = Util::FromString<long>( Util::BeforeFirst( pos,  "-" ) );
-				position.y = Util::FromString<long>( Util::AfterFirst( pos, "-" ) );
-				info.positions.push_back( position );
-			}
-			const unsigned int LineCount = cache.size();
-			for ( unsigned int i = 10; i < LineCount; i++ )
-				info.description += cache[i] + "\n";
-	} else {
-			const int index = Util::IndexInSequence( m_unsorted_map_array, mapname);
-			ASSERT_EXCEPTION(index>=0, "Map not found");
-
-			info = susynclib().GetMapInfoEx( index, 1 );
-
-			cache.push_back ( info.author );
-			cache.push_back( Util::ToString( info.tidalStrength ) );
-			cache.push_back( Util::ToString( info.gravity ) );
-			cache.push_back( Util::ToString( info.maxMetal ) );
-			cache.push_back( Util::ToString( info.extractorRadius ) );
-			cache.push_back( Util::ToString( info.minWind ) );
-			cache.push_back( Util::ToString( info.maxWind )  );
-			cache.push_back( Util::ToString( info.width ) );
-			cache.push_back( Util::ToString( info.height ) );
-
-			std::string postring;
-			for ( unsigned int i = 0; i < info.positions.size(); i++)
-			{
-				postring += Util::ToString( info.positions[i].x ) + "-" + Util::ToString( info.positions[i].y ) + " ";
-			}
-			cache.push_back( postring );
+	return m_mapinfo_flights.Do( mapname, boost::bind( &Unitsync::_LoadMapInfoEx, this, mapname ) );
+}
 
-			const StringVector descrtokens = Util::StringTokenize( info.description, "\n" );
-			for( const std::string descrtoken: descrtokens ) {
-				cache.push_back( descrtoken );
-			}
-			SetCacheFile( cachefile, cache );
+MapInfo Unitsync::_LoadMapInfoEx( const std::string& mapname )
+{
+	MapInfo info;
+	info.width = 1;
+	info.height = 1;
+	if ( !m_binary_cache.GetMapInfo( mapname, info ) ) {
+		const int index = GetCatalogIndex( mapname, false );
+		ASSERT_EXCEPTION(index>=0, "Map not found");
+
+		info = susynclib().GetMapInfoEx( index, 1 );
+		m_binary_cache.SetMapInfo( mapname, info );
 	}
 
 	m_mapinfo_cache.Add( mapname, info );
@@ -761,12 +1316,7 @@ std::string Unitsync::GetFileCachePath( const std::string& name, bool IsMod, boo
 	if (!usehash)
 		return ret;
 
-	if (IsMod) {
-		ret += "-" + m_mods_list[name];
-	} else {
-		ret += "-" + m_maps_list[name];
-	}
-	return ret;
+	return ret + "-" + GetArchiveHash( name, IsMod );
 }
 
 bool Unitsync::GetCacheFile( const std::string& path, StringVector& ret) const
@@ -775,11 +1325,18 @@ bool Unitsync::GetCacheFile( const std::string& path, StringVector& ret) const
 	if (file == NULL)
 		return false;
 	ret.clear();
-	char line[1024];
-	while(fgets(line, 1024, file) != NULL) {
-		const int len = strlen(line);
-		ret.push_back(std::string(line, len-1));
+	char buf[1024];
+	std::string line;
+	while(fgets(buf, sizeof(buf), file) != NULL) {
+		line += buf;
+		if (line.empty() || line[line.size()-1] != '\n')
+			continue; // line longer than buf, keep reading
+		line.resize(line.size()-1);
+		ret.push_back(line);
+		line.clear();
 	}
+	if (!line.empty())
+		ret.push_back(line);
 	fclose(file);
 	return true;
 }
@@ -869,22 +1426,6 @@ namespace
 typedef UnitsyncImage (Unitsync::*LoadMethodPtr)(const std::string&);
 typedef UnitsyncImage (Unitsync::*ScaledLoadMethodPtr)(const std::string&, int, int);
 
-class CacheMapWorkItem : public WorkItem
-{
-public:
-	Unitsync* m_usync;
-	std::string m_mapname;
-	LoadMethodPtr m_loadMethod;
-
-	void Run()
-	{
-		(m_usync->*m_loadMethod)( m_mapname );
-	}
-
-	CacheMapWorkItem( Unitsync* usync, const std::string& mapname, LoadMethodPtr loadMethod )
-		: m_usync(usync), m_mapname(mapname.c_str()), m_loadMethod(loadMethod) {}
-};
-
 class GetMapImageAsyncResult : public WorkItem // TODO: rename
 {
 public:
@@ -998,37 +1539,198 @@ public:
 };
 
 
-void Unitsync::PrefetchMap( const std::string& mapname )
+//! one job per map, however often it is requested, see Unitsync::PrefetchMap
+class PrefetchMapWorkItem : public WorkItem
 {
-	// Use a simple hash based on 3 characters from the mapname
-	// (without '.smf') as negative priority for the WorkItems.
-	// This ensures WorkItems for the same map are put together,
-	// which improves caching performance.
+public:
+	PrefetchMapWorkItem( Unitsync* usync, const std::string& mapname )
+		: m_usync( usync ), m_mapname( mapname ), m_cancelled( false ) {}
 
-	// Measured improvement: 60% more cache hits while populating replay tab.
-	// 50% hits without, 80% hits with this code.  (cache size 20 images)
-	assert(!mapname.empty());
+	void Run()
+	{
+		{
+			boost::mutex::scoped_lock lock( m_usync->m_prefetch_lock );
+			// cancelled after a worker took us off the queue
+			if ( m_cancelled )
+				return;
+			m_usync->m_prefetch_jobs.erase( m_mapname );
+			for ( unsigned int token: m_tokens )
+				m_usync->m_prefetch_tokens.erase( token );
+		}
+		UnitsyncImage minimap, metalmap, heightmap;
+		MapInfo info;
+		m_usync->GetAllMapImages( m_mapname, minimap, metalmap, heightmap, info );
+	}
 
-	const int length = std::max(0, int(mapname.length()) - 4);
-	const int hash = ( mapname[length * 1/4] << 16 )
-			| ( mapname[length * 2/4] << 8  )
-			| mapname[length * 3/4];
-	const int priority = -hash;
+	Unitsync* m_usync;
+	const std::string m_mapname;
+	std::vector<unsigned int> m_tokens; /// live requests
+	bool m_cancelled;
+};
 
-	if (! m_cache_thread )
+unsigned int Unitsync::PrefetchMap( const std::string& mapname, int priority )
+{
+	assert(!mapname.empty());
+	if (! m_worker_pool )
 	{
-		LslDebug( "cache thread not initialized %s", "PrefetchMap" );
-		return;
+		LslDebug( "worker pool not initialized %s", "PrefetchMap" );
+		return 0;
+	}
+	boost::mutex::scoped_lock lock( m_prefetch_lock );
+	const unsigned int token = ++m_next_prefetch_token;
+	m_prefetch_tokens[token] = mapname;
+	std::map<std::string, PrefetchMapWorkItem*>::iterator it = m_prefetch_jobs.find( mapname );
+	if ( it != m_prefetch_jobs.end() ) {
+		PrefetchMapWorkItem* job = it->second;
+		job->m_tokens.push_back( token );
+		if ( priority > job->GetPriority() )
+			job->SetPriority( priority );
+		return token;
 	}
+	PrefetchMapWorkItem* job = new PrefetchMapWorkItem( this, mapname );
+	job->m_tokens.push_back( token );
+	m_prefetch_jobs[mapname] = job;
+	m_worker_pool->DoWork( job, priority );
+	return token;
+}
+
+void Unitsync::CancelPrefetch( unsigned int token )
+{
+	boost::mutex::scoped_lock lock( m_prefetch_lock );
+	std::map<unsigned int, std::string>::iterator tit = m_prefetch_tokens.find( token );
+	if ( tit == m_prefetch_tokens.end() )
+		return; // already running or done
+	std::map<std::string, PrefetchMapWorkItem*>::iterator it = m_prefetch_jobs.find( tit->second );
+	m_prefetch_tokens.erase( tit );
+	if ( it == m_prefetch_jobs.end() )
+		return;
+	PrefetchMapWorkItem* job = it->second;
+	job->m_tokens.erase( std::remove( job->m_tokens.begin(), job->m_tokens.end(), token ), job->m_tokens.end() );
+	if ( !job->m_tokens.empty() )
+		return;
+	m_prefetch_jobs.erase( it );
+	CancelPrefetchJob( job );
+}
+
+void Unitsync::CancelAllPrefetches()
+{
+	boost::mutex::scoped_lock lock( m_prefetch_lock );
+	for ( std::map<std::string, PrefetchMapWorkItem*>::iterator it = m_prefetch_jobs.begin(); it != m_prefetch_jobs.end(); ++it )
+		CancelPrefetchJob( it->second );
+	m_prefetch_jobs.clear();
+	m_prefetch_tokens.clear();
+}
+
+void Unitsync::CancelPrefetchJob( PrefetchMapWorkItem* job )
+{
+	// m_prefetch_lock is held, so the job cannot have passed the check in Run yet
+	if ( job->Cancel() )
+		delete job;
+	else
+		job->m_cancelled = true;
+}
+
+class MapThumbnailAtlasWorkItem : public WorkItem
+{
+public:
+	MapThumbnailAtlasWorkItem( Unitsync* usync, int size, unsigned int generation )
+		: m_usync( usync ), m_size( size ), m_generation( generation ) {}
+
+	void Run()
 	{
-		CacheMapWorkItem* work;
+		m_usync->BuildMapThumbnailAtlas( m_size, m_generation );
+	}
 
-		work = new CacheMapWorkItem( this, mapname, &Unitsync::GetMetalmap );
-		m_cache_thread->DoWork( work, priority );
+private:
+	Unitsync* m_usync;
+	const int m_size;
+	const unsigned int m_generation;
+};
+
+std::string Unitsync::GetThumbnailAtlasPath( int size ) const
+{
+	return m_cache_path + "thumbnails-" + Util::ToString( size ) + ".raw";
+}
 
-		work = new CacheMapWorkItem( this, mapname, &Unitsync::GetHeightmap );
-		m_cache_thread->DoWork( work, priority );
+ThumbnailAtlas Unitsync::GetMapThumbnailAtlas( int size )
+{
+	const StringVector maps = GetMapList();
+	unsigned int generation;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		generation = m_archives_generation;
 	}
+	boost::mutex::scoped_lock lock( m_atlas_lock );
+	if ( m_thumbnail_atlas.GetCellSize() != size ) {
+		// one atlas at a time, asking for another size starts that one from its file
+		m_thumbnail_atlas = ThumbnailAtlas( size );
+		if ( !m_cache_path.empty() )
+			m_thumbnail_atlas.Load( GetThumbnailAtlasPath( size ) );
+	}
+	if ( !m_atlas_job_queued && m_cache_thread ) {
+		for ( const std::string& map: maps ) {
+			if ( m_thumbnail_atlas.Contains( map ) )
+				continue;
+			m_atlas_job_queued = true;
+			m_cache_thread->DoWork( new MapThumbnailAtlasWorkItem( this, size, generation ), 100 );
+			break;
+		}
+	}
+	return m_thumbnail_atlas;
+}
+
+void Unitsync::BuildMapThumbnailAtlas( int size, unsigned int generation )
+{
+	const StringVector maps = GetMapList();
+	StringVector missing;
+	{
+		boost::mutex::scoped_lock lock( m_atlas_lock );
+		for ( const std::string& map: maps ) {
+			if ( !m_thumbnail_atlas.Contains( map ) )
+				missing.push_back( map );
+		}
+		// laid out for all maps once, instead of growing with every row
+		if ( m_thumbnail_atlas.GetCellSize() == size )
+			m_thumbnail_atlas.Reserve( m_thumbnail_atlas.GetCount() + missing.size() );
+	}
+	const size_t total = maps.size();
+	size_t done = total - missing.size();
+	size_t added = 0;
+	for ( const std::string& map: missing ) {
+		{
+			boost::mutex::scoped_lock lock(m_archives_lock);
+			if ( generation != m_archives_generation )
+				break;
+		}
+		// served from the map's mip pyramid, a broken map gets an empty entry instead of being retried
+		UnitsyncImage thumbnail;
+		try {
+			thumbnail = GetMinimap( map, size, size );
+		} catch (...) {}
+		{
+			boost::mutex::scoped_lock lock( m_atlas_lock );
+			if ( m_thumbnail_atlas.GetCellSize() != size )
+				break;
+			m_thumbnail_atlas.Add( map, thumbnail );
+		}
+		++added;
+		++done;
+		if ( done % 16 == 0 || done == total )
+			sig_MapThumbnailAtlasProgress( done, total );
+	}
+	ThumbnailAtlas atlas;
+	{
+		boost::mutex::scoped_lock lock( m_atlas_lock );
+		m_atlas_job_queued = false;
+		if ( m_thumbnail_atlas.GetCellSize() == size )
+			atlas = m_thumbnail_atlas;
+	}
+	// saved from the copy, adding to the shared atlas meanwhile copies its image first
+	if ( added > 0 && atlas.GetCellSize() == size && !m_cache_path.empty() )
+		atlas.Save( GetThumbnailAtlasPath( size ) );
+	// and the map infos the thumbnails needed
+	if ( added > 0 )
+		m_binary_cache.Flush();
 }
 
 boost::signals2::connection Unitsync::RegisterEvtHandler( const StringSignalSlotType& handler )
@@ -1050,14 +1752,14 @@ void Unitsync::_GetMapImageAsync( const std::string& mapname, UnitsyncImage (Uni
 {
 	if (mapname.empty())
 		return;
-	if (! m_cache_thread )
+	if (! m_worker_pool )
 	{
-		LslDebug( "cache thread not initialised -- %s", mapname.c_str() );
+		LslDebug( "worker pool not initialised -- %s", mapname.c_str() );
 		return;
 	}
 	GetMapImageAsyncWorkItem* work;
 	work = new GetMapImageAsyncWorkItem( this, mapname, loadMethod );
-	m_cache_thread->DoWork( work, 100 );
+	m_worker_pool->DoWork( work, 100 );
 }
 
 void Unitsync::GetMinimapAsync( const std::string& mapname )
@@ -1070,14 +1772,14 @@ void Unitsync::GetMinimapAsync( const std::string& mapname, int width, int heigh
 {
 	if (mapname.empty())
 		return;
-	if (! m_cache_thread )
+	if (! m_worker_pool )
 	{
-		LslError( "cache thread not initialised" );
+		LslError( "worker pool not initialised" );
 		return;
 	}
 	GetScaledMapImageAsyncWorkItem* work;
 	work = new GetScaledMapImageAsyncWorkItem( this, mapname, width, height, &Unitsync::GetMinimap );
-	m_cache_thread->DoWork( work, 100 );
+	m_worker_pool->DoWork( work, 100 );
 }
 
 void Unitsync::GetMetalmapAsync( const std::string& mapname )
@@ -1110,43 +1812,65 @@ void Unitsync::GetMapExAsync( const std::string& mapname )
 	if (mapname.empty())
 		return;
 
-	if (! m_cache_thread )
+	if (! m_worker_pool )
 	{
-		LslDebug( "cache thread not initialized %s", "GetMapExAsync" );
+		LslDebug( "worker pool not initialized %s", "GetMapExAsync" );
 		return;
 	}
 	GetMapExAsyncWorkItem* work;
 	work = new GetMapExAsyncWorkItem( this, mapname );
-	m_cache_thread->DoWork( work, 200 /* higher prio then GetMinimapAsync */ );
+	m_worker_pool->DoWork( work, 200 /* higher prio then GetMinimapAsync */ );
 }
 
 std::string Unitsync::GetTextfileAsString( const std::string& modname, const std::string& file_path )
 {
 	assert(!modname.empty());
-	susynclib().SetCurrentMod( modname );
-
-	int ini = susynclib().OpenFileVFS ( file_path );
-	if ( !ini )
-		return std::string();
-	int FileSize = susynclib().FileSizeVFS(ini);
-	if (FileSize == 0) {
-		susynclib().CloseFileVFS(ini);
-		return std::string();
-	}
-	Util::uninitialized_array<char> FileContent(FileSize);
-	susynclib().ReadFileVFS(ini, FileContent, FileSize);
-	return std::string( FileContent, size_t( FileSize ) );
+	VfsFileVector files = susynclib().ReadFilesVFS( modname, StringVector( 1, file_path ) );
+	std::string ret( files[0].data.begin(), files[0].data.end() );
+	susynclib().ReleaseVfsFiles( files );
+	return ret;
 }
 
 std::string Unitsync::GetNameForShortname( const std::string& shortname, const std::string& version) const
 {
-	ShortnameVersionToNameMap::const_iterator it
-			=  m_shortname_to_name_map.find( std::make_pair(shortname,version) );
-	if ( it != m_shortname_to_name_map.end() )
-		return it->second;
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	return m_mod_catalog.NameForShortname( shortname, version );
+}
+
+std::string Unitsync::GetNameForHash( const std::string& hash, bool IsMod ) const
+{
+	StringVector unhashed;
+	{
+		boost::mutex::scoped_lock lock(m_archives_lock);
+		const std::string name = ( IsMod ? m_mod_catalog : m_map_catalog ).NameForHash( hash );
+		if ( !name.empty() )
+			return name;
+		for ( const PendingChecksum& item: m_pending_checksums ) {
+			if ( item.ismod == IsMod )
+				unhashed.push_back( item.name );
+		}
+	}
+	// the cache thread hasn't checksummed everything yet, do the rest here;
+	// it works from the back, so start at the front to overlap as little as possible
+	for ( const std::string& name: unhashed ) {
+		if ( GetArchiveHash( name, IsMod ) == hash )
+			return name;
+	}
 	return std::string();
 }
 
+std::string Unitsync::GetNameNoCase( const std::string& name, bool IsMod ) const
+{
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	return ( IsMod ? m_mod_catalog : m_map_catalog ).FindNoCase( name );
+}
+
+int Unitsync::GetCatalogIndex( const std::string& name, bool IsMod ) const
+{
+	boost::mutex::scoped_lock lock(m_archives_lock);
+	return ( IsMod ? m_mod_catalog : m_map_catalog ).IndexOf( name );
+}
+
 Unitsync& usync() {
     static LSL::Util::LineInfo<Unitsync> m( AT );
     static LSL::Util::GlobalObjectHolder<Unitsync, LSL::Util::LineInfo<Unitsync> > m_sync( m );
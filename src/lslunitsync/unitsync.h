@@ -4,10 +4,16 @@
 #include "mmoptionmodel.h"
 #include "data.h"
 #include "mru_cache.h"
+#include "binarycache.h"
+#include "archivecatalog.h"
+#include "singleflight.h"
+#include "thumbnailatlas.h"
 #include <lslutils/type_forwards.h>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/cstdint.hpp>
+#include <ctime>
 #include <map>
 
 #ifdef HAVE_WX
@@ -21,6 +27,10 @@ struct CachedMapInfo;
 struct SpringMapInfo;
 class UnitsyncLib;
 class WorkerThread;
+class WorkerPool;
+class ArchiveChecksumWorkItem;
+class PrefetchMapWorkItem;
+class MapThumbnailAtlasWorkItem;
 
 #ifdef HAVE_WX
 extern const wxEventType UnitSyncAsyncOperationCompletedEvt;
@@ -39,6 +49,11 @@ public:
 	Unitsync();
 	~Unitsync();
 
+	//! archives done | total, fired from the cache thread while checksums are filled in after load
+	boost::signals2::signal<void (int,int)> sig_ArchiveChecksumProgress;
+	//! maps packed | total, fired from the cache thread while the thumbnail atlas is built
+	boost::signals2::signal<void (int,int)> sig_MapThumbnailAtlasProgress;
+
     StringVector GetModList() const;
 	bool ModExists( const std::string& modname, const std::string& hash = "" ) const;
 	UnitsyncMod GetMod( const std::string& modname );
@@ -57,6 +72,8 @@ public:
 
     StringVector GetSides( const std::string& modname  );
 	UnitsyncImage GetSidePicture( const std::string& modname, const std::string& SideName );
+	//! pictures of all GetSides( \param modname ), read from the mod in one batch; sides without one get an invalid image
+	std::vector<UnitsyncImage> GetSidePictures( const std::string& modname );
 
     bool LoadUnitSyncLib( const std::string& unitsyncloc );
     void FreeUnitSyncLib();
@@ -79,6 +96,15 @@ public:
     UnitsyncImage GetMetalmap( const std::string& mapname, int width, int height );
     /// get heightmap rescaled to given width x height
     UnitsyncImage GetHeightmap( const std::string& mapname, int width, int height );
+    /// get mapinfo and all three native size images, whatever is not cached comes from one unitsync batch
+    void GetAllMapImages( const std::string& mapname, UnitsyncImage& minimap, UnitsyncImage& metalmap, UnitsyncImage& heightmap, MapInfo& info );
+    /** \brief every map's minimap as a \param size thumbnail in one image, plus where each one sits
+     *
+     * Returns what is packed so far and queues a background job for the maps
+     * still missing, see sig_MapThumbnailAtlasProgress. The atlas is kept in the
+     * cache dir, so later sessions start where this one stopped.
+     */
+    ThumbnailAtlas GetMapThumbnailAtlas( int size = 100 );
 
 	bool ReloadUnitSyncLib(  );
 
@@ -90,7 +116,15 @@ public:
 	std::string GetArchivePath( const std::string& name ) const;
 
     /// schedule a map for prefetching
-    void PrefetchMap( const std::string& mapname );
+    /** schedule a map for prefetching, higher priority runs first on whichever pool thread is free next
+     *  \return token for CancelPrefetch, requests for an already queued map share its job,
+     *  which is raised to the highest priority asked for, e.g. once its row became visible
+     */
+    unsigned int PrefetchMap( const std::string& mapname, int priority = 0 );
+    //! drop one prefetch request, the job is cancelled once nobody wants it anymore
+    void CancelPrefetch( unsigned int token );
+    //! drop all queued prefetches, e.g. after the visible map list changed completely
+    void CancelAllPrefetches();
 
     boost::signals2::connection RegisterEvtHandler(const StringSignalSlotType &handler );
     void UnregisterEvtHandler(boost::signals2::connection& conn );
@@ -131,42 +165,102 @@ private:
     StringVector GetMapDeps( const std::string& name );
 
 	UnitsyncImage GetImage( const std::string& modname, const std::string& image_path, bool useWhiteAsTransparent = true ) const;
-	typedef std::map< std::pair<std::string,std::string>, std::string> ShortnameVersionToNameMap;
-	ShortnameVersionToNameMap m_shortname_to_name_map;
-
-    LocalArchivesVector m_maps_list; /// mapname -> hash
-    LocalArchivesVector m_mods_list; /// modname -> hash
+	//! name, hash and shortname lookups, guarded by m_archives_lock
+	mutable ArchiveCatalog m_map_catalog;
+	mutable ArchiveCatalog m_mod_catalog;
+
+    /// the hash maps are filled lazily (see GetArchiveHash) and by the cache thread,
+    /// all access goes through m_archives_lock
+    mutable LocalArchivesVector m_maps_list; /// mapname -> hash
+    mutable LocalArchivesVector m_mods_list; /// modname -> hash
     LocalArchivesVector m_mods_unchained_hash; /// modname -> unchained hash
     LocalArchivesVector m_maps_unchained_hash; /// mapname -> unchained hash
     LocalArchivesVector m_mods_archive_name; /// modname -> archive name
     LocalArchivesVector m_maps_archive_name; /// mapname -> archive name
     StringVector m_map_array; // this vector is CUSTOM SORTED ALPHABETICALLY, DON'T USE TO ACCESS UNITSYNC DIRECTLY
     StringVector m_mod_array; // this vector is CUSTOM SORTED ALPHABETICALLY, DON'T USE TO ACCESS UNITSYNC DIRECTLY
-    StringVector m_unsorted_map_array; // this is because unitsync doesn't have a search map index by name ..
-    StringVector m_unsorted_mod_array; // this isn't necessary but makes things more symmetrical :P
 
     /// caches sett().GetCachePath(), because that method calls back into
     /// susynclib(), there's a good chance main thread blocks on some
     /// WorkerThread operation... cache is invalidated on reload.
     std::string m_cache_path;
+	//! keyed like the KIND_OPTIONS records in m_binary_cache, see _GetGameOptions
 	std::map<std::string, GameOptions> m_map_gameoptions;
 	std::map<std::string, GameOptions> m_game_gameoptions;
 
 	mutable boost::mutex m_lock;
+	mutable boost::mutex m_archives_lock;
+	//! bumped by ClearCache, lets a running checksum job notice it became stale
+	unsigned int m_archives_generation;
+	struct PendingChecksum {
+		std::string name;
+		std::string archivename;
+		bool ismod;
+	};
+	//! archives without a known checksum, worked off by ArchiveChecksumWorkItem
+	std::vector<PendingChecksum> m_pending_checksums;
+
+	//! everything unitsync told us about one archive, persisted across sessions
+	struct ArchiveIndexEntry {
+		ArchiveIndexEntry() : size(0), mtime(0), depsknown(false) {}
+		std::string kind; /// "map" or "mod"
+		std::string name;
+		std::string archivename;
+		std::string path;
+		boost::uintmax_t size;
+		std::time_t mtime;
+		std::string hash;
+		std::string unchainedhash;
+		std::string shortname;
+		std::string version;
+		//! size and mtime of the other archives in the chain, the chained hash is only reused if it still matches
+		std::string chainstamp;
+		bool depsknown;
+		StringVector deps;
+	};
+	typedef std::map<std::string, ArchiveIndexEntry>
+		ArchiveIndex;
+	//! kind + name -> entry, guarded by m_archives_lock
+	mutable ArchiveIndex m_archive_index;
+	//! serialized lane for multi-call unitsync jobs (checksums, reloading)
 	WorkerThread* m_cache_thread;
+	//! async image and mapinfo loads, decoding and rescaling run in parallel here
+	WorkerPool* m_worker_pool;
+
+	//! queued prefetch jobs by map name and the map each request token points to, guarded by m_prefetch_lock
+	std::map<std::string, PrefetchMapWorkItem*> m_prefetch_jobs;
+	std::map<unsigned int, std::string> m_prefetch_tokens;
+	unsigned int m_next_prefetch_token;
+	boost::mutex m_prefetch_lock;
+	void CancelPrefetchJob( PrefetchMapWorkItem* job );
+
+	//! see GetMapThumbnailAtlas, guarded by m_atlas_lock
+	ThumbnailAtlas m_thumbnail_atlas;
+	bool m_atlas_job_queued;
+	boost::mutex m_atlas_lock;
+	std::string GetThumbnailAtlasPath( int size ) const;
+	void BuildMapThumbnailAtlas( int size, unsigned int generation );
 	StringSignalType m_async_ops_complete_sig;
 
     /// this cache facilitates async image fetching (image is stored in cache
     /// in background thread, then main thread gets it from cache)
     MostRecentlyUsedImageCache m_map_image_cache;
-    /// this cache is a real cache, it stores minimaps with max size 100x100
-    MostRecentlyUsedImageCache m_tiny_minimap_cache;
+    /// map images with their halved levels, every scaled request is served from these
+    MostRecentlyUsedImagePyramidCache m_map_pyramid_cache;
 
-	/// this caches MapInfo to facilitate GetMapExAsync
+	/// this caches MapInfo to facilitate GetMapExAsync, image and mapinfo caches use TinyLFU admission
     MostRecentlyUsedMapInfoCache m_mapinfo_cache;
 
     MostRecentlyUsedArrayStringCache m_sides_cache;
 
+	//! map infos, sides and unit lists of all archives in one mapped file
+	BinaryCache m_binary_cache;
+
+	//! concurrent loads of the same image or mapinfo share one unitsync call / decode
+	SingleFlight<std::string, UnitsyncImage> m_image_flights;
+	SingleFlight<std::string, UnitsyncImagePyramid> m_pyramid_flights;
+	SingleFlight<std::string, MapInfo> m_mapinfo_flights;
+
     //! this function returns only the cache path without the file extension,
     //! the extension itself would be added in the function as needed
     std::string GetFileCachePath( const std::string& archivename, bool IsMod, bool usehash = true);
@@ -175,17 +269,56 @@ private:
     void _FreeUnitSyncLib();
 
     MapInfo _GetMapInfoEx( const std::string& mapname );
+    MapInfo _LoadMapInfoEx( const std::string& mapname );
+	//! options of one archive from memory, the binary cache or unitsync, in that order
+	GameOptions _GetGameOptions( const std::string& name, bool ismod );
+	//! fills \param imgs in the order of \param sides, false if a side has no picture at all
+	bool _GetSidePictures( const std::string& modname, const StringVector& sides, std::vector<UnitsyncImage>& imgs );
 
     void PopulateArchiveList();
+	//! returns the archive's checksum, asking unitsync right away if the cache thread hasn't got to it yet
+	std::string GetArchiveHash( const std::string& name, bool ismod ) const;
+	void ComputePendingChecksums( unsigned int generation );
+	std::string GetArchiveIndexPath() const;
+	//! fills \param index keyed by archive path
+	void LoadArchiveIndex( ArchiveIndex& index ) const;
+	void SaveArchiveIndex();
+	/** \brief looks up \param entry's archive on disk and reuses \param previous data if size and mtime still match
+	 *
+	 * The chained hash also covers the other archives in \param chain, it is dropped for
+	 * recomputation if any of them changed. \param stamps caches their fingerprints
+	 * across calls, an empty one marks an archive that can't be trusted.
+	 */
+	bool RestoreIndexEntry( ArchiveIndexEntry& entry, const StringVector& chain, const ArchiveIndex& previous,
+							std::map<std::string, std::string>& stamps ) const;
+	//! path, size and mtime of \param archivename, false if unitsync or the filesystem don't know it
+	bool StatArchive( const std::string& archivename, std::string& path, boost::uintmax_t& size, std::time_t& mtime ) const;
+	//! unitsync index of a map or game, -1 if unknown
+	int GetCatalogIndex( const std::string& name, bool IsMod ) const;
+	bool GetIndexedDeps( const std::string& key, StringVector& deps ) const;
+	void SetIndexedDeps( const std::string& key, const StringVector& deps ) const;
+	friend class ArchiveChecksumWorkItem;
+	friend class PrefetchMapWorkItem;
+	friend class MapThumbnailAtlasWorkItem;
 
 	UnitsyncImage _GetMapImage( const std::string& mapname, const std::string& imagename, UnitsyncImage (UnitsyncLib::*loadMethod)(const std::string&) );
-	UnitsyncImage _GetScaledMapImage( const std::string& mapname, UnitsyncImage (Unitsync::*loadMethod)(const std::string&), int width, int height );
+	UnitsyncImage _LoadMapImage( const std::string& mapname, const std::string& imagename, UnitsyncImage (UnitsyncLib::*loadMethod)(const std::string&) );
+	UnitsyncImagePyramid _GetMapImagePyramid( const std::string& mapname, const std::string& imagename, UnitsyncImage (Unitsync::*loadMethod)(const std::string&) );
+	UnitsyncImagePyramid _LoadMapImagePyramid( const std::string& mapname, const std::string& imagename, UnitsyncImage (Unitsync::*loadMethod)(const std::string&) );
+	UnitsyncImage _GetScaledMapImage( const std::string& mapname, const std::string& imagename, UnitsyncImage (Unitsync::*loadMethod)(const std::string&), int width, int height );
 
 	void _GetMapImageAsync( const std::string& mapname, UnitsyncImage (Unitsync::*loadMethod)(const std::string&) );
 
 	friend Unitsync& usync();
 public:
 	std::string GetNameForShortname( const std::string& shortname, const std::string& version ) const;
+	/** \brief name of the map or game with checksum \param hash, empty if none is known
+	 * Archives the background checksum pass hasn't reached yet are checksummed
+	 * on the spot until one matches, so a miss can be slow before it reported done.
+	 */
+	std::string GetNameForHash( const std::string& hash, bool IsMod ) const;
+	//! correctly cased name of the map or game matching \param name ignoring case, empty if none
+	std::string GetNameNoCase( const std::string& name, bool IsMod ) const;
 private:
 	//! returns an array where each element is a line of the file
 	bool GetCacheFile( const std::string& path, StringVector& ret) const;
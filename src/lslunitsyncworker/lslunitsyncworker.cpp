@@ -0,0 +1,53 @@
+#include <lslunitsync/c_api.h>
+#include <lslunitsync/processpool.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+// stdout may be used by unitsync itself, everything we have to say goes to stderr
+static void log(const char* prefix, const char* format, va_list args)
+{
+	fprintf(stderr, "lsl-unitsync-worker: %s", prefix);
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+}
+
+void lsllogerror(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	log("error: ", format, args);
+	va_end(args);
+}
+
+void lsllogwarning(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	log("warning: ", format, args);
+	va_end(args);
+}
+
+void lsllogdebug(const char* /*format*/, ...)
+{
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <unitsync path> <socket fd>\n", argv[0]);
+		fprintf(stderr, "Started by LSL::UnitsyncProcessPool, not meant to be run by hand.\n");
+		return 1;
+	}
+	try {
+		LSL::susynclib().Load(argv[1]);
+	} catch (std::exception& e) {
+		fprintf(stderr, "lsl-unitsync-worker: %s\n", e.what());
+		return 1;
+	}
+	const int ret = LSL::RunUnitsyncWorker(atoi(argv[2]));
+	LSL::susynclib().Unload();
+	return ret;
+}
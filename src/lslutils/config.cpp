@@ -12,7 +12,9 @@ namespace Util {
 Config::Config():
 	Cache("cache"),
 	CurrentUsedUnitSync("unitsync"),
-	CurrentUsedSpringBinary("spring")
+	CurrentUsedSpringBinary("spring"),
+	ImageCacheFormat("raw"),
+	WorkerThreadCount(0)
 {
 }
 
@@ -52,5 +54,25 @@ void Config::ConfigurePaths(const std::string& Cache, const std::string& Current
 	this->CurrentUsedSpringBinary = CurrentUsedSpringBinary;
 }
 
+std::string Config::GetImageCacheFormat() const
+{
+	return ImageCacheFormat;
+}
+
+void Config::SetImageCacheFormat(const std::string& format)
+{
+	ImageCacheFormat = format;
+}
+
+size_t Config::GetWorkerThreadCount() const
+{
+	return WorkerThreadCount;
+}
+
+void Config::SetWorkerThreadCount(size_t count)
+{
+	WorkerThreadCount = count;
+}
+
 } // namespace Util
 }// namespace LSL {
@@ -31,12 +31,20 @@ private:
 	std::string Cache;
 	std::string CurrentUsedUnitSync;
 	std::string CurrentUsedSpringBinary;
+	std::string ImageCacheFormat;
+	size_t WorkerThreadCount;
 
 public:
 	std::string GetCachePath() const;
 	std::string GetCurrentUsedUnitSync() const;
 	std::string GetCurrentUsedSpringBinary() const;
 	void ConfigurePaths(const std::string& Cache, const std::string& CurrentUsedUnitSync, const std::string& CurrentUsedSpringBinary);
+	//! how map images are kept in the cache dir: "raw" (default) pixel dumps, loaded with a single read, or "png"
+	std::string GetImageCacheFormat() const;
+	void SetImageCacheFormat(const std::string& format);
+	//! threads decoding and rescaling map images, 0 (default) uses one per hardware thread; read when usync() is first used
+	size_t GetWorkerThreadCount() const;
+	void SetWorkerThreadCount(size_t count);
 	STR_DUMMY( GetMyInternalUdpSourcePort )
 	INT_DUMMY( GetClientPort )
 
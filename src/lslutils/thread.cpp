@@ -1,20 +1,17 @@
 #include "thread.h"
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <lslutils/logging.h>
 
-namespace
+namespace LSL {
+
+bool WorkItemQueue::RunsAfter( const WorkItem* a, const WorkItem* b )
 {
-	struct WorkItemCompare
-	{
-        bool operator()( const LSL::WorkItem* a, const LSL::WorkItem* b )
-		{
-			return a->GetPriority() < b->GetPriority();
-		}
-	};
+	if ( a->m_priority != b->m_priority )
+		return a->m_priority < b->m_priority;
+	return a->m_sequence > b->m_sequence;
 }
 
-namespace LSL {
-
 bool WorkItem::Cancel()
 {
     LslDebug( "cancelling WorkItem %p", this );
@@ -22,13 +19,74 @@ bool WorkItem::Cancel()
 	return m_queue->Remove( this );
 }
 
+bool WorkItem::SetPriority( int priority )
+{
+	if ( m_queue == NULL ) {
+		m_priority = priority;
+		return false;
+	}
+	return m_queue->Reprioritize( this, priority );
+}
+
+void WorkItemQueue::Place( size_t index, WorkItem* item )
+{
+	m_queue[index] = item;
+	item->m_heapIndex = index;
+}
+
+void WorkItemQueue::SiftUp( size_t index )
+{
+	WorkItem* item = m_queue[index];
+	while ( index > 0 ) {
+		const size_t parent = ( index - 1 ) / 2;
+		if ( !RunsAfter( m_queue[parent], item ) )
+			break;
+		Place( index, m_queue[parent] );
+		index = parent;
+	}
+	Place( index, item );
+}
+
+void WorkItemQueue::SiftDown( size_t index )
+{
+	WorkItem* item = m_queue[index];
+	const size_t size = m_queue.size();
+	while ( true ) {
+		size_t child = 2 * index + 1;
+		if ( child >= size )
+			break;
+		if ( child + 1 < size && RunsAfter( m_queue[child], m_queue[child + 1] ) )
+			++child;
+		if ( !RunsAfter( item, m_queue[child] ) )
+			break;
+		Place( index, m_queue[child] );
+		index = child;
+	}
+	Place( index, item );
+}
+
+WorkItem* WorkItemQueue::RemoveAt( size_t index )
+{
+	WorkItem* item = m_queue[index];
+	WorkItem* last = m_queue.back();
+	m_queue.pop_back();
+	if ( item != last ) {
+		Place( index, last );
+		SiftDown( index );
+		SiftUp( last->m_heapIndex );
+	}
+	item->m_queue = NULL;
+	return item;
+}
+
 void WorkItemQueue::Push( WorkItem* item )
 {
 	if ( item == NULL ) return;
     boost::mutex::scoped_lock lock( m_lock );
-	m_queue.push_back( item );
-	std::push_heap( m_queue.begin(), m_queue.end(), WorkItemCompare() );
+	item->m_sequence = m_sequence++;
 	item->m_queue = this;
+	m_queue.push_back( item );
+	SiftUp( m_queue.size() - 1 );
     m_cond.notify_one();
 }
 
@@ -36,29 +94,30 @@ WorkItem* WorkItemQueue::Pop()
 {
     boost::mutex::scoped_lock lock( m_lock );
 	if ( m_queue.empty() ) return NULL;
-	WorkItem* item = m_queue.front();
-	std::pop_heap( m_queue.begin(), m_queue.end(), WorkItemCompare() );
-	m_queue.pop_back();
-	item->m_queue = NULL;
-	return item;
+	return RemoveAt( 0 );
 }
 
 bool WorkItemQueue::Remove( WorkItem* item )
 {
     boost::mutex::scoped_lock lock( m_lock );
-	if ( m_queue.empty() ) return false;
-	// WARNING: this destroys the heap...
-	std::vector<WorkItem*>::iterator new_end =
-    std::remove( m_queue.begin(), m_queue.end(), item );
 	// did a WorkerThread process the item just before we got here?
-	if ( new_end == m_queue.end() ) return false;
-	m_queue.erase( new_end, m_queue.end() );
-	// recreate the heap...
-	std::make_heap( m_queue.begin(), m_queue.end(), WorkItemCompare() );
-	item->m_queue = NULL;
+	if ( item->m_queue != this || item->m_heapIndex >= m_queue.size() || m_queue[item->m_heapIndex] != item )
+		return false;
+	RemoveAt( item->m_heapIndex );
     return true;
 }
 
+bool WorkItemQueue::Reprioritize( WorkItem* item, int priority )
+{
+    boost::mutex::scoped_lock lock( m_lock );
+	if ( item->m_queue != this || item->m_heapIndex >= m_queue.size() || m_queue[item->m_heapIndex] != item )
+		return false;
+	item->m_priority = priority;
+	SiftUp( item->m_heapIndex );
+	SiftDown( item->m_heapIndex );
+	return true;
+}
+
 void WorkItemQueue::Cancel()
 {
     m_dying = true;
@@ -94,7 +153,8 @@ WorkerThread::~WorkerThread()
 }
 
 WorkItemQueue::WorkItemQueue()
-    : m_dying(false)
+    : m_sequence(0),
+    m_dying(false)
 {
 }
 
@@ -109,17 +169,8 @@ void WorkItemQueue::Process()
         WorkItem* item = NULL;
         boost::unique_lock<boost::mutex> lock(m_mutex);
         while ( (!m_dying) && (item = Pop()) ) {
-            try {
-//                LslDebug( "running WorkItem %p, prio = %d", item, item->m_priority );
-                item->Run();
-            }
-            catch ( std::exception& e ) {
-                // better eat all exceptions thrown by WorkItem::Run(),
-                // don't want to let the thread die on a single faulty WorkItem.
-                LslDebug( "WorkerThread caught exception thrown by WorkItem::Run -- %s", e.what() );
-            } catch ( ... ) {
-                LslDebug( "WorkerThread caught exception thrown by WorkItem::Run");
-            }
+//            LslDebug( "running WorkItem %p, prio = %d", item, item->m_priority );
+            Execute( item );
             CleanupWorkItem( item );
         }
         // cleanup leftover WorkItems
@@ -132,6 +183,20 @@ void WorkItemQueue::Process()
     }
 }
 
+void WorkItemQueue::Execute( WorkItem* item )
+{
+	try {
+		item->Run();
+	}
+	catch ( std::exception& e ) {
+		// better eat all exceptions thrown by WorkItem::Run(),
+		// don't want to let the thread die on a single faulty WorkItem.
+		LslDebug( "WorkerThread caught exception thrown by WorkItem::Run -- %s", e.what() );
+	} catch ( ... ) {
+		LslDebug( "WorkerThread caught exception thrown by WorkItem::Run");
+	}
+}
+
 void WorkItemQueue::CleanupWorkItem( WorkItem* item )
 {
 	if ( item->m_toBeDeleted ) {
@@ -146,4 +211,71 @@ void WorkItemQueue::CleanupWorkItem( WorkItem* item )
 	}
 }
 
+WorkerPool::WorkerPool( size_t threads )
+	: m_thread_count(threads),
+	m_epoch(0),
+	m_dying(false)
+{
+	if ( m_thread_count == 0 )
+		m_thread_count = std::max( 1u, boost::thread::hardware_concurrency() );
+	for ( size_t i = 0; i < m_thread_count; ++i )
+		m_threads.create_thread( boost::bind( &WorkerPool::Process, this ) );
+}
+
+WorkerPool::~WorkerPool()
+{
+	Wait();
+}
+
+void WorkerPool::DoWork( WorkItem* item, int priority, bool toBeDeleted )
+{
+	item->m_priority = priority;
+	item->m_toBeDeleted = toBeDeleted;
+	m_queue.Push( item );
+	{
+		boost::mutex::scoped_lock lock( m_mutex );
+		++m_epoch;
+	}
+	m_cond.notify_one();
+}
+
+void WorkerPool::Wait()
+{
+	{
+		boost::mutex::scoped_lock lock( m_mutex );
+		if ( m_dying )
+			return;
+		m_dying = true;
+	}
+	m_cond.notify_all();
+	m_threads.join_all();
+	WorkItem* item;
+	while ( ( item = m_queue.Pop() ) != NULL )
+		m_queue.CleanupWorkItem( item );
+}
+
+void WorkerPool::Process()
+{
+	while ( true ) {
+		unsigned long epoch;
+		{
+			boost::mutex::scoped_lock lock( m_mutex );
+			if ( m_dying )
+				return;
+			epoch = m_epoch;
+		}
+		// the queue lock is only held for the pop, the items run in parallel
+		WorkItem* item = m_queue.Pop();
+		if ( item != NULL ) {
+			WorkItemQueue::Execute( item );
+			m_queue.CleanupWorkItem( item );
+			continue;
+		}
+		// queue empty, sleep until something was pushed after our pop
+		boost::mutex::scoped_lock lock( m_mutex );
+		while ( !m_dying && m_epoch == epoch )
+			m_cond.wait( lock );
+	}
+}
+
 } // namespace LSL
@@ -19,7 +19,7 @@ class WorkItem : public boost::noncopyable
   public:
 
     /** @brief Construct a new WorkItem */
-    WorkItem() : m_priority(0), m_toBeDeleted(true), m_queue(NULL) {}
+    WorkItem() : m_priority(0), m_toBeDeleted(true), m_queue(NULL), m_heapIndex(0), m_sequence(0) {}
 
     /** @brief Destructor */
     virtual ~WorkItem() {}
@@ -31,15 +31,22 @@ class WorkItem : public boost::noncopyable
         @return true if it was removed, false otherwise */
     bool Cancel();
 
+    /** @brief Move a queued WorkItem up or down
+        @return true if it was still queued, false otherwise */
+    bool SetPriority(int priority);
+
     int GetPriority() const { return m_priority; }
 
   private:
     int m_priority;              ///< Priority of item, highest is run first
     volatile bool m_toBeDeleted; ///< Should this item be deleted after it has run?
     WorkItemQueue* m_queue;
+    size_t m_heapIndex;          ///< position in m_queue->m_queue, valid while queued
+    unsigned long m_sequence;    ///< push order, items of equal priority run first in first out
 
     friend class WorkItemQueue;
     friend class WorkerThread;
+    friend class WorkerPool;
 };
 
 
@@ -58,6 +65,9 @@ class WorkItemQueue : public boost::noncopyable
     /** @brief Remove a specific workitem from the queue
         @return true if it was removed, false otherwise */
     bool Remove(WorkItem* item);
+    /** @brief Change the priority of a queued workitem, O(log n)
+        @return true if it was queued, false otherwise */
+    bool Reprioritize(WorkItem* item, int priority);
     //! dangerous
     void Cancel();
 
@@ -68,13 +78,23 @@ class WorkItemQueue : public boost::noncopyable
 
   private:
     friend class boost::thread;
+    friend class WorkerPool;
+    //! runs \param item, eating whatever it throws
+    static void Execute(WorkItem* item);
     void CleanupWorkItem(WorkItem* item);
+    //! heap maintenance, items track their own index so removal needs no search
+    static bool RunsAfter(const WorkItem* a, const WorkItem* b);
+    void SiftUp(size_t index);
+    void SiftDown(size_t index);
+    void Place(size_t index, WorkItem* item);
+    WorkItem* RemoveAt(size_t index);
 
     boost::mutex m_mutex;
     boost::mutex m_lock;
     boost::condition_variable m_cond;
     // this is a priority queue maintained as a heap stored in a vector :o
     std::vector<WorkItem*> m_queue;
+    unsigned long m_sequence;
     bool m_dying;
 };
 
@@ -96,6 +116,37 @@ class WorkerThread : public boost::noncopyable
     boost::mutex m_mutex;
 };
 
+
+/** @brief Several threads sharing WorkItems
+ *
+ * All threads take from one priority queue, so the highest priority item
+ * queued is always the next one started, whichever thread is free. Items
+ * must not depend on running in order or alone, work that does belongs on
+ * a WorkerThread.
+ */
+class WorkerPool : public boost::noncopyable
+{
+  public:
+    /** @param threads number of threads, 0 picks the hardware concurrency */
+    explicit WorkerPool(size_t threads = 0);
+    ~WorkerPool();
+    /** @brief Adds a new WorkItem to the queue */
+    void DoWork(WorkItem* item, int priority = 0, bool toBeDeleted = true);
+    //! stops taking new items and joins all threads, queued items are dropped
+    void Wait();
+    size_t GetThreadCount() const { return m_thread_count; }
+  private:
+    void Process();
+
+    WorkItemQueue m_queue;
+    size_t m_thread_count;
+    boost::thread_group m_threads;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    unsigned long m_epoch; ///< bumped on every push, lets idle threads sleep without missing one
+    bool m_dying;
+};
+
 } // namespace LSL
 
 /**
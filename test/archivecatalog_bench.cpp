@@ -0,0 +1,116 @@
+// lookups in a 5000 map ArchiveCatalog against the linear scans it replaced
+
+#include <lslunitsync/archivecatalog.h>
+#include <lslutils/conversion.h>
+#include <lslutils/misc.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace {
+
+typedef std::chrono::steady_clock
+	Clock;
+
+const int MAP_COUNT = 5000;
+const int LOOKUPS = 20000;
+
+//! average microseconds per call of \param lookup over \param keys
+template < class Lookup >
+double Measure( const std::vector<std::string>& keys, Lookup lookup, size_t& found )
+{
+	const Clock::time_point start = Clock::now();
+	for ( int i = 0; i < LOOKUPS; ++i ) {
+		if ( lookup( keys[i % keys.size()] ) )
+			++found;
+	}
+	const double us = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - start ).count() / 1000.0;
+	return us / LOOKUPS;
+}
+
+void Report( const char* what, double linear, double catalog )
+{
+	std::cout << boost::format( "%-16s %10.3f us %10.3f us %8.0fx\n" ) % what % linear % catalog % ( linear / catalog );
+}
+
+} // namespace
+
+int main()
+{
+	using namespace LSL;
+	// unitsync reports archives in filesystem order, so the scan has no useful ordering
+	std::vector<std::string> names, hashes;
+	for ( int i = 0; i < MAP_COUNT; ++i ) {
+		names.push_back( ( boost::format( "Map_%04d_%s v%d" ) % ( ( i * 7919 ) % MAP_COUNT ) % ( i % 2 ? "Dry" : "Wet" ) % ( i % 5 ) ).str() );
+		hashes.push_back( Util::ToString( 1000000007u * unsigned( i + 1 ) ) );
+	}
+	ArchiveCatalog catalog;
+	for ( int i = 0; i < MAP_COUNT; ++i )
+		LSL_CHECK( catalog.Add( i, names[i], hashes[i] ) );
+
+	std::vector<std::string> by_name, by_lower, by_hash;
+	srand( 42 );
+	for ( int i = 0; i < 1000; ++i ) {
+		const int n = rand() % MAP_COUNT;
+		by_name.push_back( names[n] );
+		by_lower.push_back( boost::algorithm::to_lower_copy( names[n] ) );
+		by_hash.push_back( hashes[n] );
+	}
+
+	size_t linear_found = 0, catalog_found = 0;
+	std::cout << boost::format( "%d maps, %d lookups each\n%-16s %13s %13s %9s\n" )
+		% MAP_COUNT % LOOKUPS % "" % "linear" % "catalog" % "speedup";
+
+	Report( "name",
+		Measure( by_name, [&]( const std::string& key ) { return Util::IndexInSequence( names, key ) != lslNotFound; }, linear_found ),
+		Measure( by_name, [&]( const std::string& key ) { return catalog.IndexOf( key ) >= 0; }, catalog_found ) );
+	Report( "name no case",
+		Measure( by_lower, [&]( const std::string& key ) {
+			for ( const std::string& name: names )
+				if ( boost::algorithm::to_lower_copy( name ) == key )
+					return true;
+			return false;
+		}, linear_found ),
+		Measure( by_lower, [&]( const std::string& key ) { return !catalog.FindNoCase( key ).empty(); }, catalog_found ) );
+	Report( "hash",
+		Measure( by_hash, [&]( const std::string& key ) { return Util::IndexInSequence( hashes, key ) != lslNotFound; }, linear_found ),
+		Measure( by_hash, [&]( const std::string& key ) { return !catalog.NameForHash( key ).empty(); }, catalog_found ) );
+
+	// every key exists, both sides have to find all of them
+	LSL_CHECK( linear_found == size_t( 3 * LOOKUPS ) );
+	LSL_CHECK( catalog_found == linear_found );
+	return 0;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
@@ -0,0 +1,267 @@
+// BinaryCache: round trip, rejection of damaged files and merging on Flush
+
+#include <lslunitsync/binarycache.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "common.h"
+
+namespace {
+
+using LSL::BinaryCache;
+using LSL::MapInfo;
+using LSL::StringVector;
+
+MapInfo MakeInfo( int seed )
+{
+	MapInfo info;
+	info.description = "description of map " + std::to_string( seed );
+	info.author = seed % 2 ? "" : "author " + std::to_string( seed );
+	info.tidalStrength = seed;
+	info.gravity = 100 + seed;
+	info.maxMetal = 0.5f * seed;
+	info.extractorRadius = 2 * seed;
+	info.minWind = seed % 7;
+	info.maxWind = 20 + seed % 7;
+	info.width = 8 + seed % 16;
+	info.height = 16 - seed % 8;
+	for ( int i = 0; i < seed % 5; ++i ) {
+		LSL::StartPos pos;
+		pos.x = seed * 10 + i;
+		pos.y = -i;
+		info.positions.push_back( pos );
+	}
+	return info;
+}
+
+bool SameInfo( const MapInfo& a, const MapInfo& b )
+{
+	if ( a.positions.size() != b.positions.size() )
+		return false;
+	for ( size_t i = 0; i < a.positions.size(); ++i ) {
+		if ( a.positions[i].x != b.positions[i].x || a.positions[i].y != b.positions[i].y )
+			return false;
+	}
+	return a.description == b.description && a.author == b.author && a.tidalStrength == b.tidalStrength
+		&& a.gravity == b.gravity && a.maxMetal == b.maxMetal && a.extractorRadius == b.extractorRadius
+		&& a.minWind == b.minWind && a.maxWind == b.maxWind && a.width == b.width && a.height == b.height;
+}
+
+StringVector MakeList( int seed )
+{
+	StringVector list;
+	for ( int i = 0; i < seed % 4; ++i )
+		list.push_back( "item " + std::to_string( seed ) + "/" + std::to_string( i ) );
+	if ( seed % 3 == 0 )
+		list.push_back( "" ); // empty strings must survive too
+	return list;
+}
+
+std::string ReadFile( const std::string& path )
+{
+	std::ifstream in( path.c_str(), std::ios::binary );
+	return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+}
+
+void WriteFile( const std::string& path, const std::string& data )
+{
+	std::ofstream out( path.c_str(), std::ios::binary | std::ios::trunc );
+	out.write( data.data(), data.size() );
+}
+
+boost::uint32_t ReadU32( const std::string& data, size_t offset )
+{
+	boost::uint32_t v;
+	memcpy( &v, data.data() + offset, sizeof(v) );
+	return v;
+}
+
+void WriteU32( std::string& data, size_t offset, boost::uint32_t v )
+{
+	memcpy( &data[offset], &v, sizeof(v) );
+}
+
+const int ENTRIES = 300;
+
+//! a file with ENTRIES map infos and side lists
+void Fill( const std::string& path )
+{
+	boost::filesystem::remove( path );
+	BinaryCache cache( 1000000 );
+	cache.Open( path );
+	for ( int i = 0; i < ENTRIES; ++i ) {
+		cache.SetMapInfo( "map" + std::to_string( i ), MakeInfo( i ) );
+		cache.SetStringList( BinaryCache::KIND_SIDES, "mod" + std::to_string( i ), MakeList( i ) );
+	}
+	LSL_CHECK( cache.PendingCount() == 2 * ENTRIES );
+	LSL_CHECK( cache.Flush() );
+	LSL_CHECK( cache.PendingCount() == 0 );
+	LSL_CHECK( cache.MappedCount() == 2 * ENTRIES );
+}
+
+void TestRoundTrip( const std::string& path )
+{
+	Fill( path );
+	BinaryCache cache;
+	cache.Open( path );
+	LSL_CHECK( cache.MappedCount() == 2 * ENTRIES );
+	for ( int i = 0; i < ENTRIES; ++i ) {
+		MapInfo info;
+		LSL_CHECK( cache.GetMapInfo( "map" + std::to_string( i ), info ) );
+		LSL_CHECK( SameInfo( info, MakeInfo( i ) ) );
+		StringVector list;
+		LSL_CHECK( cache.GetStringList( BinaryCache::KIND_SIDES, "mod" + std::to_string( i ), list ) );
+		LSL_CHECK( list == MakeList( i ) );
+	}
+	// kinds are separate key spaces
+	StringVector list;
+	MapInfo info;
+	LSL_CHECK( !cache.GetStringList( BinaryCache::KIND_UNITS, "mod1", list ) );
+	LSL_CHECK( !cache.GetMapInfo( "mod1", info ) );
+	LSL_CHECK( !cache.GetMapInfo( "map" + std::to_string( ENTRIES ), info ) );
+	LSL_CHECK( !cache.GetMapInfo( "", info ) );
+}
+
+//! \param damage changes the file contents, the cache has to come up empty and usable
+template < class Damage >
+void TestRejected( const std::string& path, const char* what, Damage damage )
+{
+	Fill( path );
+	std::string data = ReadFile( path );
+	damage( data );
+	WriteFile( path, data );
+
+	BinaryCache cache;
+	cache.Open( path );
+	if ( cache.MappedCount() != 0 )
+		throw TestFailedException( std::string( "damaged cache was accepted: " ) + what );
+	MapInfo info;
+	LSL_CHECK( !cache.GetMapInfo( "map1", info ) );
+	// and it is replaced by a good one on the next flush
+	cache.SetMapInfo( "fresh", MakeInfo( 3 ) );
+	LSL_CHECK( cache.Flush() );
+	cache.Close();
+	cache.Open( path );
+	LSL_CHECK( cache.MappedCount() == 1 );
+	LSL_CHECK( cache.GetMapInfo( "fresh", info ) && SameInfo( info, MakeInfo( 3 ) ) );
+}
+
+void TestCorruption( const std::string& path )
+{
+	// header: magic, version, byte order, record count, records offset, ...
+	TestRejected( path, "bad magic", []( std::string& data ) { data[0] = 'X'; } );
+	TestRejected( path, "other version", []( std::string& data ) { WriteU32( data, 4, ReadU32( data, 4 ) + 1 ); } );
+	TestRejected( path, "truncated", []( std::string& data ) { data.resize( data.size() / 2 ); } );
+	TestRejected( path, "shorter than a header", []( std::string& data ) { data.resize( 10 ); } );
+	TestRejected( path, "record count too high", []( std::string& data ) { WriteU32( data, 12, ReadU32( data, 12 ) * 4 ); } );
+	TestRejected( path, "key outside the string table", []( std::string& data ) {
+		const boost::uint32_t records = ReadU32( data, 16 );
+		WriteU32( data, records + 4, 0xFFFFFF00u ); // first record, key offset
+	} );
+	TestRejected( path, "misaligned records", []( std::string& data ) { WriteU32( data, 16, ReadU32( data, 16 ) + 1 ); } );
+}
+
+void TestFlushMerge( const std::string& path )
+{
+	Fill( path );
+	{
+		BinaryCache cache( 1000000 );
+		cache.Open( path );
+		// new entries, one replaced and one of another kind under an existing key
+		cache.SetMapInfo( "map" + std::to_string( ENTRIES ), MakeInfo( ENTRIES ) );
+		cache.SetMapInfo( "map0", MakeInfo( 1000 ) );
+		cache.SetStringList( BinaryCache::KIND_UNITS, "mod1", MakeList( 5 ) );
+		// pending entries are visible before the flush
+		MapInfo info;
+		LSL_CHECK( cache.GetMapInfo( "map0", info ) && SameInfo( info, MakeInfo( 1000 ) ) );
+		LSL_CHECK( cache.PendingCount() == 3 );
+		LSL_CHECK( cache.Flush() );
+		LSL_CHECK( cache.MappedCount() == 2 * ENTRIES + 2 );
+	}
+	BinaryCache cache;
+	cache.Open( path );
+	LSL_CHECK( cache.MappedCount() == 2 * ENTRIES + 2 );
+	MapInfo info;
+	LSL_CHECK( cache.GetMapInfo( "map0", info ) && SameInfo( info, MakeInfo( 1000 ) ) );
+	LSL_CHECK( cache.GetMapInfo( "map" + std::to_string( ENTRIES ), info ) && SameInfo( info, MakeInfo( ENTRIES ) ) );
+	for ( int i = 1; i < ENTRIES; ++i )
+		LSL_CHECK( cache.GetMapInfo( "map" + std::to_string( i ), info ) && SameInfo( info, MakeInfo( i ) ) );
+	StringVector list;
+	LSL_CHECK( cache.GetStringList( BinaryCache::KIND_UNITS, "mod1", list ) && list == MakeList( 5 ) );
+	LSL_CHECK( cache.GetStringList( BinaryCache::KIND_SIDES, "mod1", list ) && list == MakeList( 1 ) );
+	LSL_CHECK( !boost::filesystem::exists( path + ".tmp" ) );
+}
+
+void TestAutomaticFlush( const std::string& path )
+{
+	boost::filesystem::remove( path );
+	BinaryCache cache( 16 );
+	cache.Open( path );
+	size_t rewrites = 0, mapped = 0;
+	for ( int i = 0; i < 1000; ++i ) {
+		cache.SetStringList( BinaryCache::KIND_SIDES, std::to_string( i ), MakeList( i ) );
+		if ( cache.MappedCount() != mapped ) {
+			++rewrites;
+			mapped = cache.MappedCount();
+		}
+	}
+	// the threshold grows with the file, so rewrites stay logarithmic
+	LSL_CHECK( rewrites > 0 && rewrites <= 8 );
+	cache.Close(); // flushes the rest
+	cache.Open( path );
+	LSL_CHECK( cache.MappedCount() == 1000 );
+}
+
+} // namespace
+
+int main()
+{
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "lsl-binarycache-%%%%%%%%" );
+	boost::filesystem::create_directories( dir );
+	const std::string path = ( dir / "unitsync.cache" ).string();
+	int ret = 0;
+	try {
+		TestRoundTrip( path );
+		TestCorruption( path );
+		TestFlushMerge( path );
+		TestAutomaticFlush( path );
+	} catch ( std::exception& e ) {
+		std::cerr << e.what() << std::endl;
+		ret = 1;
+	}
+	boost::system::error_code ec;
+	boost::filesystem::remove_all( dir, ec );
+	return ret;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
@@ -0,0 +1,188 @@
+// TinyLfuPolicy admission and what it means for MostRecentlyUsedCache
+
+#include <lslunitsync/mru_cache.h>
+
+#include <iostream>
+#include <string>
+
+#include "common.h"
+
+namespace {
+
+using LSL::TinyLfuPolicy;
+using LSL::LruPolicy;
+using LSL::MostRecentlyUsedCache;
+using LSL::CacheItemBytes;
+using LSL::CacheItemCount;
+
+void TestFrequency()
+{
+	TinyLfuPolicy policy;
+	policy.Init( 100 );
+	const size_t hot = 12345, cold = 67890;
+	LSL_CHECK( policy.Frequency( hot ) == 0 );
+	for ( int i = 0; i < 3; ++i )
+		policy.Record( hot );
+	// count-min never underestimates
+	LSL_CHECK( policy.Frequency( hot ) >= 3 );
+	LSL_CHECK( policy.Frequency( cold ) < policy.Frequency( hot ) );
+	// counters are 4 bit
+	for ( int i = 0; i < 100; ++i )
+		policy.Record( hot );
+	LSL_CHECK( policy.Frequency( hot ) == 15 );
+	policy.Init( 100 );
+	LSL_CHECK( policy.Frequency( hot ) == 0 );
+}
+
+void TestAdmit()
+{
+	TinyLfuPolicy policy;
+	policy.Init( 100 );
+	const size_t hot = 1, warm = 2, cold = 3;
+	for ( int i = 0; i < 5; ++i )
+		policy.Record( hot );
+	policy.Record( warm );
+	LSL_CHECK( policy.Admit( hot, warm ) );
+	LSL_CHECK( policy.Admit( warm, cold ) );
+	LSL_CHECK( !policy.Admit( warm, hot ) );
+	LSL_CHECK( !policy.Admit( cold, warm ) );
+	// ties keep the victim, a scan of equally cold items must not churn the main segment
+	LSL_CHECK( !policy.Admit( warm, warm ) );
+	LSL_CHECK( !policy.Admit( cold, 4 ) );
+
+	LruPolicy lru;
+	LSL_CHECK( lru.Admit( cold, hot ) );
+}
+
+void TestAging()
+{
+	TinyLfuPolicy policy;
+	policy.Init( 100 );
+	const size_t hot = 7;
+	for ( int i = 0; i < 15; ++i )
+		policy.Record( hot );
+	LSL_CHECK( policy.Frequency( hot ) == 15 );
+	// a long stream of other items, old popularity has to fade
+	for ( size_t i = 0; i < 200000; ++i )
+		policy.Record( 1000 + i );
+	LSL_CHECK( policy.Frequency( hot ) < 15 );
+	// and the sketch must not fill up, a fresh item still counts from almost nothing
+	LSL_CHECK( policy.Frequency( 5000000 ) < 15 );
+	for ( int i = 0; i < 15; ++i )
+		policy.Record( hot );
+	LSL_CHECK( policy.Admit( hot, 5000000 ) );
+}
+
+//! value with a byte footprint, for CacheItemBytes
+struct Blob
+{
+	Blob( size_t b = 0 ) : bytes( b ) {}
+	size_t MemoryUsage() const { return bytes; }
+	size_t bytes;
+};
+
+std::string Key( const char* prefix, int i )
+{
+	return prefix + std::to_string( i );
+}
+
+//! hits among \param count keys after a warm up of the same keys and a scan over many others
+template < class TPolicy >
+int HotHitsAfterScan( int count )
+{
+	MostRecentlyUsedCache<std::string, int, CacheItemCount, TPolicy> cache( 100, "test", 1 );
+	int value = 0;
+	for ( int round = 0; round < 4; ++round ) {
+		for ( int i = 0; i < count; ++i ) {
+			if ( !cache.TryGet( Key( "hot", i ), value ) )
+				cache.Add( Key( "hot", i ), i );
+		}
+	}
+	for ( int i = 0; i < 1000; ++i ) {
+		if ( !cache.TryGet( Key( "scan", i ), value ) )
+			cache.Add( Key( "scan", i ), i );
+	}
+	int hits = 0;
+	for ( int i = 0; i < count; ++i ) {
+		if ( cache.TryGet( Key( "hot", i ), value ) && value == i )
+			++hits;
+	}
+	LSL_CHECK( cache.Used() <= cache.Capacity() );
+	return hits;
+}
+
+void TestScanResistance()
+{
+	LSL_CHECK( HotHitsAfterScan<LruPolicy>( 50 ) == 0 );
+	LSL_CHECK( HotHitsAfterScan<TinyLfuPolicy>( 50 ) >= 45 );
+}
+
+/** byte budgets with items far bigger than one percent of the shard: the newest
+ * items have to survive in the window instead of losing the duel on arrival
+ */
+void TestWindowFloor()
+{
+	const size_t item = 300 * 1024;
+	MostRecentlyUsedCache<std::string, Blob, CacheItemBytes, TinyLfuPolicy> cache( 100 * item, "test", 1 );
+	Blob blob;
+	for ( int round = 0; round < 3; ++round ) {
+		for ( int i = 0; i < 80; ++i ) {
+			if ( !cache.TryGet( Key( "hot", i ), blob ) )
+				cache.Add( Key( "hot", i ), Blob( item ) );
+		}
+	}
+	// scrolling through a long map list
+	for ( int i = 0; i < 200; ++i ) {
+		if ( !cache.TryGet( Key( "scroll", i ), blob ) )
+			cache.Add( Key( "scroll", i ), Blob( item ) );
+	}
+	for ( int i = 197; i < 200; ++i )
+		LSL_CHECK( cache.TryGet( Key( "scroll", i ), blob ) && blob.bytes == item );
+	int hot_hits = 0;
+	for ( int i = 0; i < 80; ++i )
+		hot_hits += cache.TryGet( Key( "hot", i ), blob ) ? 1 : 0;
+	LSL_CHECK( hot_hits >= 70 );
+	LSL_CHECK( cache.Used() <= cache.Capacity() );
+}
+
+} // namespace
+
+int main()
+{
+	try {
+		TestFrequency();
+		TestAdmit();
+		TestAging();
+		TestScanResistance();
+		TestWindowFloor();
+	} catch ( std::exception& e ) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
@@ -2,10 +2,17 @@
 #define LSL_TESTS_COMMON_H
 
 #include <exception>
+#include <stdexcept>
 #include <string>
 
 struct TestFailedException : public std::logic_error {
     TestFailedException(std::string msg):std::logic_error(msg) {}
 };
 
+#define LSL_TEST_STR2(x) #x
+#define LSL_TEST_STR(x) LSL_TEST_STR2(x)
+//! throws TestFailedException naming the failed expression and where it is
+#define LSL_CHECK(cond) \
+    do { if (!(cond)) throw TestFailedException( __FILE__ ":" LSL_TEST_STR(__LINE__) ": " #cond ); } while (0)
+
 #endif // LSL_TESTS_COMMON_H
@@ -0,0 +1,270 @@
+// RAW images and thumbnail atlases on disk: round trips and damaged files
+
+#include <lslunitsync/image.h>
+#include <lslunitsync/thumbnailatlas.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace {
+
+using LSL::UnitsyncImage;
+using LSL::ThumbnailAtlas;
+
+std::string ReadFile( const std::string& path )
+{
+	std::ifstream in( path.c_str(), std::ios::binary );
+	return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+}
+
+void WriteFile( const std::string& path, const std::string& data )
+{
+	std::ofstream out( path.c_str(), std::ios::binary | std::ios::trunc );
+	out.write( data.data(), data.size() );
+}
+
+void WriteU32( std::string& data, size_t offset, boost::uint32_t v )
+{
+	memcpy( &data[offset], &v, sizeof(v) );
+}
+
+//! RAW header: 8 byte magic, then width, height and spectrum
+const size_t RAW_HEADER = 24;
+
+//! a minimap of random RGB565 pixels, small enough not to be scaled down
+UnitsyncImage RandomImage( int width, int height )
+{
+	std::vector<unsigned short> data( size_t( width ) * height );
+	for ( size_t i = 0; i < data.size(); ++i )
+		data[i] = static_cast<unsigned short>( rand() );
+	return UnitsyncImage::FromMinimapData( &data[0], width, height, 1024, 1024 );
+}
+
+//! pixels are compared by writing both images again, there is no accessor for them
+bool SameRawFile( const UnitsyncImage& a, const UnitsyncImage& b, const std::string& dir )
+{
+	const std::string pa = dir + "/a.raw", pb = dir + "/b.raw";
+	return a.SaveRaw( pa ) && b.SaveRaw( pb ) && ReadFile( pa ) == ReadFile( pb );
+}
+
+void TestRawRoundTrip( const std::string& dir )
+{
+	const std::string path = dir + "/image.raw";
+	// odd sizes, rows are not padded
+	UnitsyncImage img = RandomImage( 37, 23 );
+	LSL_CHECK( img.GetWidth() == 37 && img.GetHeight() == 23 );
+	LSL_CHECK( img.SaveRaw( path ) );
+	LSL_CHECK( ReadFile( path ).size() == RAW_HEADER + 37 * 23 * 3 );
+	UnitsyncImage loaded;
+	LSL_CHECK( loaded.LoadRaw( path ) );
+	LSL_CHECK( loaded.GetWidth() == 37 && loaded.GetHeight() == 23 );
+	LSL_CHECK( SameRawFile( img, loaded, dir ) );
+
+	// with alpha
+	img.MakeTransparent();
+	LSL_CHECK( img.SaveRaw( path ) );
+	LSL_CHECK( ReadFile( path ).size() == RAW_HEADER + 37 * 23 * 4 );
+	LSL_CHECK( loaded.LoadRaw( path ) );
+	LSL_CHECK( SameRawFile( img, loaded, dir ) );
+}
+
+//! \param damage changes a good file, LoadRaw has to fail and leave the image alone
+template < class Damage >
+void TestRawRejected( const std::string& dir, const char* what, Damage damage )
+{
+	const std::string path = dir + "/damaged.raw";
+	LSL_CHECK( RandomImage( 9, 5 ).SaveRaw( path ) );
+	std::string data = ReadFile( path );
+	damage( data );
+	WriteFile( path, data );
+	UnitsyncImage img = RandomImage( 3, 2 );
+	if ( img.LoadRaw( path ) )
+		throw TestFailedException( std::string( "damaged raw image was accepted: " ) + what );
+	LSL_CHECK( img.GetWidth() == 3 && img.GetHeight() == 2 );
+}
+
+void TestRawDamaged( const std::string& dir )
+{
+	UnitsyncImage img;
+	LSL_CHECK( !img.LoadRaw( dir + "/missing.raw" ) );
+	TestRawRejected( dir, "bad magic", []( std::string& data ) { data[1] ^= 1; } );
+	TestRawRejected( dir, "truncated", []( std::string& data ) { data.resize( data.size() - 1 ); } );
+	TestRawRejected( dir, "shorter than a header", []( std::string& data ) { data.resize( RAW_HEADER - 4 ); } );
+	TestRawRejected( dir, "trailing garbage", []( std::string& data ) { data += "x"; } );
+	TestRawRejected( dir, "zero width", []( std::string& data ) { WriteU32( data, 8, 0 ); } );
+	TestRawRejected( dir, "too high", []( std::string& data ) { WriteU32( data, 12, UnitsyncImage::RAW_MAX_SIDE + 1 ); } );
+	TestRawRejected( dir, "five channels", []( std::string& data ) { WriteU32( data, 16, 5 ); } );
+
+	// and it does not write what it would refuse to read
+	const std::string path = dir + "/huge.raw";
+	LSL_CHECK( !UnitsyncImage( UnitsyncImage::RAW_MAX_SIDE + 1, 1 ).SaveRaw( path ) );
+	LSL_CHECK( !boost::filesystem::exists( path ) );
+	LSL_CHECK( !UnitsyncImage().SaveRaw( path ) );
+	LSL_CHECK( UnitsyncImage( UnitsyncImage::RAW_MAX_SIDE, 1 ).SaveRaw( path ) );
+	LSL_CHECK( img.LoadRaw( path ) && img.GetWidth() == UnitsyncImage::RAW_MAX_SIDE );
+}
+
+const int CELL = 16;
+
+//! thumbnails smaller than, equal to and bigger than a cell, plus one missing
+ThumbnailAtlas MakeAtlas()
+{
+	ThumbnailAtlas atlas( CELL );
+	atlas.Reserve( 4 );
+	atlas.Add( "small", RandomImage( 5, 11 ) );
+	atlas.Add( "exact", RandomImage( CELL, CELL ) );
+	atlas.Add( "wide", RandomImage( 64, 8 ) );
+	atlas.Add( "none", UnitsyncImage() );
+	// past the reservation, the grid grows and moves the cells
+	for ( int i = 0; i < 7; ++i )
+		atlas.Add( "map" + std::to_string( i ), RandomImage( 7 + i, 13 - i ) );
+	return atlas;
+}
+
+bool SameEntries( const ThumbnailAtlas& a, const ThumbnailAtlas& b )
+{
+	if ( a.GetCount() != b.GetCount() )
+		return false;
+	ThumbnailAtlas::EntryMap::const_iterator ia = a.GetEntries().begin(), ib = b.GetEntries().begin();
+	for ( ; ia != a.GetEntries().end(); ++ia, ++ib ) {
+		if ( ia->first != ib->first || ia->second.x != ib->second.x || ia->second.y != ib->second.y
+				|| ia->second.width != ib->second.width || ia->second.height != ib->second.height )
+			return false;
+	}
+	return true;
+}
+
+void TestAtlasRoundTrip( const std::string& dir )
+{
+	const std::string path = dir + "/atlas.raw";
+	const ThumbnailAtlas atlas = MakeAtlas();
+	LSL_CHECK( atlas.GetCount() == 11 );
+	ThumbnailAtlas::Entry e;
+	LSL_CHECK( atlas.Get( "wide", e ) && e.width == CELL && e.height <= CELL );
+	LSL_CHECK( atlas.Get( "small", e ) && e.width == 5 && e.height == 11 );
+	LSL_CHECK( atlas.Get( "none", e ) && e.width == 0 );
+	LSL_CHECK( atlas.Save( path ) );
+
+	ThumbnailAtlas loaded( CELL );
+	LSL_CHECK( loaded.Load( path ) );
+	LSL_CHECK( SameEntries( atlas, loaded ) );
+	LSL_CHECK( SameRawFile( atlas.GetImage(), loaded.GetImage(), dir ) );
+	const std::string again = dir + "/again.raw";
+	LSL_CHECK( loaded.Save( again ) );
+	LSL_CHECK( ReadFile( path + ".index" ) == ReadFile( again + ".index" ) );
+
+	// a loaded atlas keeps growing without overwriting the cells it came with
+	loaded.Add( "later", RandomImage( 4, 4 ) );
+	LSL_CHECK( loaded.Get( "later", e ) );
+	for ( ThumbnailAtlas::EntryMap::const_iterator it = atlas.GetEntries().begin(); it != atlas.GetEntries().end(); ++it ) {
+		ThumbnailAtlas::Entry moved;
+		LSL_CHECK( loaded.Get( it->first, moved ) );
+		LSL_CHECK( moved.x != e.x || moved.y != e.y );
+	}
+}
+
+//! \param damage changes a good index, Load has to fail and leave the atlas empty
+template < class Damage >
+void TestAtlasRejected( const std::string& dir, const char* what, Damage damage )
+{
+	const std::string path = dir + "/damaged_atlas.raw";
+	LSL_CHECK( MakeAtlas().Save( path ) );
+	std::string index = ReadFile( path + ".index" );
+	damage( index );
+	WriteFile( path + ".index", index );
+	ThumbnailAtlas atlas( CELL );
+	atlas.Add( "before", RandomImage( 2, 2 ) );
+	if ( atlas.Load( path ) )
+		throw TestFailedException( std::string( "damaged atlas was accepted: " ) + what );
+	LSL_CHECK( atlas.GetCount() == 0 );
+	LSL_CHECK( atlas.GetCellSize() == CELL );
+}
+
+void TestAtlasDamaged( const std::string& dir )
+{
+	const std::string path = dir + "/atlas.raw";
+	LSL_CHECK( MakeAtlas().Save( path ) );
+	// laid out for another cell size
+	ThumbnailAtlas other( CELL * 2 );
+	LSL_CHECK( !other.Load( path ) && other.GetCount() == 0 );
+	LSL_CHECK( !ThumbnailAtlas().Load( path ) );
+
+	TestAtlasRejected( dir, "empty index", []( std::string& index ) { index.clear(); } );
+	TestAtlasRejected( dir, "other header", []( std::string& index ) { index[0] ^= 1; } );
+	TestAtlasRejected( dir, "missing column", []( std::string& index ) {
+		const size_t last_tab = index.rfind( '\t' );
+		index.erase( last_tab, index.find( '\n', last_tab ) - last_tab );
+	} );
+	TestAtlasRejected( dir, "entry outside the image", []( std::string& index ) {
+		index += "stray\t0\t" + std::to_string( CELL * 1000 ) + "\t1\t1\n";
+	} );
+	TestAtlasRejected( dir, "entry between cells", []( std::string& index ) { index += "stray\t1\t0\t1\t1\n"; } );
+	TestAtlasRejected( dir, "thumbnail bigger than a cell", []( std::string& index ) {
+		index += "stray\t0\t0\t" + std::to_string( CELL + 1 ) + "\t1\n";
+	} );
+
+	// index without its image, and the other way round
+	boost::filesystem::remove( path );
+	ThumbnailAtlas atlas( CELL );
+	LSL_CHECK( !atlas.Load( path ) );
+	LSL_CHECK( MakeAtlas().Save( path ) );
+	boost::filesystem::remove( path + ".index" );
+	LSL_CHECK( !atlas.Load( path ) && atlas.GetCount() == 0 );
+}
+
+} // namespace
+
+int main()
+{
+	srand( 7 );
+	const boost::filesystem::path tmp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "lsl-imagefiles-%%%%%%%%" );
+	boost::filesystem::create_directories( tmp );
+	const std::string dir = tmp.string();
+	int ret = 0;
+	try {
+		TestRawRoundTrip( dir );
+		TestRawDamaged( dir );
+		TestAtlasRoundTrip( dir );
+		TestAtlasDamaged( dir );
+	} catch ( std::exception& e ) {
+		std::cerr << e.what() << std::endl;
+		ret = 1;
+	}
+	boost::system::error_code ec;
+	boost::filesystem::remove_all( tmp, ec );
+	return ret;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
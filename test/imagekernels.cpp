@@ -0,0 +1,208 @@
+// ImageKernels: every level the CPU supports against the scalar code
+
+#include <lslunitsync/imagekernels.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace {
+
+namespace IK = LSL::ImageKernels;
+typedef boost::uint8_t u8;
+typedef boost::uint16_t u16;
+typedef boost::uint32_t u32;
+
+//! below, at and above the vector widths, so every tail length shows up
+const size_t COUNTS[] = { 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 100, 255, 1000, 4099 };
+//! start this many elements into the buffers, vector code must not assume alignment
+const size_t SHIFTS[] = { 0, 1, 3 };
+
+u16 Random16()
+{
+	return u16( ( rand() << 4 ) ^ rand() );
+}
+
+//! runs \param kernel at LEVEL_SCALAR and at \param level, with the same arguments
+template < class Kernel >
+void Compare( IK::Level level, Kernel kernel )
+{
+	IK::Use( IK::LEVEL_SCALAR );
+	kernel( true );
+	LSL_CHECK( IK::Use( level ) == level );
+	kernel( false );
+}
+
+void TestMinMax( IK::Level level )
+{
+	for ( size_t c = 0; c < sizeof(COUNTS) / sizeof(COUNTS[0]); ++c ) {
+		for ( size_t s = 0; s < sizeof(SHIFTS) / sizeof(SHIFTS[0]); ++s ) {
+			const size_t count = COUNTS[c], shift = SHIFTS[s];
+			std::vector<u16> data( count + shift );
+			for ( size_t i = 0; i < data.size(); ++i )
+				data[i] = Random16();
+			// the extremes in the tail, where only the remainder loop sees them
+			if ( count > 2 && rand() % 2 ) {
+				data[shift + count - 1] = 0xffff;
+				data[shift + count - 2] = 0;
+			}
+			u16 min[2], max[2];
+			Compare( level, [&]( bool scalar ) { IK::MinMax( &data[shift], count, min[scalar], max[scalar] ); } );
+			LSL_CHECK( min[0] == min[1] && max[0] == max[1] );
+		}
+	}
+}
+
+void TestUnpackRGB565( IK::Level level )
+{
+	for ( size_t c = 0; c < sizeof(COUNTS) / sizeof(COUNTS[0]); ++c ) {
+		for ( size_t s = 0; s < sizeof(SHIFTS) / sizeof(SHIFTS[0]); ++s ) {
+			const size_t count = COUNTS[c], shift = SHIFTS[s];
+			std::vector<u16> colors( count + shift );
+			for ( size_t i = 0; i < colors.size(); ++i )
+				colors[i] = Random16();
+			// one canary past the end, the tail must not be written beyond count
+			std::vector<u8> out[2][3];
+			for ( int k = 0; k < 2; ++k )
+				for ( int ch = 0; ch < 3; ++ch )
+					out[k][ch].assign( count + shift + 1, 0xAB );
+			Compare( level, [&]( bool scalar ) {
+				std::vector<u8>* o = out[scalar];
+				IK::UnpackRGB565( &colors[shift], count, &o[0][shift], &o[1][shift], &o[2][shift] );
+			} );
+			for ( int ch = 0; ch < 3; ++ch ) {
+				LSL_CHECK( out[0][ch] == out[1][ch] );
+				LSL_CHECK( out[1][ch][shift + count] == 0xAB );
+			}
+		}
+	}
+	// the documented exact expansion, on every color
+	std::vector<u16> all( 0x10000 );
+	for ( size_t i = 0; i < all.size(); ++i )
+		all[i] = u16( i );
+	std::vector<u8> r( all.size() ), g( all.size() ), b( all.size() );
+	LSL_CHECK( IK::Use( level ) == level );
+	IK::UnpackRGB565( &all[0], all.size(), &r[0], &g[0], &b[0] );
+	for ( size_t i = 0; i < all.size(); ++i ) {
+		LSL_CHECK( r[i] == ( ( i >> 11 ) & 31 ) * 255 / 31 );
+		LSL_CHECK( g[i] == ( ( i >> 5 ) & 63 ) * 255 / 63 );
+		LSL_CHECK( b[i] == ( i & 31 ) * 255 / 31 );
+	}
+}
+
+void TestMapPalette( IK::Level level )
+{
+	for ( size_t c = 0; c < sizeof(COUNTS) / sizeof(COUNTS[0]); ++c ) {
+		for ( size_t s = 0; s < sizeof(SHIFTS) / sizeof(SHIFTS[0]); ++s ) {
+			const size_t count = COUNTS[c], shift = SHIFTS[s];
+			// heights between offset and offset + palette size, like FromHeightmapData
+			const u16 offset = u16( rand() % 30000 );
+			std::vector<u32> palette( 1 + rand() % 2000 );
+			for ( size_t i = 0; i < palette.size(); ++i )
+				palette[i] = ( u32( Random16() ) << 16 ) | Random16(); // the top byte has to be ignored
+			std::vector<u16> data( count + shift );
+			for ( size_t i = 0; i < data.size(); ++i )
+				data[i] = u16( offset + rand() % palette.size() );
+			std::vector<u8> out[2][3];
+			for ( int k = 0; k < 2; ++k )
+				for ( int ch = 0; ch < 3; ++ch )
+					out[k][ch].assign( count + shift + 1, 0xAB );
+			Compare( level, [&]( bool scalar ) {
+				std::vector<u8>* o = out[scalar];
+				IK::MapPalette( &data[shift], count, offset, &palette[0], &o[0][shift], &o[1][shift], &o[2][shift] );
+			} );
+			for ( int ch = 0; ch < 3; ++ch ) {
+				LSL_CHECK( out[0][ch] == out[1][ch] );
+				LSL_CHECK( out[1][ch][shift + count] == 0xAB );
+			}
+		}
+	}
+}
+
+void TestHalveRows( IK::Level level )
+{
+	for ( size_t c = 0; c < sizeof(COUNTS) / sizeof(COUNTS[0]); ++c ) {
+		for ( size_t s = 0; s < sizeof(SHIFTS) / sizeof(SHIFTS[0]); ++s ) {
+			const size_t count = COUNTS[c], shift = SHIFTS[s];
+			std::vector<u8> top( 2 * count + shift ), bottom( 2 * count + shift );
+			for ( size_t i = 0; i < top.size(); ++i ) {
+				top[i] = u8( rand() );
+				bottom[i] = u8( rand() );
+			}
+			// rounding at the top end, where 8 bit sums overflow
+			if ( rand() % 2 ) {
+				top[shift] = top[shift + 1] = bottom[shift] = 255;
+				bottom[shift + 1] = 254;
+			}
+			std::vector<u8> out[2];
+			out[0].assign( count + shift + 1, 0xAB );
+			out[1] = out[0];
+			Compare( level, [&]( bool scalar ) { IK::HalveRows( &top[shift], &bottom[shift], count, &out[scalar][shift] ); } );
+			LSL_CHECK( out[0] == out[1] );
+			LSL_CHECK( out[1][shift + count] == 0xAB );
+			for ( size_t i = 0; i < count; ++i ) {
+				const unsigned int sum = top[shift + 2 * i] + top[shift + 2 * i + 1] + bottom[shift + 2 * i] + bottom[shift + 2 * i + 1];
+				LSL_CHECK( out[1][shift + i] == ( sum + 2 ) / 4 );
+			}
+		}
+	}
+}
+
+} // namespace
+
+int main()
+{
+	const IK::Level detected = IK::Detect();
+	int ret = 0;
+	try {
+		LSL_CHECK( IK::Use( IK::LEVEL_SCALAR ) == IK::LEVEL_SCALAR );
+		// never more than the CPU has
+		LSL_CHECK( IK::Use( IK::LEVEL_AVX2 ) == detected );
+		const IK::Level levels[] = { IK::LEVEL_SCALAR, IK::LEVEL_SSE2, IK::LEVEL_AVX2 };
+		for ( size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l ) {
+			if ( levels[l] > detected ) {
+				std::cout << IK::Name( levels[l] ) << ": not supported here, skipped" << std::endl;
+				continue;
+			}
+			srand( 1234 );
+			TestMinMax( levels[l] );
+			TestUnpackRGB565( levels[l] );
+			TestMapPalette( levels[l] );
+			TestHalveRows( levels[l] );
+			std::cout << IK::Name( levels[l] ) << ": ok" << std::endl;
+		}
+	} catch ( std::exception& e ) {
+		std::cerr << e.what() << std::endl;
+		ret = 1;
+	}
+	IK::Use( detected );
+	return ret;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
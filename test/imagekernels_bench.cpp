@@ -0,0 +1,105 @@
+// 4096x4096 heightmap through UnitsyncImage::FromHeightmapData at each kernel level
+
+#include <lslunitsync/image.h>
+#include <lslunitsync/imagekernels.h>
+
+#include <boost/format.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "common.h"
+
+namespace {
+
+namespace IK = LSL::ImageKernels;
+
+typedef std::chrono::steady_clock
+	Clock;
+
+const int SIDE = 4096;
+const int RUNS = 5;
+
+//! milliseconds per call of \param work, best of RUNS
+template < class Work >
+double Measure( Work work )
+{
+	double best = 0;
+	for ( int i = 0; i < RUNS; ++i ) {
+		const Clock::time_point start = Clock::now();
+		work();
+		const double ms = std::chrono::duration_cast<std::chrono::microseconds>( Clock::now() - start ).count() / 1000.0;
+		if ( i == 0 || ms < best )
+			best = ms;
+	}
+	return best;
+}
+
+} // namespace
+
+int main()
+{
+	// rolling hills with some noise, spanning most of the 16 bit range like real maps
+	std::vector<unsigned short> heights( size_t( SIDE ) * SIDE );
+	srand( 42 );
+	for ( int y = 0; y < SIDE; ++y ) {
+		for ( int x = 0; x < SIDE; ++x ) {
+			const double h = 0.5 + 0.25 * std::sin( x * 0.003 ) + 0.2 * std::cos( y * 0.005 + x * 0.001 );
+			heights[size_t( y ) * SIDE + x] = static_cast<unsigned short>( h * 60000 + rand() % 512 );
+		}
+	}
+	const IK::Level detected = IK::Detect();
+	std::cout << boost::format( "%dx%d heightmap, best of %d runs\n%-8s %12s %12s %12s\n" )
+		% SIDE % SIDE % RUNS % "" % "full size" % "512x512" % "minmax";
+
+	const IK::Level levels[] = { IK::LEVEL_SCALAR, IK::LEVEL_SSE2, IK::LEVEL_AVX2 };
+	for ( size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l ) {
+		if ( levels[l] > detected )
+			continue;
+		LSL_CHECK( IK::Use( levels[l] ) == levels[l] );
+		const double full = Measure( [&]() {
+			const LSL::UnitsyncImage img = LSL::UnitsyncImage::FromHeightmapData( &heights[0], SIDE, SIDE, SIDE, SIDE );
+			LSL_CHECK( img.GetWidth() == SIDE );
+		} );
+		// what the lobby asks for, the halving loop does most of the work
+		const double small = Measure( [&]() {
+			const LSL::UnitsyncImage img = LSL::UnitsyncImage::FromHeightmapData( &heights[0], SIDE, SIDE );
+			LSL_CHECK( img.GetWidth() == 512 );
+		} );
+		const double minmax = Measure( [&]() {
+			boost::uint16_t min, max;
+			IK::MinMax( &heights[0], heights.size(), min, max );
+			LSL_CHECK( min < max );
+		} );
+		std::cout << boost::format( "%-8s %9.2f ms %9.2f ms %9.2f ms\n" ) % IK::Name( levels[l] ) % full % small % minmax;
+	}
+	IK::Use( detected );
+	return 0;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
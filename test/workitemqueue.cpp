@@ -0,0 +1,197 @@
+// WorkItemQueue heap: run order after Cancel and SetPriority on queued items
+
+#include <lslutils/thread.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "common.h"
+
+namespace {
+
+//! what ran, in order, shared by all items of one test
+struct RunLog
+{
+	RunLog() : gate_started( false ), gate_open( false ) {}
+	boost::mutex lock;
+	boost::condition_variable cond;
+	std::vector<int> ran; // item ids
+	bool gate_started;
+	bool gate_open;
+};
+
+class LoggedItem : public LSL::WorkItem
+{
+public:
+	LoggedItem( RunLog& log, int id ) : m_log( log ), m_id( id ) {}
+	void Run()
+	{
+		boost::mutex::scoped_lock lock( m_log.lock );
+		m_log.ran.push_back( m_id );
+		m_log.cond.notify_all();
+	}
+private:
+	RunLog& m_log;
+	const int m_id;
+};
+
+//! occupies the pool's only thread until Open(), so everything else stays queued
+class GateItem : public LSL::WorkItem
+{
+public:
+	explicit GateItem( RunLog& log ) : m_log( log ) {}
+	void Run()
+	{
+		boost::mutex::scoped_lock lock( m_log.lock );
+		m_log.gate_started = true;
+		m_log.cond.notify_all();
+		while ( !m_log.gate_open )
+			m_log.cond.wait( lock );
+	}
+	void WaitStarted()
+	{
+		boost::mutex::scoped_lock lock( m_log.lock );
+		while ( !m_log.gate_started )
+			m_log.cond.wait( lock );
+	}
+	void Open()
+	{
+		boost::mutex::scoped_lock lock( m_log.lock );
+		m_log.gate_open = true;
+		m_log.cond.notify_all();
+	}
+private:
+	RunLog& m_log;
+};
+
+void WaitForRuns( RunLog& log, size_t count )
+{
+	boost::mutex::scoped_lock lock( log.lock );
+	while ( log.ran.size() < count )
+		log.cond.wait( lock );
+}
+
+/** push \param count items with random priorities behind a gate, cancel and
+ * reprioritize some of them while queued, then check the run order
+ */
+void TestRandomHeap( unsigned int seed, int count )
+{
+	srand( seed );
+	RunLog log;
+	std::vector< std::shared_ptr<LoggedItem> > items;
+	std::vector<int> priority( count );
+	std::vector<bool> cancelled( count, false );
+	LSL::WorkerPool pool( 1 );
+	GateItem gate( log );
+	pool.DoWork( &gate, 1000000, false );
+	gate.WaitStarted();
+
+	for ( int i = 0; i < count; ++i ) {
+		items.push_back( std::make_shared<LoggedItem>( log, i ) );
+		priority[i] = rand() % 10; // many ties, so the FIFO order is exercised too
+		pool.DoWork( items[i].get(), priority[i], false );
+	}
+	for ( int round = 0; round < count; ++round ) {
+		const int i = rand() % count;
+		if ( cancelled[i] )
+			continue;
+		if ( rand() % 3 == 0 ) {
+			LSL_CHECK( items[i]->Cancel() );
+			LSL_CHECK( !items[i]->Cancel() ); // already out of the queue
+			LSL_CHECK( !items[i]->SetPriority( 5 ) );
+			cancelled[i] = true;
+		} else {
+			priority[i] = rand() % 20 - 5;
+			LSL_CHECK( items[i]->SetPriority( priority[i] ) );
+			LSL_CHECK( items[i]->GetPriority() == priority[i] );
+		}
+	}
+	size_t expected = 0;
+	for ( int i = 0; i < count; ++i )
+		expected += cancelled[i] ? 0 : 1;
+
+	gate.Open();
+	WaitForRuns( log, expected );
+	pool.Wait();
+
+	LSL_CHECK( log.ran.size() == expected );
+	std::vector<bool> seen( count, false );
+	for ( size_t n = 0; n < log.ran.size(); ++n ) {
+		const int id = log.ran[n];
+		LSL_CHECK( !cancelled[id] );
+		LSL_CHECK( !seen[id] );
+		seen[id] = true;
+		if ( n == 0 )
+			continue;
+		// highest priority first; a reprioritized item counts as pushed when first queued
+		const int prev = log.ran[n - 1];
+		LSL_CHECK( priority[prev] > priority[id] || ( priority[prev] == priority[id] && prev < id ) );
+	}
+	// ran items are out of the queue
+	LSL_CHECK( log.ran.empty() || !items[log.ran[0]]->Cancel() );
+}
+
+void TestCancelLast()
+{
+	RunLog log;
+	LSL::WorkerPool pool( 1 );
+	GateItem gate( log );
+	pool.DoWork( &gate, 100, false );
+	gate.WaitStarted();
+	LoggedItem a( log, 0 ), b( log, 1 ), c( log, 2 );
+	pool.DoWork( &a, 3, false );
+	pool.DoWork( &b, 2, false );
+	pool.DoWork( &c, 1, false );
+	// the last heap slot and the root
+	LSL_CHECK( c.Cancel() );
+	LSL_CHECK( a.Cancel() );
+	LSL_CHECK( b.SetPriority( 7 ) );
+	gate.Open();
+	WaitForRuns( log, 1 );
+	pool.Wait();
+	LSL_CHECK( log.ran.size() == 1 && log.ran[0] == 1 );
+}
+
+} // namespace
+
+int main()
+{
+	try {
+		TestCancelLast();
+		for ( unsigned int seed = 1; seed <= 20; ++seed )
+			TestRandomHeap( seed, 10 * seed );
+	} catch ( std::exception& e ) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+Copyright 2012 by The libSpringLobby team. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/